@@ -1,277 +1,644 @@
 #include "ARMv6_Assembler.h"
+#include "ARMv6_Mnemonics.h"
+#include "ARMv6_Lexer.h"
+#include "ARMv6_Object.h"
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <cctype>
+#include <fcntl.h>			// For open()
+#include <sys/mman.h>		// For mmap()
+#include <sys/stat.h>		// For fstat()
+#include <unistd.h>			// For close()
 #include <ctype.h>			// For toupper() / tolower()
 #include <bits/stdc++.h>	// For sort()
 #include <iomanip>			// For setfill(), setw()
 #include <string>
+#include <memory>
+#include <atomic>
+#include <thread>
 #include <vector>
 // C library
-extern "C" {
-	#include "basiclib_string.h"
-}
 
 
-ARMv6_Assembler::ARMv6_Assembler(string asmFilePath) {
-	vector<string> asmLines = readASMFile(asmFilePath);
-	vector<char**> instArgs;
-	vector<string> parsedLine;
+ARMv6_Assembler::ARMv6_Assembler(string asmFilePath, int logLvl) : ARMv6_Assembler(vector<string>{asmFilePath}, logLvl) {}
 
+ARMv6_Assembler::ARMv6_Assembler(vector<string> asmFilePaths, int logLvl) {
+	this -> logLvl = logLvl;
 	PC = INST_BASEADDR;		// Reset PC
 
-	cout << "[ASSEMBLER] First parse of assembly lines for formatting and labels." << endl;
-	// Only parses assembly line and add labels found; does not increment PC
-	for (int i=0; i<asmLines.size(); i++) {
-		// Remove starting spaces and tabs
-		if (asmLines.at(i).find_first_not_of(" \t") != string::npos)
-			asmLines.at(i).erase(0, asmLines.at(i).find_first_not_of(" \t"));
+	if (asmFilePaths.size() == 1) {
+		assembleFile(asmFilePaths[0]);
+	}
+	else {
+		vector<size_t> all;
+		for (auto &path: asmFilePaths) {
+			all.push_back(units.size());
+			units.push_back(ARMv6_Assembler());
+			units.back().logLvl = logLvl;
+			units.back().sourcePath = path;
+		}
+		assembleUnits(all);
+		link();
+	}
+	finish(true);
+}
 
-		// Remove comments
-		if (asmLines.at(i).find(";") != -1) {
-			asmLines.at(i).erase(asmLines.at(i).find(";"));
+void ARMv6_Assembler::assembleUnits(const vector<size_t> &indices) {
+	// Each worker takes the next unit until none are left
+	atomic<size_t> next(0);
+	auto worker = [&]() {
+		for (size_t i=next++; i<indices.size(); i=next++) {
+			ARMv6_Assembler &unit = units[indices[i]];
+			unit.clearProgram();
+			unit.sourceRead = false;
+			unit.assembleFile(unit.sourcePath);
 		}
+	};
+	size_t threadCount = min<size_t>(max(thread::hardware_concurrency(), 1u), indices.size());
+	vector<thread> workers;
+	for (size_t i=1; i<threadCount; i++) {
+		workers.emplace_back(worker);
+	}
+	worker();
+	for (auto &it: workers) {
+		it.join();
+	}
+}
+
+void ARMv6_Assembler::link() {
+	clearProgram();
+	vector<string> paths;
+	vector<uint64_t> hashes;
+	sourceRead = true;
+	for (auto &unit: units) {
+		// Units are kept as assembled so unchanged ones can be linked again
+		ARMv6_Assembler copy(unit);
+		mergeChunk(copy, unit.sourcePath);
+		paths.push_back(unit.sourcePath);
+		hashes.push_back(unit.sourceHash);
+		sourceRead = sourceRead and unit.sourceRead;
+	}
+	sourceHash = ARMv6_Object::combineHashes(paths, hashes);
+}
 
-		// Add parsed line to list for logging later
-		string line = strReplace(&asmLines.at(i)[0], (char*)"\t", (char*)" ", -1);
-		line += "\0";
-		// If string is empty skip
-		if (line.find_first_not_of(' ') == string::npos) {
-			asmLines.erase(asmLines.begin()+i);
-			i--;
+void ARMv6_Assembler::finish(bool print) {
+	passRecords = diagnostics.size();
+	resolveFixups();
+	report(print);
+}
+
+void ARMv6_Assembler::report(bool print) {
+	currentLine = 0;
+	if (labels.find("main") == labels.end())
+		log("Label \"main\" not found, assuming starting address as "s + to_string(INST_BASEADDR), 2);
+
+	int instructions = 0;
+	int dropped = 0;
+	uint32_t firstError = 0;
+	for (auto &source: sourceLines) {
+		// Instruction dropped while resolving labels
+		bool invalid = source.entry < 0 ? source.result.invalid : finalOpcodes.at(source.entry).second.invalid;
+		if (source.entry >= 0 and !invalid) {
+			OpcodeResult &result = finalOpcodes.at(source.entry).second;
+			instructions++;
+			if (logLvl >= ARMv6_Diagnostics::LOG_VERBOSE)
+				diagnostics.addListing(source.line, source.text, result.opcode, result.i32);
 			continue;
 		}
-		parsedLine.push_back(line);
-		// Separate instruction into arguments list by ' ' or ','
-		char** args = strtokSplit(&asmLines.at(i)[0], (char*)" ,\t");
-		// Add parsed arguments to vector
-		instArgs.push_back(args);
-
-		if (args[0][strlen(args[0])-1] == ':') {
-			addLabel(args[0]);
+		// Label only lines are marked invalid but are not errors
+		bool labelOnly = source.entry < 0 and source.result.label;
+		if (invalid and !labelOnly) {
+			dropped++;
+			firstError = firstError ? firstError : source.line;
+		}
+		if (logLvl < ARMv6_Diagnostics::LOG_VERBOSE)
+			continue;
+		if (source.result.unsupported)
+			diagnostics.addListing(source.line, source.text, "unsupported; ignored");
+		else if (source.result.directive)
+			diagnostics.addListing(source.line, source.text, "directive");
+		else if (labelOnly)
+			diagnostics.addListing(source.line, source.text, "label");
+		else
+			diagnostics.addListing(source.line, source.text, "not assembled");
+	}
+
+	summary = "[ASSEMBLER] "s + to_string(instructions) + " instructions, " + to_string(PC - INST_BASEADDR) + " bytes, "
+		+ to_string(labels.size()) + " labels from " + to_string(lineCount) + " lines; "
+		+ to_string(dropped) + " lines not assembled, " + to_string(diagnostics.count(ARMv6_Diagnostics::sevError)) + " errors, "
+		+ to_string(diagnostics.count(ARMv6_Diagnostics::sevWarning)) + " warnings";
+	// Point at the first problem so the full listing is rarely needed
+	for (auto &it: diagnostics.getRecords()) {
+		if (it.severity == ARMv6_Diagnostics::sevError and firstError > 0 and it.line == firstError) {
+			summary += "; " + diagnostics.location(it.line) + ": " + it.message;
+			break;
 		}
 	}
-	cout << "[ASSEMBLER] Added all labels to list. Beginning second parse to finalize labels." << endl;
-	for (int i=0; i<instArgs.size(); i++) {
-		OpcodeResult result = genOpcode(instArgs.at(i), true);
+
+	if (print and logLvl >= ARMv6_Diagnostics::LOG_VERBOSE)
+		diagnostics.print(stdout);
+	if (print and logLvl >= ARMv6_Diagnostics::LOG_SUMMARY) {
+		printf("%s\n", summary.c_str());
+		fflush(stdout);
 	}
-	PC = INST_BASEADDR;		// Reset PC
-	cout << "[ASSEMBLER] Finalized all labels. Beginning final parse." << endl;
-	for (int i=0; i<instArgs.size(); i++) {
-		OpcodeResult result = genOpcode(instArgs.at(i), false);
-		cout << "  Input Line " << i << setfill(' ') << setw(intLen(instArgs.size())-intLen(i)) << "\t";
-		if (!result.invalid and !result.unsupported) {
-			printf("[0x%X] opcode generated from:  ", result.opcode);
-			//cout << asmLines.at(i) << endl;
-			cout << parsedLine.at(i) << endl;
-
-			pair<string, OpcodeResult> opcodePair(parsedLine.at(i), result);
-			finalOpcodes.push_back(opcodePair);
+}
+
+bool ARMv6_Assembler::writeDiagnostics(string path) {
+	return diagnostics.writeJSON(path);
+}
+
+string ARMv6_Assembler::getSummary() {
+	return summary;
+}
+
+// FNV-1a; only compared against hashes of the previous version of the same file
+static uint64_t hashLine(string_view line) {
+	uint64_t hash = 14695981039346656037ULL;
+	for (char c: line) {
+		hash = (hash ^ (uint8_t)c) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+bool ARMv6_Assembler::reassemble() {
+	if (units.empty())
+		return reassembleFile();
+
+	vector<size_t> changed;
+	for (size_t i=0; i<units.size(); i++) {
+		uint64_t hash;
+		if (!ARMv6_Object::hashFile(units[i].sourcePath, hash) or hash != units[i].sourceHash or !units[i].sourceRead)
+			changed.push_back(i);
+	}
+	if (changed.empty())
+		return 0;
+	assembleUnits(changed);
+	link();
+	finish(false);
+	return 1;
+}
+
+bool ARMv6_Assembler::reassembleFile() {
+	size_t fileSize;
+	const char* file = mapFile(sourcePath, fileSize);
+	if (file == nullptr)
+		return 0;
+	const char* end = file + fileSize;
+	sourceHash = ARMv6_Object::hashSource(file, fileSize);
+	sourceRead = true;
+
+	vector<string_view> lines;
+	vector<uint64_t> hashes;
+	for (const char* pos=file; pos<end;) {
+		const char* eol = (const char*) memchr(pos, '\n', end - pos);
+		if (eol == nullptr)
+			eol = end;
+		lines.push_back(string_view(pos, eol - pos));
+		hashes.push_back(hashLine(lines.back()));
+		pos = eol + 1;
+	}
+
+	// Unchanged lines at the start and end of the file
+	size_t oldCount = lineHashes.size();
+	size_t newCount = lines.size();
+	size_t prefix = 0;
+	while (prefix < oldCount and prefix < newCount and lineHashes[prefix] == hashes[prefix]) {
+		prefix++;
+	}
+	size_t suffix = 0;
+	while (
+			suffix < oldCount - prefix and suffix < newCount - prefix and
+			lineHashes[oldCount-1-suffix] == hashes[newCount-1-suffix]
+		) {
+		suffix++;
+	}
+	if (prefix == oldCount and prefix == newCount) {
+		unmapFile(file, fileSize);
+		return 0;
+	}
+
+	// Messages from resolving labels and the listing are made again
+	diagnostics.truncate(passRecords);
+	if (labelRedefined) {
+		clearProgram();
+		assembleRange(file, end);
+	}
+	else {
+		ARMv6_Assembler tail;
+		splitAt(prefix, oldCount - suffix, tail);
+		for (size_t i=prefix; i<newCount-suffix; i++) {
+			currentLine = ++lineCount;
+			lineHashes.push_back(hashes[i]);
+			assembleLine(lines[i]);
 		}
-		else if (result.unsupported) {
-			cout << "Unsupported instruction; Ignoring  ";
-			cout << parsedLine.at(i) << endl;
+		mergeChunk(tail);
+	}
+	unmapFile(file, fileSize);
+
+	relayoutNeeded = true;
+	finish(false);
+	return 1;
+}
+
+void ARMv6_Assembler::splitAt(uint32_t keepUpTo, uint32_t tailAfter, ARMv6_Assembler &tail) {
+	// Source lines, entries and fixups are all in line order; find where each cut falls
+	size_t keptLines = 0;
+	while (keptLines < sourceLines.size() and sourceLines[keptLines].line <= keepUpTo) {
+		keptLines++;
+	}
+	size_t tailLines = keptLines;
+	while (tailLines < sourceLines.size() and sourceLines[tailLines].line <= tailAfter) {
+		tailLines++;
+	}
+	size_t keptEntries = finalOpcodes.size();
+	size_t tailEntries = finalOpcodes.size();
+	for (size_t i=sourceLines.size(); i-->keptLines;) {
+		if (sourceLines[i].entry < 0)
+			continue;
+		keptEntries = sourceLines[i].entry;
+		if (i >= tailLines)
+			tailEntries = sourceLines[i].entry;
+	}
+	int keptFixups = 0;
+	while (keptFixups < (int)fixups.size() and fixups[keptFixups].line <= keepUpTo) {
+		keptFixups++;
+	}
+	int tailFixups = keptFixups;
+	while (tailFixups < (int)fixups.size() and fixups[tailFixups].line <= tailAfter) {
+		tailFixups++;
+	}
+
+	tail.logLvl = logLvl;
+	tail.lineCount = lineCount - tailAfter;
+	tail.lineHashes.assign(lineHashes.begin() + tailAfter, lineHashes.end());
+	for (size_t i=tailEntries; i<finalOpcodes.size(); i++) {
+		tail.finalOpcodes.push_back(move(finalOpcodes[i]));
+	}
+	for (size_t i=tailLines; i<sourceLines.size(); i++) {
+		SourceLine &source = sourceLines[i];
+		if (source.entry >= 0)
+			source.entry -= tailEntries;
+		source.line -= tailAfter;
+		tail.sourceLines.push_back(move(source));
+	}
+	for (size_t i=tailFixups; i<fixups.size(); i++) {
+		Fixup fixup = fixups[i];
+		fixup.entry -= tailEntries;
+		fixup.line -= tailAfter;
+		fixup.next = fixup.next >= tailFixups ? fixup.next - tailFixups : -1;
+		tail.fixups.push_back(fixup);
+	}
+	diagnostics.split(keepUpTo, tailAfter, tail.diagnostics);
+
+	for (auto it=symbols.begin(); it!=symbols.end();) {
+		Symbol &symbol = it->second;
+		// Chains run from the latest use back, so uses after a cut are at the head
+		if (symbol.chain >= tailFixups)
+			tail.symbols[it->first].chain = symbol.chain - tailFixups;
+		while (symbol.chain >= keptFixups) {
+			symbol.chain = fixups[symbol.chain].next;
 		}
-		// Do nothing on label
-		else if (result.label) {
-			cout << "Label found; Ignoring  ";
-			cout << parsedLine.at(i) << endl;
+		if (symbol.defined and symbol.line > tailAfter) {
+			Symbol &tailSymbol = tail.symbols[it->first];
+			tailSymbol.defined = true;
+			tailSymbol.entry = symbol.entry - tailEntries;
+			tailSymbol.line = symbol.line - tailAfter;
 		}
-		else {
-			cout << "Error parsing instruction: " << parsedLine.at(i) << endl;
+		if (symbol.defined and symbol.line > keepUpTo) {
+			symbol.defined = false;
+			labels.erase(it->first);
 		}
+		if (!symbol.defined and symbol.chain < 0)
+			it = symbols.erase(it);
+		else
+			it++;
+	}
+
+	finalOpcodes.resize(keptEntries);
+	sourceLines.resize(keptLines);
+	fixups.resize(keptFixups);
+	lineHashes.resize(keepUpTo);
+	lineCount = keepUpTo;
+	// Continue after the last kept instruction
+	PC = INST_BASEADDR;
+	for (auto &it: finalOpcodes) {
+		if (!it.second.invalid)
+			PC += it.second.i32 ? 4 : 2;
 	}
-	cout << "[ASSEMBLER] Finished generating all opcodes." << endl;
+}
+
+void ARMv6_Assembler::clearProgram() {
+	finalOpcodes.clear();
+	sourceLines.clear();
+	fixups.clear();
+	symbols.clear();
+	labels.clear();
+	diagnostics = ARMv6_Diagnostics();
+	globals.clear();
+	lineHashes.clear();
+	lineCount = 0;
+	PC = INST_BASEADDR;
+	relayoutNeeded = false;
+	labelRedefined = false;
+}
+
+bool ARMv6_Assembler::patchFixupChain(Symbol &symbol, uint32_t labelAddr, bool logErrors) {
+	bool dropped = false;
+	for (int i=symbol.chain; i>=0; i=fixups.at(i).next) {
+		Fixup &fixup = fixups.at(i);
+		OpcodeResult &result = finalOpcodes.at(fixup.entry).second;
+		if (result.invalid)
+			continue;
+		if (logErrors)
+			currentLine = fixup.line;
+		if (!encodeLabelOffset(fixup.kind, result.opcode, labelAddr - fixup.addr, logErrors)) {
+			result.invalid = 1;
+			dropped = true;
+		}
+	}
+	return dropped;
+}
+
+void ARMv6_Assembler::resolveFixups() {
+	bool relayout = relayoutNeeded;
+
+	// Offsets that did not fit while assembling are checked again with all lines placed
+	for (auto &fixup: fixups) {
+		OpcodeResult &result = finalOpcodes.at(fixup.entry).second;
+		relayout = relayout or result.invalid;
+		result.invalid = 0;
+	}
+	// Labels used but never defined
+	for (auto &it: symbols) {
+		if (it.second.defined)
+			continue;
+		for (int i=it.second.chain; i>=0; i=fixups.at(i).next) {
+			currentLine = fixups.at(i).line;
+			log("Invalid label: no label with name \""s + it.first + "\" found!", 1);
+			finalOpcodes.at(fixups.at(i).entry).second.invalid = 1;
+			relayout = true;
+		}
+	}
+
+	// Dropping an instruction moves everything after it; repeat until all offsets fit.
+	// A use is only dropped, with an error, when it does not fit at its current address,
+	// so every round drops at least one line or ends the loop
+	while (relayout) {
+		relayout = false;
+		vector<uint32_t> addrAt(finalOpcodes.size() + 1);
+		uint32_t addr = INST_BASEADDR;
+		for (size_t i=0; i<finalOpcodes.size(); i++) {
+			addrAt[i] = addr;
+			OpcodeResult &result = finalOpcodes.at(i).second;
+			if (!result.invalid)
+				addr += result.i32 ? 4 : 2;
+		}
+		addrAt[finalOpcodes.size()] = addr;
+		PC = addr;
+
+		for (auto &fixup: fixups) {
+			fixup.addr = addrAt[fixup.entry];
+		}
+		for (auto &it: symbols) {
+			if (!it.second.defined)
+				continue;
+			labels[it.first] = addrAt[it.second.entry];
+		}
+		for (auto &it: symbols) {
+			if (it.second.defined and patchFixupChain(it.second, labels[it.first], true))
+				relayout = true;
+		}
+	}
+	relayoutNeeded = false;
 }
 
 uint32_t ARMv6_Assembler::getStartAddr() {
-	if (labels.find("main") == labels.end()) {
-		log("Label \"main\" not found, assuming starting address as "s + to_string(INST_BASEADDR), 1);
+	// Reported once by report()
+	if (labels.find("main") == labels.end())
 		return INST_BASEADDR;
-	}
 
 	return labels.find("main") -> second;
 }
 
 
-vector<pair<string, ARMv6_Assembler::OpcodeResult>> ARMv6_Assembler::getFinalResult() {
-	// for (auto &it: finalOpcodes) {
-	// 	if (it.second.i32)
-	// 		printf("%08x\t%s\n", it.second.opcode, it.first.c_str());
-	// 	else
-	// 		printf("%04x\t%s\n", it.second.opcode, it.first.c_str());
-	// }
-	return finalOpcodes;
+ARMv6_Program ARMv6_Assembler::getProgram() {
+	// Leave out instructions dropped while resolving labels
+	ARMv6_Program program(INST_BASEADDR);
+	program.reserve(finalOpcodes.size());
+	for (auto &source: sourceLines) {
+		if (source.entry < 0)
+			continue;
+		auto &it = finalOpcodes.at(source.entry);
+		if (!it.second.invalid)
+			program.append(it.second.opcode, it.second.i32, it.second.label, it.first, source.line);
+	}
+	program.setLabels(labels);
+	program.setStartAddr(getStartAddr());
+	return program;
+}
+
+uint64_t ARMv6_Assembler::getSourceHash() {
+	return sourceHash;
 }
 
-vector<string> ARMv6_Assembler::readASMFile(string fpath) {
-	vector<string> out;
-
-	string line;
-	// OPen file using given file path
-	ifstream file(fpath);
-	if (file.is_open()) {
-		while (getline(file, line)) {
-			// Only add line to vector if line is not empty
-			if (line != "")
-				out.push_back(line);
-		}
-		// Clean up
-		file.close();
-	}
-	else {
+bool ARMv6_Assembler::saveObject(string dirPath, const ARMv6_Program &program) {
+	if (!sourceRead)
+		return false;
+	return ARMv6_Object::save(dirPath, sourceHash, program, summary);
+}
+
+const char* ARMv6_Assembler::mapFile(string fpath, size_t &size) {
+	int fd = open(fpath.c_str(), O_RDONLY);
+	struct stat st;
+	if (fd < 0 or fstat(fd, &st) != 0) {
 		log("Unable to open file "s + fpath, 1);
+		if (fd >= 0)
+			close(fd);
+		return nullptr;
+	}
+	size = st.st_size;
+	// Nothing to map
+	if (size == 0) {
+		close(fd);
+		return "";
+	}
+	const char* file = (const char*) mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (file == MAP_FAILED) {
+		log("Unable to map file "s + fpath, 1);
+		return nullptr;
 	}
+	madvise((void*)file, size, MADV_SEQUENTIAL);
+	return file;
+}
 
-	return out;
+void ARMv6_Assembler::unmapFile(const char* file, size_t size) {
+	if (size > 0)
+		munmap((void*)file, size);
 }
 
-uint16_t ARMv6_Assembler::djb2Hash(string text) {
-	uint16_t hash = 5381;
-	// Go through each character in string
-	for (int i=0; i<text.length(); i++) {
-		hash = ((hash << 5) + hash) + toupper(text[i]);
+bool ARMv6_Assembler::assembleFile(string fpath) {
+	sourcePath = fpath;
+	size_t fileSize;
+	const char* file = mapFile(fpath, fileSize);
+	if (file == nullptr)
+		return 0;
+	const char* end = file + fileSize;
+	sourceHash = ARMv6_Object::hashSource(file, fileSize);
+	sourceRead = true;
+
+	// Split large files at line boundaries into one chunk per thread
+	size_t chunkCount = thread::hardware_concurrency();
+	chunkCount = min(chunkCount, fileSize / MIN_CHUNK_BYTES);
+	if (chunkCount <= 1) {
+		assembleRange(file, end);
+		unmapFile(file, fileSize);
+		return 1;
 	}
-	return hash;
+	vector<const char*> bounds = {file};
+	for (size_t i=1; i<chunkCount; i++) {
+		const char* pos = max(bounds.back(), file + fileSize * i / chunkCount);
+		const char* eol = (const char*) memchr(pos, '\n', end - pos);
+		if (eol == nullptr)
+			break;
+		bounds.push_back(eol + 1);
+	}
+	bounds.push_back(end);
+
+	// Each chunk is assembled as if it started at the base address; addresses and
+	// labels are fixed up when the chunks are joined in source order
+	vector<unique_ptr<ARMv6_Assembler>> chunks;
+	vector<thread> workers;
+	for (size_t i=0; i+1<bounds.size(); i++) {
+		chunks.emplace_back(new ARMv6_Assembler());
+		chunks.back() -> logLvl = logLvl;
+		workers.emplace_back(&ARMv6_Assembler::assembleRange, chunks.back().get(), bounds[i], bounds[i+1]);
+	}
+	for (size_t i=0; i<workers.size(); i++) {
+		workers[i].join();
+		mergeChunk(*chunks[i]);
+	}
+
+	unmapFile(file, fileSize);
+	return 1;
 }
 
-bool ARMv6_Assembler::hashUniqueCheck() {
-	// Cortex-M0+ Devices Generic User Guide 3.1 
-	string instructionSet[] = {
-		"ADCS",
-		"ADD",
-		"ADDS",
-		"ADR",
-		"ANDS",
-		"ASRS",
-		"B",
-		"BEQ",
-		"BNE",
-		"BCS",
-		"BHS",
-		"BCC",
-		"BLO",
-		"BMI",
-		"BPL",
-		"BVS",
-		"BVC",
-		"BHI",
-		"BLS",
-		"BGE",
-		"BLT",
-		"BGT",
-		"BLE",
-		"BAL",
-		"BICS",
-		"BKPT",
-		"BL",
-		"BLX",
-		"BX",
-		"CMN",
-		"CMP",
-		"CPSID",
-		"CPSIE",
-		"CPY",
-		"DMB",
-		"DSB",
-		"EORS",
-		"ISB",
-		"LDM",
-		"LDMIA",
-		"LDMFD",
-		"LDR",
-		"LDRB",
-		"LDRH",
-		"LDRSB",
-		"LDRSH",
-		"LSLS",
-		"LSRS",
-		"MOV",
-		"MOVS",
-		"MRS",
-		"MSR",
-		"MULS",
-		"MVNS",
-		"NOP",
-		"ORRS",
-		"POP",
-		"PUSH",
-		"REV",
-		"REV16",
-		"REVSH",
-		"RORS",
-		"RSBS",
-		"SBCS",
-		"SEV",
-		"STM",
-		"STMIA",
-		"STMEA",
-		"STR",
-		"STRB",
-		"STRH",
-		"SUB",
-		"SUBS",
-		"SVC",
-		"SXTB",
-		"SXTH",
-		"TST",
-		"UDF",
-		"UXTB",
-		"UXTH",
-		"WFE",
-		"WFI",
-		"YIELD"
-	};
+void ARMv6_Assembler::assembleRange(const char* begin, const char* end) {
+	// Lines are assembled straight from the mapping
+	for (const char* pos=begin; pos<end;) {
+		const char* eol = (const char*) memchr(pos, '\n', end - pos);
+		if (eol == nullptr)
+			eol = end;
+		string_view line(pos, eol - pos);
+		currentLine = ++lineCount;
+		lineHashes.push_back(hashLine(line));
+		assembleLine(line);
+		pos = eol + 1;
+	}
+}
+
+void ARMv6_Assembler::mergeChunk(ARMv6_Assembler &chunk, string unitName) {
+	size_t entryBase = finalOpcodes.size();
+	int fixupBase = fixups.size();
+	uint32_t lineBase = lineCount;
+	lineCount += chunk.lineCount;
+	lineHashes.insert(lineHashes.end(), chunk.lineHashes.begin(), chunk.lineHashes.end());
+	if (!unitName.empty())
+		diagnostics.addUnit(lineBase, unitName);
+	diagnostics.append(chunk.diagnostics, lineBase);
+
+	for (auto &it: chunk.finalOpcodes) {
+		finalOpcodes.push_back(move(it));
+	}
+	for (auto &it: chunk.sourceLines) {
+		if (it.entry >= 0)
+			it.entry += entryBase;
+		it.line += lineBase;
+		sourceLines.push_back(move(it));
+	}
+	for (auto fixup: chunk.fixups) {
+		fixup.entry += entryBase;
+		if (fixup.next >= 0)
+			fixup.next += fixupBase;
+		fixup.line += lineBase;
+		fixups.push_back(fixup);
+	}
 
-	int instructionSetSize = sizeof(instructionSet)/sizeof(string);
-	// Get hash for every instruction
-	uint16_t hash[instructionSetSize];
-	for (int i=0; i<instructionSetSize; i++) {
-		hash[i] = djb2Hash(instructionSet[i]);
-		printf("%04x   %s\n", hash[i], instructionSet[i].c_str());
-	}
-	// Sort hash values
-	sort(hash, hash+instructionSetSize);
-	// Count number of collisions
-	int collision = 0;
-	for (int i=1; i<instructionSetSize; i++) {
-		if (hash[i] == hash[i-1]) {
-			collision++;
+	for (auto &it: chunk.symbols) {
+		// Labels defined in a file without .global stay private to it
+		bool local = !unitName.empty() and it.second.defined and chunk.globals.count(it.first) == 0;
+		string name = local ? unitName + ":" + it.first : it.first;
+		Symbol &symbol = symbols[name];
+		// Append the chunk's uses to the label's chain
+		if (it.second.chain >= 0) {
+			int tail = it.second.chain + fixupBase;
+			while (fixups.at(tail).next >= 0) {
+				tail = fixups.at(tail).next;
+			}
+			fixups.at(tail).next = symbol.chain;
+			symbol.chain = it.second.chain + fixupBase;
+		}
+		if (!it.second.defined)
+			continue;
+		if (symbol.defined) {
+			currentLine = it.second.line + lineBase;
+			log("Replacing existing label " + it.first, 2);
+			labelRedefined = true;
 		}
+		symbol.defined = true;
+		symbol.entry = it.second.entry + entryBase;
+		symbol.line = it.second.line + lineBase;
 	}
 
-	cout << "Collisions: " << collision << endl;
-	return ~collision;
-};
-
-
-int ARMv6_Assembler::getRegNum(char* reg) {
-	// Assumes input is in format of "Rn" where n is 0-15
-	if (strlen(reg) < 2)
-		return -1;
-	// Convert to upper case
-	string capReg = upString(reg);
-
-	if (capReg[0] == 'R') {
-		int out = strtol(reg+1, NULL, 0);
-		if (out > 0 and out < 16)
-			return out;
-		if (capReg == "R0")
-			return 0;
-		return -1;
-	}
-	if (capReg == "SP")
-		return 13;
-	if (capReg == "LR")
-		return 14;
-	if (capReg == "PC")
-		return 15;
-	return -1;
+	if (unitName.empty())
+		globals.insert(chunk.globals.begin(), chunk.globals.end());
+
+	// Offsets were encoded against chunk addresses
+	relayoutNeeded = true;
+	labelRedefined = labelRedefined or chunk.labelRedefined;
 }
 
-uint8_t ARMv6_Assembler::getSYSm(char* spReg) {
-	map<string, int> sysmValues = {
+void ARMv6_Assembler::assembleLine(string_view asmLine) {
+	// Remove comments
+	const char* comment = (const char*) memchr(asmLine.data(), ';', asmLine.size());
+	if (comment != nullptr)
+		asmLine = asmLine.substr(0, comment - asmLine.data());
+	// Remove starting spaces and tabs
+	size_t start = asmLine.find_first_not_of(" \t");
+	if (start == string_view::npos)
+		return;
+	asmLine.remove_prefix(start);
+
+	// Separate instruction into tokens by ' ' or ','; tokens point into the mapped file
+	ARMv6_Token tokens[ARMv6_Lexer::MAX_TOKENS];
+	ARMv6_Args args(tokens, ARMv6_Lexer::tokenize(asmLine, tokens));
+	// If string is empty skip
+	if (args.size() == 0)
+		return;
+	// Keep parsed line for logging later
+	string line(asmLine);
+	replace(line.begin(), line.end(), '\t', ' ');
+
+	uint32_t addr = PC;
+	pendingUse.active = false;
+	OpcodeResult result = genOpcode(args);
+	SourceLine source = {line, result, -1, currentLine};
+	if (!result.invalid and !result.unsupported and !result.directive) {
+		source.entry = finalOpcodes.size();
+		// Link the label use into the label's fixup chain
+		if (pendingUse.active) {
+			Symbol &symbol = symbols[pendingUse.label];
+			fixups.push_back({pendingUse.kind, finalOpcodes.size(), addr, symbol.chain, currentLine});
+			symbol.chain = fixups.size() - 1;
+		}
+		finalOpcodes.push_back(pair<string, OpcodeResult>(line, result));
+	}
+	sourceLines.push_back(move(source));
+}
+
+uint8_t ARMv6_Assembler::getSYSm(string_view spReg) {
+	static const map<string_view, int> sysmValues = {
 		{"APSR",    0},
 		{"IAPSR",   1},
 		{"EAPSR",   2},
@@ -286,10 +653,9 @@ uint8_t ARMv6_Assembler::getSYSm(char* spReg) {
 	};
 
 	// No special register found
-	if(sysmValues.count(spReg))
+	if (sysmValues.count(spReg) == 0)
 		return 0b11111111;
-	else
-		return sysmValues.at(spReg);
+	return sysmValues.at(spReg);
 }
 
 
@@ -297,40 +663,115 @@ bool ARMv6_Assembler::addLabel(string label) {
 	// Remove ':' from label
 	label.pop_back();
 
-	if (labels.find(label) != labels.end()) {
+	Symbol &symbol = symbols[label];
+	if (symbol.defined) {
 		// log("Invalid label: label already exists!", 1);
 		// return 0;
-		log("Replacing existing label " + label, 1);
-		labels.find(label) -> second = PC;
-		return 1;
+		log("Replacing existing label " + label, 2);
+		relayoutNeeded = true;
+		labelRedefined = true;
 	}
-	
-	// Add label to list
+	else {
+		log("Added '"s + label + "' to labels", 3);
+	}
+
+	// Add label to list and patch earlier uses
 	labels[label] = PC;
-	log("Added '"s + label + "' to labels", 2);
+	symbol.defined = true;
+	symbol.entry = finalOpcodes.size();
+	symbol.line = currentLine;
+	patchFixupChain(symbol, PC);
 	return 1;
 }
 
-pair<bool, int> ARMv6_Assembler::labelOffsetLookup(string label) {
+pair<bool, int> ARMv6_Assembler::labelOffsetLookup(string label, FixupKind kind) {
 	// Boolean value -> if output is valid(1) or invalid(0)
-	// Integer -> immediate offset of label
-	pair<bool, uint32_t> out(1, 0);
+	// Integer -> address of label
+	pair<bool, uint32_t> out(1, PC);
+
+	pendingUse.active = true;
+	pendingUse.label = label;
+	pendingUse.kind = kind;
 
-	// No label found
-	if (labels.find(label) == labels.end()) {
-		log("Invalid label: no label with name \""s + label + "\" found!", 1);
-		out.first = false;
+	// Not defined yet; patched once the label is found
+	if (labels.find(label) == labels.end())
 		return out;
-	}
 
 	out.second = labels.find(label) -> second;
 
 	return out;
 }
 
+bool ARMv6_Assembler::encodeLabelUse(FixupKind kind, uint32_t &opcode, int offset) {
+	if (!pendingUse.active)
+		return encodeLabelOffset(kind, opcode, offset);
+	// Addresses before the label may still move; checked again by resolveFixups()
+	if (!encodeLabelOffset(kind, opcode, offset, false))
+		relayoutNeeded = true;
+	return 1;
+}
+
+bool ARMv6_Assembler::encodeLabelOffset(FixupKind kind, uint32_t &opcode, int offset, bool logErrors) {
+	switch (kind) {
+		case fixBranchT1:
+			if (offset < -256 or offset > 254 or offset % 2 != 0) {
+				if (logErrors)
+					log("Invalid immediate offset: must be even number in between -256 and 254!", 1);
+				return 0;
+			}
+			opcode = (opcode & 0xFF00) | ((offset + 256) >> 1);
+			break;
+		case fixBranchT2:
+			if (offset < -2048 or offset > 2046 or offset % 2 != 0) {
+				if (logErrors)
+					log("Invalid immediate offset: must be even number in between -2048 and 2046!", 1);
+				return 0;
+			}
+			opcode = (opcode & 0xF800) | ((offset + 2048) >> 1);
+			break;
+		case fixBL:
+			{
+				if (offset < -16777216 or offset > 16777214 or offset % 2 != 0){
+					if (logErrors)
+						log("Invalid immediate offset: must be even number in between -16777216 and 16777214", 1);
+					return 0;
+				}
+
+				// From ARMv6-M Architecure Reference Manual A6.7.13
+				// I1 = NOT(J1 EOR S); I2 = NOT(J2 EOR S); imm32 = SignExtend(S:I1:I2:imm10:imm11:'0', 32);
+				int imm11 = (offset >> 1) & 0b11111111111;
+				int imm10 = (offset >> 12) & 0b1111111111;
+				int S = offset >> 24 & 1;
+				int j1 = ~((offset >> 24) & 1) ^ S;
+				int j2 = ~((offset >> 23) & 1) ^ S;
+
+				opcode = imm11;
+				opcode |= j2 << 11;
+				opcode |= 1 << 12;
+				opcode |= j2 << 13;
+				opcode |= 0b11 << 14;
+				opcode |= imm10 << 16;
+				opcode |= S << 25;
+				opcode |= 0b11110 << 27;
+			}
+			break;
+		case fixLiteral:
+			if (offset < 0 or offset > 1020 or offset % 4 != 0) {
+				if (logErrors)
+					log("Invalid immediate offset: must be a multiple of 4 in between 0 and 1020!", 1);
+				return 0;
+			}
+			opcode = (opcode & 0xFF00) | (offset >> 2);
+			break;
+	}
+	return 1;
+}
+
 void ARMv6_Assembler::log(string msg, int msgLvl) {
-	if (msgLvl >= logLvl)
-		cout << "[LOG] " << msg << endl;
+	// Notes are only shown in the verbose listing
+	if (msgLvl == ARMv6_Diagnostics::sevNote and logLvl < ARMv6_Diagnostics::LOG_VERBOSE)
+		return;
+	diagnostics.add(currentLine, (ARMv6_Diagnostics::Severity)msgLvl, move(msg));
 }
 
 void ARMv6_Assembler::log16bitOpcode(string instruction, uint16_t opcode) {
@@ -346,16 +787,13 @@ void ARMv6_Assembler::log16bitOpcode(string instruction, uint16_t opcode) {
 	log((string)buf, 3);
 }
 
-ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode(char** args, bool labelOnly) {
-	int argLen = strArrLen(args);
+ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode(ARMv6_Args args) {
+	int argLen = args.size();
 	OpcodeResult result = {};
 
 	// Label; if first argument ends with ':'
-	if (args[0][strlen(args[0])-1] == ':') {
-		// Only add label if flag is true
-		if (labelOnly) {
-			addLabel(args[0]);
-		}
+	if (args[0].text.back() == ':') {
+		addLabel(string(args[0].text));
 
 		result.label = 1;
 		// If only label exists on line
@@ -365,63 +803,42 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode(char** args, bool label
 			return result;
 		}
 
-		args++;		// Remove first argument
+		args = args.next();		// Remove first argument
 		argLen--;
 	}
 	else {
-		switch (args[0][0]) {
+		switch (args[0].text[0]) {
 			case '.':
 				{
-					/*
-					vector<string> tmp = {
-						".align",
-						".eabi_attribute",
-						".cpu",
-						".fpu",
-						".arch",
-						".file",
-						".text",
-						".section",
-						".ident",
-						".word",
-						".ascii",
-						".p2align",
-						".global",
-						".syntax",
-						".code",
-						".thumb_func",
-						".type",
-						".size"
-					};
-					for (auto s = tmp.begin(); s != tmp.end(); s++) {
-						printf("case 0x%x: \t// ", djb2Hash(*s));
-						cout << *s << endl;
-					}
-					*/
-					
-					switch(djb2Hash(args[0])) {
-						case 0x773e:	// .align
-						case 0x9b77:	// .eabi_attribute
-						case 0x709b:	// .cpu
-						case 0x7d5e:	// .fpu
-						case 0x71b1:	// .arch
-						case 0x0a73:	// .file
-						case 0xa858:	// .text
-						case 0xeb08:	// .section
-						case 0xc827:	// .ident
-						case 0x772f:	// .word
-						case 0x349c:    // .ascii
-						case 0x9bc0:    // .p2align
-						case 0x8664:    // .global
-						case 0x6cba:    // .syntax
-						case 0x7dce:    // .code
-						case 0x1d3e:    // .thumb_func
-						case 0xfc55:    // .type
-						case 0x2d2e:    // .size
+					switch(lookupMnemonic(args[0].text)) {
+						case DIR_ALIGN:
+						case DIR_EABI_ATTRIBUTE:
+						case DIR_CPU:
+						case DIR_FPU:
+						case DIR_ARCH:
+						case DIR_FILE:
+						case DIR_TEXT:
+						case DIR_SECTION:
+						case DIR_IDENT:
+						case DIR_WORD:
+						case DIR_ASCII:
+						case DIR_P2ALIGN:
+						case DIR_SYNTAX:
+						case DIR_CODE:
+						case DIR_THUMB_FUNC:
+						case DIR_TYPE:
+						case DIR_SIZE:
 							result.unsupported = 1;
 							return result;
+						// Labels visible to other files when several are linked
+						case DIR_GLOBAL:
+							for (int i=1; i<argLen; i++) {
+								globals.insert(string(args[i].text));
+							}
+							result.directive = 1;
+							return result;
 						default:
-							cout << "Dot instruction unknown." << endl;
+							log("Dot instruction unknown.", 1);
 							result.invalid = 1;
 							return result;
 					}
@@ -449,15 +866,12 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode(char** args, bool label
 	}
 	*/
 
-	// Capitalize first argument
-	args[0] = upString(args[0]);
-
-	switch (djb2Hash(args[0])) {
-		case 0xde60:		// ADCS
+	switch (lookupMnemonic(args[0].text)) {
+		case MN_ADCS:
 			{
-				int Rd = getRegNum(args[1]);
-				int Rn = getRegNum(args[argLen-2]);
-				int Rm = getRegNum(args[argLen-1]);
+				int Rd = args[1].reg;
+				int Rn = args[argLen-2].reg;
+				int Rm = args[argLen-1].reg;
 
 				if (Rd != Rn) {
 					log("Invalid registers: Rd and Rn must be equal!", 1);
@@ -475,14 +889,14 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode(char** args, bool label
 				result.opcode = 0b0100000101 << 6;
 			}
 			break;
-		case 0xd06e:		// ADD
+		case MN_ADD:
 			{
-				int Rd = getRegNum(args[1]);
-				int Rn = getRegNum(args[argLen-2]);
-				int Rm = getRegNum(args[argLen-1]);
+				int Rd = args[1].reg;
+				int Rn = args[argLen-2].reg;
+				int Rm = args[argLen-1].reg;
 				// SP Plus Immediate
-				if (args[argLen-1][0] == '#') {
-					int imm = strtol(args[argLen-1]+1, NULL, 0);
+				if (args[argLen-1].isImm) {
+					int imm = args[argLen-1].imm;
 					if (imm %4 != 0) {
 						log("Invalid immediate value: must be an integer multiple of four!", 1);
 						result.invalid = 1;
@@ -558,14 +972,14 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode(char** args, bool label
 				}
 			}
 			break;
-		case 0xde81:		// ADDS
+		case MN_ADDS:
 			{
-				int Rd = getRegNum(args[1]);
-				int Rn = getRegNum(args[argLen-2]);
-				int Rm = getRegNum(args[argLen-1]);
+				int Rd = args[1].reg;
+				int Rn = args[argLen-2].reg;
+				int Rm = args[argLen-1].reg;
 				// Immediate
-				if (args[argLen-1][0] == '#') {
-					int imm = strtol(args[argLen-1]+1, NULL, 0);
+				if (args[argLen-1].isImm) {
+					int imm = args[argLen-1].imm;
 
 					if (Rd < 0 or Rd > 7 or Rn < 0 or Rn > 7) {
 						log("Invalid register: Rd and Rn must be between R0 and R7!", 1);
@@ -582,7 +996,7 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode(char** args, bool label
 						}
 
 						result.opcode = imm;
-						result.opcode |= getRegNum(args[1]) << 8;		// Rdn
+						result.opcode |= args[1].reg << 8;		// Rdn
 						result.opcode |= 0b110 << 11;
 					}
 					// Encoding T1
@@ -615,99 +1029,97 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode(char** args, bool label
 				}
 			}
 			break;
-		case 0xd07c:		// ADR
+		case MN_ADR:
 			{
-				int Rd = getRegNum(args[1]);
+				int Rd = args[1].reg;
 				if (Rd < 0 or Rd > 7) {
 					log("Invalid registers: Rd must be between R0 and R7!", 1);
 					result.invalid = 1;
 					break;
 				}
 				int immOffset;
-				if ((string)args[2] == "[PC") {
-					immOffset = strtol(args[3]+1, NULL, 0);
+				if (args[2].memOpen and args[2].reg == 15) {
+					immOffset = args[3].imm;
 				}
 				else {
-					pair<bool, int> labelOffset = labelOffsetLookup(args[2]);
+					pair<bool, int> labelOffset = labelOffsetLookup(string(args[2].text), fixLiteral);
 					if (!labelOffset.first) {
 						result.invalid = 1;
 						break;
 					}
 					immOffset = labelOffset.second - PC;
 				}
-				if (immOffset < 0 or immOffset > 1020 or immOffset % 4 != 0) {
-					log("Invalid immediate offset: must be a multiple of 4 in between 0 and 1020!", 1);
+
+				result.opcode = Rd << 8;
+				result.opcode |= 0b10100 << 11;
+				if (!encodeLabelUse(fixLiteral, result.opcode, immOffset)) {
 					result.invalid = 1;
 					return result;
 				}
-
-				result.opcode = immOffset >> 2;
-				result.opcode |= Rd << 8;
-				result.opcode |= 0b10100 << 11;
 			}
 			break;
-		case 0x090b:		// ANDS
+		case MN_ANDS:
 			result = genOpcode_bitwise(args, 0b0000);
 			break;
-		case 0x201e:		// ASRS
+		case MN_ASRS:
 			result = genOpcode_bitShift(args, 0b10, 0b0100);
 			break;
-		case 0xb5e7:		// B
+		case MN_B:
 			result = genOpcode_branch(args, 0, 1);
 			break;
-		case 0xd4dd:		// BEQ
+		case MN_BEQ:
 			result = genOpcode_branch(args, 0b0000);
 			break;
-		case 0xd5fa:		// BNE
+		case MN_BNE:
 			result = genOpcode_branch(args, 0b0001);
 			break;
-		case 0xd49d:		// BCS
-		case 0xd542:		// BHS
+		case MN_BCS:
+		case MN_BHS:
 			result = genOpcode_branch(args, 0b0010);
 			break;
-		case 0xd48d:		// BCC
-		case 0xd5c2:		// BLO
+		case MN_BCC:
+		case MN_BLO:
 			result = genOpcode_branch(args, 0b0011);
 			break;
-		case 0xd5dd:		// BMI
+		case MN_BMI:
 			result = genOpcode_branch(args, 0b0100);
 			break;
-		case 0xd643:		// BPL
+		case MN_BPL:
 			result = genOpcode_branch(args, 0b0101);
 			break;
-		case 0xd710:		// BVS
+		case MN_BVS:
 			result = genOpcode_branch(args, 0b0110);
 			break;
-		case 0xd700:		// BVC
+		case MN_BVC:
 			result = genOpcode_branch(args, 0b0111);
 			break;
-		case 0xd538:		// BHI
+		case MN_BHI:
 			result = genOpcode_branch(args, 0b1000);
 			break;
-		case 0xd5c6:		// BLS
+		case MN_BLS:
 			result = genOpcode_branch(args, 0b1001);
 			break;
-		case 0xd513:		// BGE
+		case MN_BGE:
 			result = genOpcode_branch(args, 0b1010);
 			break;
-		case 0xd5c7:		// BLT
+		case MN_BLT:
 			result = genOpcode_branch(args, 0b1011);
 			break;
-		case 0xd522:		// BGT
+		case MN_BGT:
 			result = genOpcode_branch(args, 0b1100);
 			break;
-		case 0xd5b8:		// BLE
+		case MN_BLE:
 			result = genOpcode_branch(args, 0b1101);
 			break;
-		case 0xd454:		// BAL
+		case MN_BAL:
 			result = genOpcode_branch(args, 0b1110, 1);
 			break;
-		case 0x8006:		// BICS
+		case MN_BICS:
 			result = genOpcode_bitwise(args, 0b1110);
 			break;
-		case 0x8a36:		// BKPT
+		case MN_BKPT:
 			{
-				int imm = strtol(args[1]+1, NULL, 0);
+				int imm = args[1].imm;
 				if (imm < 0 or imm > 255) {
 					log("Invalid immediate value: must be between 0 and 255!", 1);
 					result.invalid = 1;
@@ -718,54 +1130,36 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode(char** args, bool label
 				result.opcode |= 0b10111110 << 8;
 			}
 			break;
-		case 0x7313:		// BL
+		case MN_BL:
 			{
-				if ((string)args[1] == "puts") {
+				if (args[1].text == "puts") {
 					result.unsupported = 1;
 					break;
 				}
 
-				pair<bool, int> labelOffset = labelOffsetLookup(args[1]);
+				pair<bool, int> labelOffset = labelOffsetLookup(string(args[1].text), fixBL);
 				if (!labelOffset.first) {
 					result.invalid = 1;
 					return result;
 				}
-				int immOffset = labelOffset.second - PC;
-				if (immOffset < -16777216 or immOffset > 16777214 or immOffset % 2 == 1){
-					log("Invalid immediate offset: must be even number in between -16777216 and 16777214", 1);
+
+				result.i32 = 1;
+				if (!encodeLabelUse(fixBL, result.opcode, labelOffset.second - PC)) {
 					result.invalid = 1;
 					break;
 				}
-
-				// From ARMv6-M Architecure Reference Manual A6.7.13
-				// I1 = NOT(J1 EOR S); I2 = NOT(J2 EOR S); imm32 = SignExtend(S:I1:I2:imm10:imm11:'0', 32);
-				int imm11 = (immOffset >> 1) & 0b11111111111;
-				int imm10 = (immOffset >> 12) & 0b1111111111;
-				int S = immOffset >> 24 & 1;
-				int j1 = ~((immOffset >> 24) & 1) ^ S;
-				int j2 = ~((immOffset >> 23) & 1) ^ S;
-
-				result.i32 = 1;
-				result.opcode = imm11;
-				result.opcode |= j2 << 11;
-				result.opcode |= 1 << 12;
-				result.opcode |= j2 << 13;
-				result.opcode |= 0b11 << 14;
-				result.opcode |= imm10 << 16;
-				result.opcode |= S << 25;
-				result.opcode |= 0b11110 << 27;
 			}
 			break;
-		case 0xd5cb:		// BLX
+		case MN_BLX:
 			result = genOpcode_branchExchange(args, 0b10001111);
 			break;
-		case 0x731f:		// BX
+		case MN_BX:
 			result = genOpcode_branchExchange(args, 0b10001110);
 			break;
-		case 0xda23:		// CMN
+		case MN_CMN:
 			{
-				int Rn = getRegNum(args[1]);
-				int Rm = getRegNum(args[2]);
+				int Rn = args[1].reg;
+				int Rm = args[2].reg;
 
 				if (Rn < 0 or Rn > 7 or Rm < 0 or Rm > 7) {
 					log("Invalid register: Rn and Rm must be between R0 and R7!", 1);
@@ -778,9 +1172,9 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode(char** args, bool label
 				result.opcode |= 0b100001011 << 6;
 			}
 			break;
-		case 0xda25:		// CMP
+		case MN_CMP:
 			{
-				int Rn = getRegNum(args[1]);
+				int Rn = args[1].reg;
 				if (Rn < 0 or Rn > 14) {
 					log("Invalid register: Rn must be between R0 and R14!", 1);
 					result.invalid = 1;
@@ -788,8 +1182,8 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode(char** args, bool label
 				}
 
 				// Immediate
-				if (args[2][0] == '#') {
-					int imm = strtol(args[2]+1, NULL, 0);
+				if (args[2].isImm) {
+					int imm = args[2].imm;
 					if (imm < 0 or imm > 255) {
 						log("Invalid immediate value: must be between 0 and 255!", 1);
 						result.invalid = 1;
@@ -802,7 +1196,7 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode(char** args, bool label
 				}
 				// Register
 				else {
-					int Rm = getRegNum(args[2]);
+					int Rm = args[2].reg;
 					if (Rm < 0 or Rm > 14) {
 						log("Invalid register: Rm must be between R0 and R14!", 1);
 						result.invalid = 1;
@@ -824,30 +1218,30 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode(char** args, bool label
 				}
 			}
 			break;
-		case 0xb2f8:		// CPSID
+		case MN_CPSID:
 			result.opcode = 0b1011011001110010;
 			break;
-		case 0xb2f9:		// CPSIE
+		case MN_CPSIE:
 			result.opcode = 0b1011011001100010;
 			break;
-		case 0xde58:		// DMB
+		case MN_DMB:
 			result = genOpcode_barrier(args, 0b0101);
 			break;
-		case 0xdf1e:		// DSB
+		case MN_DSB:
 			result = genOpcode_barrier(args, 0b0100);
 			break;
-		case 0x409e:		// EORS
+		case MN_EORS:
 			result = genOpcode_bitwise(args, 0b0001);
 			break;
-		case 0xf463:		// ISB
+		case MN_ISB:
 			result = genOpcode_barrier(args, 0b0110);
 			break;
-		case 0xff42:		// LDM
-		case 0xe16c:		// LDMIA
-		case 0xe10c:		// LDMFD
+		case MN_LDM:
+		case MN_LDMIA:
+		case MN_LDMFD:
 			result = genOpcode_loadStoreMulReg(args, 1);
 			break;
-		case 0xff47:		// LDR
+		case MN_LDR:
 			{
 				// LDR Rt, [<Rn | SP> {, #imm}]		// Immediate
 				// 		LDR R0, [R1
@@ -858,7 +1252,7 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode(char** args, bool label
 				// LDR Rt, <label | [PC, #imm]>		// Literal
 				// 		LDR R0, LabelX
 				// 		LDR R0, [PC,#100]
-				int Rt = getRegNum(args[1]);
+				int Rt = args[1].reg;
 				if (Rt < 0 or Rt > 7) {
 					log("Invalid register: Rt must be between R0 and R7!", 1);
 					result.invalid = 1;
@@ -873,15 +1267,15 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode(char** args, bool label
 				instType itype;
 				// Determines if instruction is using immediate offset, register offset or literal
 				if (argLen < 4) {
-					if (args[2][0] == '[')
+					if (args[2].memOpen)
 						itype = imm;
 					else
 						itype = ltr;
 				}
 				else {
-					if (args[3][0] == '#') {
+					if (args[3].isImm) {
 						// Rn is PC
-						if (getRegNum(args[2]+1) == 15)
+						if (args[2].reg == 15)
 							itype = ltr;
 						else
 							itype = imm;
@@ -900,69 +1294,67 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode(char** args, bool label
 					case ltr:
 						{
 							int immOffset;
-							if ((string)args[2] == "[PC") {
-								immOffset = strtol(args[2]+1, NULL, 0);
+							if (args[2].memOpen and args[2].reg == 15) {
+								immOffset = args[3].imm;
 							}
 							else {
-								pair<bool, int> labelOffset = labelOffsetLookup(args[2]);
+								pair<bool, int> labelOffset = labelOffsetLookup(string(args[2].text), fixLiteral);
 								if (!labelOffset.first) {
 									result.invalid = 1;
 									break;
 								}
 								immOffset = labelOffset.second - PC;
 							}
-							if (immOffset < 0 or immOffset > 1020 or immOffset % 4 != 0) {
-								log("Invalid immediate offset: must be a multiple of 4 in between 0 and 1020!", 1);
+
+							result.opcode = Rt << 8;
+							result.opcode |= 0b1001 << 11;
+							if (!encodeLabelUse(fixLiteral, result.opcode, immOffset)) {
 								result.invalid = 1;
 								return result;
 							}
-
-							result.opcode = immOffset >> 2;
-							result.opcode |= Rt << 8;
-							result.opcode |= 0b1001 << 11;
 						}
 						break;
 				}
 			}
 			break;
-		case 0xe869:		// LDRB
+		case MN_LDRB:
 			{
 				// Immediate
-				if (argLen < 4 or args[3][0] == '#')
+				if (argLen < 4 or args[3].isImm)
 					result = genOpcode_loadStoreImm(args, 0b01111);
 				// Register
 				else
 					result = genOpcode_loadStoreReg(args, 0b110);
 			}
 			break;
-		case 0xe86f:		// LDRH
+		case MN_LDRH:
 			{
 				// Immediate
-				if (argLen < 4 or args[3][0] == '#')
+				if (argLen < 4 or args[3].isImm)
 					result = genOpcode_loadStoreImm(args, 0b10001);
 				// Register
 				else
 					result = genOpcode_loadStoreReg(args, 0b101);
 			}
 			break;
-		case 0xf7fc:		// LDRSB
+		case MN_LDRSB:
 			result = genOpcode_loadStoreReg(args, 0b011);
 			break;
-		case 0xf802:		// LDRSH
+		case MN_LDRSH:
 			result = genOpcode_loadStoreReg(args, 0b111);
 			break;
-		case 0x2783:		// LSLS
+		case MN_LSLS:
 			result = genOpcode_bitShift(args, 0b00, 0b0010);
 			break;
-		case 0x2849:		// LSRS
+		case MN_LSRS:
 			result = genOpcode_bitShift(args, 0b01, 0b0011);
 			break;
-		case 0xda91:		// CPY (Pre-UAL synonym)
-		case 0x04f7:		// MOV
+		case MN_CPY:		// Pre-UAL synonym of MOV
+		case MN_MOV:
 			{
 				// Register Only
-				int Rd = getRegNum(args[1]);
-				int Rm = getRegNum(args[2]);
+				int Rd = args[1].reg;
+				int Rm = args[2].reg;
 				if (Rd < 0 or Rd > 15 or Rm < 0 or Rm > 15) {
 					log("Invalid registers: no such register!", 1);
 					result.invalid = 1;
@@ -979,9 +1371,9 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode(char** args, bool label
 				result.opcode |= (Rd >> 3) << 7;	// D bit
 				result.opcode |= 0b1000110 << 8;
 			}
-		case 0xa42a:		// MOVS
+		case MN_MOVS:
 			{
-				int Rd = getRegNum(args[1]);
+				int Rd = args[1].reg;
 				if (Rd < 0 or Rd > 7) {
 					log("Invalid register: Rd must be between R0 and R7!", 1);
 					result.invalid = 1;
@@ -989,8 +1381,8 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode(char** args, bool label
 				}
 
 				// Immediate
-				if (args[2][0] == '#') {
-					int imm = strtol(args[argLen-1]+1, NULL, 0);
+				if (args[2].isImm) {
+					int imm = args[argLen-1].imm;
 					if (imm < 0 or imm > 255) {
 						log("Invalid immediate value: must be between 0 and 255!", 1);
 						result.invalid = 1;
@@ -1003,7 +1395,7 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode(char** args, bool label
 				}
 				// Register
 				else {
-					int Rm = getRegNum(args[2]);
+					int Rm = args[2].reg;
 					if (Rm < 0 or Rm > 7) {
 						log("Invalid register: Rm must be between R0 and R7!", 1);
 						result.invalid = 1;
@@ -1015,16 +1407,16 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode(char** args, bool label
 				}
 			}
 			break;
-		case 0x0557:		// MRS
+		case MN_MRS:
 			{
 				result.i32 = 1;
-				int Rd = getRegNum(args[1]);
+				int Rd = args[1].reg;
 				if (Rd < 0 or Rd == 13 or Rd == 15) {
 					log("Invalid register: Rd must not be SP or PC!", 1);
 					result.invalid = 1;
 					break;
 				}
-				uint8_t SYSm = getSYSm(args[2]);
+				uint8_t SYSm = getSYSm(args[2].text);
 				if (SYSm == 0b11111111) {
 					log("Invalid special register: cannot find such register!", 1);
 					result.invalid = 1;
@@ -1036,16 +1428,16 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode(char** args, bool label
 				result.opcode |= 0b11110011111011111000 << 12;
 			}
 			break;
-		case 0x0577:		// MSR
+		case MN_MSR:
 			{
 				result.i32 = 1;
-				uint8_t SYSm = getSYSm(args[1]);
+				uint8_t SYSm = getSYSm(args[1].text);
 				if (SYSm == 0b11111111) {
 					log("Invalid special register: cannot find such register!", 1);
 					result.invalid = 1;
 					break;
 				}
-				int Rd = getRegNum(args[2]);
+				int Rd = args[2].reg;
 				if (Rd < 0 or Rd == 13 or Rd == 15) {
 					log("Invalid register: Rd must not be SP or PC!", 1);
 					result.invalid = 1;
@@ -1058,11 +1450,11 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode(char** args, bool label
 				result.opcode |= 0b111100111000 << 20;
 			}
 			break;
-		case 0xbc66:		// MULS
+		case MN_MULS:
 			{
-				int Rd = getRegNum(args[1]);
-				int Rn = getRegNum(args[argLen-2]);
-				int Rm = getRegNum(args[argLen-1]);
+				int Rd = args[1].reg;
+				int Rn = args[argLen-2].reg;
+				int Rm = args[argLen-1].reg;
 				// When Rd is omitted, Rd will be Rn in above
 				if (Rd != Rm) {
 					log("Invalid registers: Rd and Rm must be the same!", 1);
@@ -1080,10 +1472,10 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode(char** args, bool label
 				result.opcode |= 0b100001101 << 6;
 			}
 			break;
-		case 0xc0e9:		// MVNS
+		case MN_MVNS:
 			{
-				int Rd = getRegNum(args[1]);
-				int Rm = getRegNum(args[2]);
+				int Rd = args[1].reg;
+				int Rm = args[2].reg;
 				if (Rd < 0 or Rd > 7 or Rm < 0 or Rm > 7) {
 					log("Invalid register: Rd and Rm must be between R0 and R7!", 1);
 					result.invalid = 1;
@@ -1094,34 +1486,34 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode(char** args, bool label
 				result.opcode |= Rm << 3;
 				result.opcode |= 0b100001111 << 6;
 			}
-		case 0x0932:		// NOP
+		case MN_NOP:
 			result.opcode = 0b10111111 << 8;
 			break;
-		case 0xc92b:		// ORRS
+		case MN_ORRS:
 			result = genOpcode_bitwise(args, 0b1100);
 			break;
-		case 0x11b4:		// POP
-			result = genOpcode_popPush(args, 1, (char*)"PC");
+		case MN_POP:
+			result = genOpcode_popPush(args, 1, 15);
 			result.unsupported = 1;
 			break;
-		case 0x6265:		// PUSH
-			result = genOpcode_popPush(args, 0, (char*)"LR");
+		case MN_PUSH:
+			result = genOpcode_popPush(args, 0, 14);
 			result.unsupported = 1;
 			break;
-		case 0x18f2:		// REV
+		case MN_REV:
 			result = genOpcode_reverseBytes(args, 0b00);
 			break;
-		case 0x23f9:		// REV16
+		case MN_REV16:
 			result = genOpcode_reverseBytes(args, 0b01);
 			break;
-		case 0x286d:		// REVSH
+		case MN_REVSH:
 			result = genOpcode_reverseBytes(args, 0b11);
 			break;
-		case 0x618b:		// RORS
+		case MN_RORS:
 			{
-				int Rd = getRegNum(args[1]);
-				int Rn = getRegNum(args[argLen-2]);
-				int Rm = getRegNum(args[argLen-1]);
+				int Rd = args[1].reg;
+				int Rn = args[argLen-2].reg;
+				int Rm = args[argLen-1].reg;
 				if (Rd != Rn) {
 					log("Invalid registers: Rd and Rn must be the same!", 1);
 					result.invalid = 1;
@@ -1138,11 +1530,11 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode(char** args, bool label
 				result.opcode |= 0b100000111 << 6;
 			}
 			break;
-		case 0x707f:		// RSBS
+		case MN_RSBS:
 			{
-				int Rd = getRegNum(args[1]);
-				int Rn = getRegNum(args[argLen-2]);
-				if ((string)args[-1] != "#0") {
+				int Rd = args[1].reg;
+				int Rn = args[argLen-2].reg;
+				if (args[argLen-1].text != "#0") {
 					log(": an constant of #0 must pe provided!", 1);
 					result.invalid = 1;
 					break;
@@ -1158,11 +1550,11 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode(char** args, bool label
 				result.opcode |= 0b100001001 << 6;
 			}
 			break;
-		case 0xb4b0:		// SBCS
+		case MN_SBCS:
 			{
-				int Rd = getRegNum(args[1]);
-				int Rn = getRegNum(args[argLen-2]);
-				int Rm = getRegNum(args[argLen-1]);
+				int Rd = args[1].reg;
+				int Rn = args[argLen-2].reg;
+				int Rm = args[argLen-1].reg;
 				if (Rd != Rn) {
 					log("Invalid registers: Rd and Rn must be the same!", 1);
 					result.invalid = 1;
@@ -1179,55 +1571,55 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode(char** args, bool label
 				result.opcode |= 0b100000110 << 6;
 			}
 			break;
-		case 0x1d33:		// SEV
+		case MN_SEV:
 			result.opcode = 0b1011111101000000;
 			break;
-		case 0x1f19:		// STM
-		case 0x5303:		// STMIA
-		case 0x527f:		// STMEA
+		case MN_STM:
+		case MN_STMIA:
+		case MN_STMEA:
 			genOpcode_loadStoreMulReg(args, 0);
 			break;
-		case 0x1f1e:		// STR
+		case MN_STR:
 			{
 				// Immediate
-				if (argLen < 4 or args[3][0] == '#')
+				if (argLen < 4 or args[3].isImm)
 					result = genOpcode_loadStoreImm(args, 0b01100);
 				// Register
 				else
 					result = genOpcode_loadStoreReg(args, 0b000);
 			}
 			break;
-		case 0x0320:		// STRB
+		case MN_STRB:
 			{
 				// Immediate
-				if (argLen < 4 or args[3][0] == '#')
+				if (argLen < 4 or args[3].isImm)
 					result = genOpcode_loadStoreImm(args, 0b01110);
 				// Register
 				else
 					result = genOpcode_loadStoreReg(args, 0b010);
 			}
 			break;
-		case 0x0326:		// STRH
+		case MN_STRH:
 			{
 				// Immediate
-				if (argLen < 4 or args[3][0] == '#')
+				if (argLen < 4 or args[3].isImm)
 					result = genOpcode_loadStoreImm(args, 0b10000);
 				// Register
 				else
 					result = genOpcode_loadStoreReg(args, 0b001);
 			}
 			break;
-		case 0x1f2f:		// SUB
+		case MN_SUB:
 			{
-				int Rd = getRegNum(args[1]);
-				int Rn = getRegNum(args[argLen-2]);
+				int Rd = args[1].reg;
+				int Rn = args[argLen-2].reg;
 				if (Rd != 13 or Rn != 13) {
 					log("Invalid register: Rd and Rn must be SP!", 1);
 					result.invalid = 1;
 					break;
 				}
 
-				int imm = strtol(args[argLen-1]+1, NULL, 0);
+				int imm = args[argLen-1].imm;
 				if (imm % 4 != 0 or imm < 0 or imm > 508) {
 					log("Invalid immediate value: must be a multiple of 4 between 0 and 508!", 1);
 					result.invalid = 1;
@@ -1238,10 +1630,10 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode(char** args, bool label
 				result.opcode |= 0b101100001 << 7;
 			}
 			break;
-		case 0x0562:		// SUBS
+		case MN_SUBS:
 			{
-				int Rd = getRegNum(args[1]);
-				int Rn = getRegNum(args[argLen-2]);
+				int Rd = args[1].reg;
+				int Rn = args[argLen-2].reg;
 				if (Rd < 0 or Rd > 7 or Rn < 0 or Rn > 7) {
 					log("Invalid register: Rd and Rn must be between R0 and R7!", 1);
 					result.invalid = 1;
@@ -1249,8 +1641,8 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode(char** args, bool label
 				}
 
 				// Immediate
-				if (args[argLen-1][0] == '#') {
-					int imm = strtol(args[argLen-1]+1, NULL, 0);
+				if (args[argLen-1].isImm) {
+					int imm = args[argLen-1].imm;
 
 					// Encoding T1
 					if (imm > -1 and imm < 8) {
@@ -1279,7 +1671,7 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode(char** args, bool label
 				}
 				// Register
 				else {
-					int Rm = getRegNum(args[argLen-1]);
+					int Rm = args[argLen-1].reg;
 					if (Rm < 0 or Rm > 7) {
 						log("Invalid register: Rm must be between R0 and R7!", 1);
 						result.invalid = 1;
@@ -1293,9 +1685,9 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode(char** args, bool label
 				}
 			}
 			break;
-		case 0x1f51:		// SVC
+		case MN_SVC:
 			{
-				int imm = strtol(args[1]+1, NULL, 0);
+				int imm = args[1].imm;
 				if (imm < 0 or imm > 255) {
 					log("Invalid immediate value: must be between 0 and 255", 1);
 					break;
@@ -1307,16 +1699,16 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode(char** args, bool label
 				result.unsupported = 1;
 			}
 			break;
-		case 0x1466:		// SXTB
+		case MN_SXTB:
 			result = genOpcode_extendRegister(args, 0b01);
 			break;
-		case 0x146c:		// SXTH
+		case MN_SXTH:
 			result = genOpcode_extendRegister(args, 0b00);
 			break;
-		case 0x2340:		// TST
+		case MN_TST:
 			{
-				int Rn = getRegNum(args[1]);
-				int Rm = getRegNum(args[1]);
+				int Rn = args[1].reg;
+				int Rm = args[1].reg;
 				if (Rn < 0 or Rn > 7 or Rm < 0 or Rm > 7) {
 					log("Invalid registers: Rd and Rm must be between R0 and R7!", 1);
 					result.invalid = 1;
@@ -1328,9 +1720,9 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode(char** args, bool label
 				result.opcode |= 0b0100001000 << 6;
 			}
 			break;
-		case 0x2584:		// UDF
+		case MN_UDF:
 			{
-				int imm = strtol(args[argLen-1]+1, NULL, 0);
+				int imm = args[argLen-1].imm;
 				if (imm < 0 or imm > 0xFF) {
 					log("Invalid immediate value: must be an 8-bit value!", 1);
 					result.invalid = 1;
@@ -1343,24 +1735,24 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode(char** args, bool label
 				result.unsupported = 1;
 			}
 			break;
-		case 0x2d28:		// UXTB
+		case MN_UXTB:
 			result = genOpcode_extendRegister(args, 0b11);
 			break;
-		case 0x2d2e:		// UXTH
+		case MN_UXTH:
 			result = genOpcode_extendRegister(args, 0b10);
 			break;
-		case 0x2e47:		// WFE
+		case MN_WFE:
 			result.opcode = 0b1011111100100000;
 			break;
-		case 0x2e4b:		// WFI
+		case MN_WFI:
 			result.opcode = 0b1011111100110000;
 			break;
-		case 0xbc3c:		// YIELD
+		case MN_YIELD:
 			result.opcode = 0b1011111100010000;
 			break;
 
 		default:
-			log("Invalid instruction: instruction "s + args[0] + " not found!", 1);
+			log("Invalid instruction: instruction "s + string(args[0].text) + " not found!", 1);
 			result.invalid = 1;
 			break;
 	}
@@ -1378,22 +1770,22 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode(char** args, bool label
 }
 
 
-ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode_bitShift(char** args, uint8_t opcodeImmPrefix, uint8_t opcodeRegPrefix) {
+ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode_bitShift(ARMv6_Args args, uint8_t opcodeImmPrefix, uint8_t opcodeRegPrefix) {
 	OpcodeResult result = {};
-	int argLen = strArrLen(args);
+	int argLen = args.size();
 
-	int Rd = getRegNum(args[1]);
+	int Rd = args[1].reg;
 
 	// Immediate
-	if (args[argLen-1][0] == '#') {
-		int Rm = getRegNum(args[argLen-2]);
+	if (args[argLen-1].isImm) {
+		int Rm = args[argLen-2].reg;
 		if (Rd < 0 or Rd > 7 or Rm < 0 or Rm > 7) {
 			log("Invalid registers: Rd and Rm must be between R0 and R7!", 1);
 			result.invalid = 1;
 			return result;
 		}
 
-		int imm = strtol(args[argLen-1]+1, NULL, 0);
+		int imm = args[argLen-1].imm;
 		if (imm < 1 or imm > 32) {
 			log("Invalid immediate value: must be between 1 and 32!", 1);
 			result.invalid = 1;
@@ -1410,13 +1802,13 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode_bitShift(char** args, u
 	}
 	// Register
 	else {
-		int Rn = getRegNum(args[argLen-2]);
+		int Rn = args[argLen-2].reg;
 		if (Rd != Rn) {
 			log("Invalid registers: Rd and Rn must be the same!", 1);
 			result.invalid = 1;
 			return result;
 		}
-		int Rm = getRegNum(args[argLen-1]);
+		int Rm = args[argLen-1].reg;
 		if (Rd < 0 or Rd > 7 or Rm < 0 or Rm > 7) {
 			log("Invalid registers: all registers must be between R0 and R7!", 1);
 			result.invalid = 1;
@@ -1436,13 +1828,13 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode_bitShift(char** args, u
 }
 
 
-ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode_bitwise(char** args, uint8_t opcodePrefix) {
+ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode_bitwise(ARMv6_Args args, uint8_t opcodePrefix) {
 	OpcodeResult result = {};
-	int argLen = strArrLen(args);
+	int argLen = args.size();
 
-	int Rd = getRegNum(args[1]);
-	int Rn = getRegNum(args[argLen-2]);
-	int Rm = getRegNum(args[argLen-1]);
+	int Rd = args[1].reg;
+	int Rn = args[argLen-2].reg;
+	int Rm = args[argLen-1].reg;
 	if (Rd != Rn) {
 		log("Invalid registers: Rd and Rn must be the same!", 1);
 		result.invalid = 1;
@@ -1468,29 +1860,15 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode_bitwise(char** args, ui
 }
 
 
-ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode_branch(char** args, uint8_t opcodePrefix, bool t2) {
+ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode_branch(ARMv6_Args args, uint8_t opcodePrefix, bool t2) {
 	OpcodeResult result = {};
 
-	// Encoding T1
-	pair<bool, int> labelOffset = labelOffsetLookup(args[1]);
+	FixupKind kind = t2 ? fixBranchT2 : fixBranchT1;
+	pair<bool, int> labelOffset = labelOffsetLookup(string(args[1].text), kind);
 	if (!labelOffset.first) {
 		result.invalid = 1;
 		return result;
 	}
-	int immOffset = labelOffset.second - PC;
-
-	// Encoding T2
-	if (t2 and (immOffset < -2048 or immOffset > 2046 or immOffset % 2 != 0)) {
-		log("Invalid immediate offset: must be even number in between -2048 and 2046!", 1);
-		result.invalid = 1;
-		return result;
-	}
-	// Encoding T1
-	else if (immOffset < -256 or immOffset > 254 or immOffset % 2 != 0) {
-		log("Invalid immediate offset: must be even number in between -256 and 254!", 1);
-		result.invalid = 1;
-		return result;
-	}
 
 	// EQ 0b0000
 	// NE 0b0001
@@ -1509,23 +1887,23 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode_branch(char** args, uin
 	// AL 0b1110
 	// Encoding T2
 	if (t2) {
-		result.opcode |= (immOffset + 2048) >> 1;
-		result.opcode |= 0b11100 << 11;
+		result.opcode = 0b11100 << 11;
 	}
 	// Encoding T1
 	else {
-		result.opcode |= (immOffset + 256) >> 1;
-		result.opcode |= opcodePrefix << 8;
+		result.opcode = opcodePrefix << 8;
 		result.opcode |= 0b1101 << 12;
 	}
+	if (!encodeLabelUse(kind, result.opcode, labelOffset.second - PC))
+		result.invalid = 1;
 
 	return result;
 }
 
 
-ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode_branchExchange(char** args, uint8_t opcodePrefix) {
+ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode_branchExchange(ARMv6_Args args, uint8_t opcodePrefix) {
 	OpcodeResult result = {};
-	int Rm = getRegNum(args[1]);
+	int Rm = args[1].reg;
 	if (Rm < 0 or Rm == 13 or Rm == 15) {
 		log("Invalid register: SP or PC can not be used!", 1);
 		result.invalid = 1;
@@ -1537,10 +1915,10 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode_branchExchange(char** a
 }
 
 
-ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode_reverseBytes(char** args, uint8_t opcodePrefix) {
+ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode_reverseBytes(ARMv6_Args args, uint8_t opcodePrefix) {
 	OpcodeResult result = {};
-	int Rd = getRegNum(args[1]);
-	int Rm = getRegNum(args[2]);
+	int Rd = args[1].reg;
+	int Rm = args[2].reg;
 	if (Rd < 0 or Rd > 7 or Rm < 0 or Rm > 7) {
 		log("Invalid registers: Rd and Rm must be between R0 and R7!", 1);
 		result.invalid = 1;
@@ -1559,13 +1937,13 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode_reverseBytes(char** arg
 }
 
 
-ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode_loadStoreImm(char** args, uint8_t opcodePrefix) {
+ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode_loadStoreImm(ARMv6_Args args, uint8_t opcodePrefix) {
 	OpcodeResult result = {};
 
-	int Rt = getRegNum(args[1]);
-	int Rn = getRegNum(args[2]+1);
+	int Rt = args[1].reg;
+	int Rn = args[2].reg;
 	// Instructin is either LDR or STR
-	bool possibleSP = strcmp(args[0], "LDR") == 0 or strcmp(args[0], "STR") == 0;
+	bool possibleSP = lookupMnemonic(args[0].text) == MN_LDR or lookupMnemonic(args[0].text) == MN_STR;
 	if (
 			// Either Rt or Rn is not in 0-7
 			Rt < 0 or Rt > 7 or Rn < 0 or Rn > 7 or
@@ -1583,13 +1961,13 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode_loadStoreImm(char** arg
 	// Calculate immediate value
 	int imm = 0;
 	// Only change immediate value if argument exists
-	if (strArrLen(args) > 3) {
-		imm = strtol(args[3]+1, NULL, 0);
+	if (args.size() > 3) {
+		imm = args[3].imm;
 		int uplim = 0;
 		int mul = 0;	// Immediate must be multiples of n
-		switch (djb2Hash(args[0])) {
-			case 0xff47:	// LDR
-			case 0x1f1e:	// STR
+		switch (lookupMnemonic(args[0].text)) {
+			case MN_LDR:
+			case MN_STR:
 				{
 					// Assume R0-R7 as base; use 124 as upper limit
 					uplim = 124;
@@ -1599,12 +1977,12 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode_loadStoreImm(char** arg
 					mul = 4;
 				}
 				break;
-			case 0xe869:	// LDRB
-			case 0x0320:	// STRB
+			case MN_LDRB:
+			case MN_STRB:
 				uplim = 31;
 				break;
-			case 0xe86f:	// LDRH
-			case 0x0326:	// STRH
+			case MN_LDRH:
+			case MN_STRH:
 				uplim = 62;
 				mul = 2;
 				break;
@@ -1649,12 +2027,12 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode_loadStoreImm(char** arg
 }
 
 
-ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode_loadStoreReg(char** args, uint8_t opcodePrefix) {
+ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode_loadStoreReg(ARMv6_Args args, uint8_t opcodePrefix) {
 	OpcodeResult result = {};
 	
-	int Rt = getRegNum(args[1]);
-	int Rn = getRegNum(args[2]+1);
-	int Rm = getRegNum(args[3]);
+	int Rt = args[1].reg;
+	int Rn = args[2].reg;
+	int Rm = args[3].reg;
 	if (Rt < 0 or Rt > 7 or Rn < 0 or Rn > 7 or Rm < 0 or Rm > 7) {
 		log("Invalid register: all registers must be between R0 and R7!", 1);
 		result.invalid = 1;
@@ -1679,21 +2057,17 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode_loadStoreReg(char** arg
 }
 
 
-ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode_loadStoreMulReg(char** args, uint8_t opcodePrefix) {
+ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode_loadStoreMulReg(ARMv6_Args args, uint8_t opcodePrefix) {
 	OpcodeResult result = {};
 
-	int Rn = getRegNum(args[1]);
+	int Rn = args[1].reg;
 	if (Rn < 0 or Rn > 7) {
 		log("Invalid register: must be between R0 and R7!", 1);
 		result.invalid = 1;
 		return result;
 	}
 	// Writeback
-	bool writeback = 0;
-	if (args[1][strlen(args[1])-1] == '!') {
-		args[1][strlen(args[1])-1] = '\0';
-		writeback = 1;
-	}
+	bool writeback = args[1].writeback;
 
 	uint16_t register_list = getRegList(args, 2);
 	// No registers in register list
@@ -1724,11 +2098,11 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode_loadStoreMulReg(char**
 }
 
 
-ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode_extendRegister(char** args, uint8_t opcodePrefix) {
+ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode_extendRegister(ARMv6_Args args, uint8_t opcodePrefix) {
 	OpcodeResult result = {};
 
-	int Rd = getRegNum(args[1]);
-	int Rm = getRegNum(args[2]);
+	int Rd = args[1].reg;
+	int Rm = args[2].reg;
 	if (Rd < 0 or Rd > 7 or Rm < 0 or Rm > 7) {
 		log("Invalid registers: Rd and Rm must be between R0 and R7!", 1);
 		result.invalid = 1;
@@ -1748,12 +2122,12 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode_extendRegister(char** a
 }
 
 
-ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode_barrier(char** args, uint8_t opcodePrefix) {
+ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode_barrier(ARMv6_Args args, uint8_t opcodePrefix) {
 	OpcodeResult result = {};
 
 	result.i32 = 1;
-	if (strArrLen(args) > 1) {
-		if ((string)args[1] == "SY")
+	if (args.size() > 1) {
+		if (args[1].text == "SY")
 			result.opcode |= 0b1111;
 		else {
 			log("Invalid option: must either be SY or omitted!", 1);
@@ -1771,7 +2145,7 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode_barrier(char** args, ui
 }
 
 
-ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode_popPush(char** args, uint8_t opcodePrefix, char* extraReg) {
+ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode_popPush(ARMv6_Args args, uint8_t opcodePrefix, int extraReg) {
 	OpcodeResult result = {};
 
 	// POP  -> 0-7, PC
@@ -1782,9 +2156,9 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode_popPush(char** args, ui
 		return result;
 	}
 	// Only allow R0-R7 and extra register
-	uint16_t validReg = 0xFF | (1 << getRegNum(extraReg));
+	uint16_t validReg = 0xFF | (1 << extraReg);
 	if (register_list & (uint16_t)~validReg) {
-		log("Invalid register range: must be "s + extraReg + " or between R0 and R7!", 1);
+		log("Invalid register range: must be "s + (extraReg == 15 ? "PC" : "LR") + " or between R0 and R7!", 1);
 		result.invalid = 1;
 		return result;
 	}
@@ -1792,7 +2166,7 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode_popPush(char** args, ui
 	// POP   1011 1 10 P register_list
 	// PUSH  1011 0 10 M register_list
 	result.opcode = register_list & 0xFF;
-	if (register_list & (1<<getRegNum(extraReg))) {
+	if (register_list & (1<<extraReg)) {
 		result.opcode |= 1 << 8;
 	}
 	result.opcode |= 0b10 << 9;
@@ -1803,34 +2177,21 @@ ARMv6_Assembler::OpcodeResult ARMv6_Assembler::genOpcode_popPush(char** args, ui
 }
 
 
-uint16_t ARMv6_Assembler::getRegList(char** args, int startArg) {
+uint16_t ARMv6_Assembler::getRegList(ARMv6_Args args, int startArg) {
 	uint16_t regList = 0;
 
-	int argLen = strArrLen(args);
-	if (args[startArg][0] != '{' or args[argLen-1][strlen(args[argLen-1])-1] != '}') {
+	int argLen = args.size();
+	if (!args[startArg].listOpen or !args[argLen-1].listClose) {
 		log("Invalid instruction: registers must be surrounded by { and }!", 1);
 		return 0;
 	}
 
-	// Creates copy of args to avoid changes to original
-	char** argsCopy = (char**)malloc(sizeof(char*) * argLen);
-	for (int i=startArg; i<strArrLen(args); i++) {
-		// Copy each string including null terminator
-		argsCopy[i] = (char*) malloc(sizeof(char) * (strlen(args[i]) + 1));
-		memcpy(argsCopy[i], args[i], sizeof(char) * (strlen(args[i]) + 1));
-	}
-
-	// Remove '{' and '}' from starting and end argument
-	argsCopy[startArg] = (char*)(argsCopy[startArg] + 1);
-	argsCopy[argLen - 1][strlen(argsCopy[argLen-1])-1] = '\0';
-
 	for (int i=startArg; i<argLen; i++) {
 		// Find '-' and assumes is range
-		if (((string)argsCopy[i]).find("-") != string::npos) {
-			char** regRange = strtokSplit(argsCopy[i], (char*)"-");
-			int startReg = getRegNum(regRange[0]);
-			int endReg = getRegNum(regRange[1]);
-			if (strArrLen(regRange) != 2 or startReg > endReg) {
+		if (args[i].text.find('-') != string_view::npos) {
+			int startReg = args[i].reg;
+			int endReg = args[i].regEnd;
+			if (endReg < 0 or startReg > endReg) {
 				log("Invalid register range: please supply range in format of Rn-Rm where n < m!", 1);
 				return 0;
 			}
@@ -1845,7 +2206,7 @@ uint16_t ARMv6_Assembler::getRegList(char** args, int startArg) {
 		}
 		// No '-' found in argument, assume to not be range
 		else {
-			int reg = getRegNum(argsCopy[i]);
+			int reg = args[i].reg;
 			if (reg < 0 or reg > 15) {
 				log("Invalid register: must be a valid register!", 1);
 				return 0;
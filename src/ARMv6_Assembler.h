@@ -3,28 +3,53 @@
 #include <string>		// For type string
 #include <cstdint>		// For type uint16_t
 #include <unordered_map>
+#include <unordered_set>
+#include <string_view>
 #include <vector>
+#include "ARMv6_Diagnostics.h"
+#include "ARMv6_Lexer.h"
+#include "ARMv6_Program.h"
 using namespace std;
 
-extern "C" {
-	#include "basiclib_string.h"
-}
-
 class ARMv6_Assembler {
 	public:
 		struct OpcodeResult {
-			bool invalid;		// True to invalidate all other struct members
 			uint32_t opcode;
-			bool i32;			// True for 32-bits instruction, False for 16-bits
-			bool label;			// True if line includes a label
-			bool unsupported;	// True if instruction is not implemented here
+			bool invalid : 1;		// True to invalidate all other struct members
+			bool i32 : 1;			// True for 32-bits instruction, False for 16-bits
+			bool label : 1;			// True if line includes a label
+			bool unsupported : 1;	// True if instruction is not implemented here
+			bool directive : 1;		// True for a directive that was handled but emits no code
 		};
 
 	private:
 		const uint32_t INST_BASEADDR = 0;	// Set base address of an instruction
 
-		// Log level; smaller the number the less to print
-		int logLvl = 1;
+		// Output level; smaller the number the less to print
+		int logLvl = ARMv6_Diagnostics::LOG_SUMMARY;
+		// Messages and listing, printed once assembly is done
+		ARMv6_Diagnostics diagnostics;
+		// Diagnostics added while assembling lines; later ones come from resolving labels
+		size_t passRecords = 0;
+		// One line summary of the last assembly
+		string summary;
+		// Lines read so far and the line being assembled, starting from 1
+		uint32_t lineCount = 0;
+		uint32_t currentLine = 0;
+		// Hash of every source line; unchanged lines are kept on reassembly
+		vector<uint64_t> lineHashes;
+		// File assembled by assembleFile()
+		string sourcePath;
+		// Hash of the whole source file, or of all units when linked; names its cached object
+		uint64_t sourceHash = 0;
+		bool sourceRead = false;
+		// Separately assembled files, kept unlinked so only changed ones are assembled again;
+		// empty when assembling a single file
+		vector<ARMv6_Assembler> units;
+		// Labels declared with .global; the others are local to their file when linked
+		unordered_set<string> globals;
+		// Files smaller than this per thread are assembled on the calling thread
+		const static size_t MIN_CHUNK_BYTES = 1 << 20;
 
 		uint16_t currAddress;
 		// Program Counter
@@ -35,72 +60,164 @@ class ARMv6_Assembler {
 		// Vector to store final output from input opcodes
 		vector<pair<string, OpcodeResult>> finalOpcodes;
 
-		// Reads all lines from an assembly file
-		vector<string> readASMFile(string fpath);
+		// Instruction fields holding a PC relative label offset
+		enum FixupKind {
+			fixBranchT1,	// B<cond>
+			fixBranchT2,	// B
+			fixBL,			// BL
+			fixLiteral		// ADR, LDR (literal)
+		};
+		// A label use; patched when the label is defined and again if addresses move
+		struct Fixup {
+			FixupKind kind;
+			size_t entry;	// Index into finalOpcodes
+			uint32_t addr;	// Address of the instruction
+			int next;		// Previous use of the same label; -1 at the end of the chain
+			uint32_t line;	// Source line for messages
+		};
+		vector<Fixup> fixups;
+		struct Symbol {
+			bool defined = false;
+			size_t entry = 0;	// Index into finalOpcodes of the first instruction after the label
+			int chain = -1;		// Most recent use; chains link all uses of a label
+			uint32_t line = 0;	// Source line of the definition
+		};
+		unordered_map<string, Symbol> symbols;
+		// Addresses seen while assembling may be stale; set by label redefinition and chunk joins
+		bool relayoutNeeded = false;
+		// A label was defined more than once; the last definition depends on the whole file
+		bool labelRedefined = false;
+		// Label used by the instruction currently being generated
+		struct {
+			bool active;
+			string label;
+			FixupKind kind;
+		} pendingUse;
+
+		// Source lines kept for logging once all labels are resolved
+		struct SourceLine {
+			string text;
+			OpcodeResult result;
+			int entry;		// Index into finalOpcodes; -1 if no opcode was emitted
+			uint32_t line;
+		};
+		vector<SourceLine> sourceLines;
+
+		// Maps a file read-only; nullptr if it cannot be read. Empty files give a non-null pointer
+		const char* mapFile(string fpath, size_t &size);
+		void unmapFile(const char* file, size_t size);
+		// Maps an assembly file and assembles it line by line; False if it cannot be read
+		bool assembleFile(string fpath);
+		// Assembles one source line, without its newline
+		void assembleLine(string_view asmLine);
+		// Assembles all lines between begin and end
+		void assembleRange(const char* begin, const char* end);
+		// Appends a chunk assembled separately from the following source lines. A chunk
+		// holding a whole file is named by unitName; its local labels are renamed to
+		// unitName:label so they only resolve within the file
+		void mergeChunk(ARMv6_Assembler &chunk, string unitName = "");
+		// Assemble the given units in parallel
+		void assembleUnits(const vector<size_t> &indices);
+		// Lay out all units one after another and resolve labels between them
+		void link();
+		// Reassemble a single file, keeping lines around the edited region
+		bool reassembleFile();
+		// Keep the state of lines up to keepUpTo and move lines after tailAfter into tail,
+		// so changed lines in between can be assembled again and the tail merged back
+		void splitAt(uint32_t keepUpTo, uint32_t tailAfter, ARMv6_Assembler &tail);
+		// Forget everything assembled so far
+		void clearProgram();
+		// Resolve labels once all lines are assembled and build the summary
+		void finish(bool print);
 
-		// Creates hash from text using the djb2 algorithm
-		uint16_t djb2Hash(string text);
-		// Gets an integer given a string presentation of a register
-		int getRegNum(char* reg);
 		// Get register list given arguments and starting register
-		uint16_t getRegList(char** args, int startArg);
+		uint16_t getRegList(ARMv6_Args args, int startArg);
 		// Gets SYSm value given a string representation of a special register
-		uint8_t getSYSm(char* spReg);
+		uint8_t getSYSm(string_view spReg);
 
 		// Refer to A4.2.1 in ARMv6-M Architecture Reference Manual for calculating PC value
 			// Adds a label to the list; True for success, False for not
 		bool addLabel(string label);
-		// Get an immediate offset given a string label; boolean is used to track if offset is valid
-		pair<bool, int> labelOffsetLookup(string label);
-		// Clean up instructions to aid processing
-		vector<char**> cleanInstructions(vector<string> lines);
+		// Get the address of a label and record the use for patching; an undefined label
+		// gives the current PC so the offset is 0 until the label is defined
+		pair<bool, int> labelOffsetLookup(string label, FixupKind kind);
+		// Encodes a PC relative offset into an instruction; False if out of range
+		bool encodeLabelOffset(FixupKind kind, uint32_t &opcode, int offset, bool logErrors=true);
+		// Encode an offset while assembling a line. A label use that does not fit yet is kept
+		// as a fixup and only dropped if it still does not fit once all addresses are known
+		bool encodeLabelUse(FixupKind kind, uint32_t &opcode, int offset);
+		// Patch all uses of a label with its current address; True if a use did not fit
+		// and was dropped
+		bool patchFixupChain(Symbol &symbol, uint32_t labelAddr, bool logErrors=false);
+		// Resolve remaining uses at end of file; instructions that cannot be encoded are
+		// dropped and following addresses move down as if the line was never emitted
+		void resolveFixups();
 
-		// Log function to process logs
+		// Record a message for the current line; msgLvl is an ARMv6_Diagnostics::Severity
 		void log(string msg, int msgLvl);
+		// Add the listing and build the summary; printed according to logLvl if print is set
+		void report(bool print);
 		void logInvalidValue(string type, int min, int max);
 		// Log of 16-bits opcodes generated
 		void log16bitOpcode(string instruction, uint16_t opcode);
 
 		// ==== Functions for genOpcode() to avoid code duplication
 		// For ASRS, LSLS, LSRS
-		OpcodeResult genOpcode_bitShift(char** args, uint8_t opcodeImmPrefix, uint8_t opcodeRegPrefix);
+		OpcodeResult genOpcode_bitShift(ARMv6_Args args, uint8_t opcodeImmPrefix, uint8_t opcodeRegPrefix);
 		// For ANDS, ORRS, EORS, BICS
-		OpcodeResult genOpcode_bitwise(char** args, uint8_t opcodePrefix);
+		OpcodeResult genOpcode_bitwise(ARMv6_Args args, uint8_t opcodePrefix);
 		// For B{cond}
-		OpcodeResult genOpcode_branch(char** args, uint8_t opcodePrefix, bool t2=0);
+		OpcodeResult genOpcode_branch(ARMv6_Args args, uint8_t opcodePrefix, bool t2=0);
 		// For BLX, BX
-		OpcodeResult genOpcode_branchExchange(char** args, uint8_t opcodePrefix);
+		OpcodeResult genOpcode_branchExchange(ARMv6_Args args, uint8_t opcodePrefix);
 		// For REV, REV16, REVSH
-		OpcodeResult genOpcode_reverseBytes(char** args, uint8_t opcodePrefix);
+		OpcodeResult genOpcode_reverseBytes(ARMv6_Args args, uint8_t opcodePrefix);
 		// For LDR{B|H}, STR{B|H}
-		OpcodeResult genOpcode_loadStoreImm(char** args, uint8_t opcodePrefix);
+		OpcodeResult genOpcode_loadStoreImm(ARMv6_Args args, uint8_t opcodePrefix);
 		// For LDR{B|H|SB|SH}, STR{B|H}
-		OpcodeResult genOpcode_loadStoreReg(char** args, uint8_t opcodePrefix);
+		OpcodeResult genOpcode_loadStoreReg(ARMv6_Args args, uint8_t opcodePrefix);
 		// For LDM, STM
-		OpcodeResult genOpcode_loadStoreMulReg(char** args, uint8_t opcodePrefix);
+		OpcodeResult genOpcode_loadStoreMulReg(ARMv6_Args args, uint8_t opcodePrefix);
 		// For SXTB, SXTH, UXTB, UXTH
-		OpcodeResult genOpcode_extendRegister(char** args, uint8_t opcodePrefix);
+		OpcodeResult genOpcode_extendRegister(ARMv6_Args args, uint8_t opcodePrefix);
 		// For DMB, DSB, ISB
-		OpcodeResult genOpcode_barrier(char** args, uint8_t opcodePrefix);
+		OpcodeResult genOpcode_barrier(ARMv6_Args args, uint8_t opcodePrefix);
 		// For POP, PUSG
-		OpcodeResult genOpcode_popPush(char** args, uint8_t opcodePrefix, char* extraReg);
+		OpcodeResult genOpcode_popPush(ARMv6_Args args, uint8_t opcodePrefix, int extraReg);
 
 		// ====
+		// Empty assembler for a chunk of a larger file
+		ARMv6_Assembler() : PC(INST_BASEADDR) {}
 	public:
-		// Class Constructor
-		ARMv6_Assembler(string asmFilePath);
-		// Checks if all hashes are unique
-		bool hashUniqueCheck();
+		// Class Constructor; logLvl is one of ARMv6_Diagnostics::LOG_QUIET, LOG_SUMMARY or LOG_VERBOSE
+		ARMv6_Assembler(string asmFilePath, int logLvl = ARMv6_Diagnostics::LOG_SUMMARY);
+		// Assemble several files as separate units in parallel and link them into one program
+		// in the given order. Labels not declared .global are only visible in their own file
+		ARMv6_Assembler(vector<string> asmFilePaths, int logLvl = ARMv6_Diagnostics::LOG_SUMMARY);
 		// Generate an opcode given a string instruction
-		OpcodeResult genOpcode(char** args, bool labelOnly);
+		OpcodeResult genOpcode(ARMv6_Args args);
 		//uint16_t genOpcode(string instruction);		
 
 		// Getter for address to starting instruction in memory
 		uint32_t getStartAddr();
-		// Getter for all final opcodes along with their original assembly instructions
-		vector<pair<string, OpcodeResult>> getFinalResult();
+		// Packed image of the program as assembled so far, for the core and the TUI
+		ARMv6_Program getProgram();
 		// Getter for labels
 		unordered_map<string, uint32_t> getLabels();
+		// Write all messages and the listing as JSON; False if the file cannot be written
+		bool writeDiagnostics(string path);
+		// One line summary of the last assembly
+		string getSummary();
+		// Hash of the source file contents as last read
+		uint64_t getSourceHash();
+		// Store the image from getProgram() as an object in a cache directory shared between
+		// runs, so an unchanged source can be loaded with ARMv6_Object instead; True on success
+		bool saveObject(string dirPath, const ARMv6_Program &program);
+
+		// Assemble the files again after they were edited. Lines before and after the edited
+		// region of a single file keep their encodings; of several files only changed ones
+		// are assembled before linking again. Nothing is printed. False if nothing changed
+		bool reassemble();
 };
 
 #endif
@@ -0,0 +1,187 @@
+#include "ARMv6_Diagnostics.h"
+#include <algorithm>
+#include <cstdio>
+
+void ARMv6_Diagnostics::add(uint32_t line, Severity severity, string message) {
+	records.push_back({line, severity, move(message)});
+}
+
+void ARMv6_Diagnostics::addListing(uint32_t line, string source, string message) {
+	records.push_back({line, sevNote, move(message), move(source)});
+}
+
+void ARMv6_Diagnostics::addListing(uint32_t line, string source, uint32_t opcode, bool i32) {
+	addListing(line, move(source), "opcode generated");
+	records.back().hasOpcode = true;
+	records.back().i32 = i32;
+	records.back().opcode = opcode;
+}
+
+void ARMv6_Diagnostics::append(ARMv6_Diagnostics &other, uint32_t lineBase) {
+	for (auto &it: other.records) {
+		if (it.line > 0)
+			it.line += lineBase;
+		records.push_back(move(it));
+	}
+	other.records.clear();
+}
+
+void ARMv6_Diagnostics::split(uint32_t keepUpTo, uint32_t tailAfter, ARMv6_Diagnostics &tail) {
+	size_t kept = 0;
+	for (auto &it: records) {
+		if (it.line > tailAfter) {
+			tail.records.push_back(move(it));
+			tail.records.back().line -= tailAfter;
+		}
+		else if (it.line > 0 and it.line <= keepUpTo) {
+			if (&records[kept] != &it)
+				records[kept] = move(it);
+			kept++;
+		}
+	}
+	records.resize(kept);
+}
+
+void ARMv6_Diagnostics::truncate(size_t count) {
+	if (count < records.size())
+		records.resize(count);
+}
+
+void ARMv6_Diagnostics::addUnit(uint32_t lineBase, string name) {
+	units.push_back({lineBase, move(name)});
+}
+
+const ARMv6_Diagnostics::Unit* ARMv6_Diagnostics::unitOf(uint32_t line) {
+	if (units.empty() or line == 0)
+		return nullptr;
+	auto it = upper_bound(units.begin(), units.end(), line - 1, [](uint32_t line, const Unit &unit) {
+		return line < unit.lineBase;
+	});
+	return it == units.begin() ? nullptr : &*(it - 1);
+}
+
+string ARMv6_Diagnostics::location(uint32_t line) {
+	const Unit* unit = unitOf(line);
+	if (unit == nullptr)
+		return "line " + to_string(line);
+	return unit->name + ":" + to_string(line - unit->lineBase);
+}
+
+size_t ARMv6_Diagnostics::size() {
+	return records.size();
+}
+
+int ARMv6_Diagnostics::count(Severity severity) {
+	int n = 0;
+	for (auto &it: records) {
+		n += it.severity == severity;
+	}
+	return n;
+}
+
+const vector<ARMv6_Diagnostics::Record>& ARMv6_Diagnostics::getRecords() {
+	return records;
+}
+
+vector<const ARMv6_Diagnostics::Record*> ARMv6_Diagnostics::inLineOrder() {
+	vector<const Record*> ordered;
+	ordered.reserve(records.size());
+	for (auto &it: records) {
+		ordered.push_back(&it);
+	}
+	stable_sort(ordered.begin(), ordered.end(), [](const Record* a, const Record* b) {
+		return a->line < b->line;
+	});
+	return ordered;
+}
+
+const char* ARMv6_Diagnostics::severityName(Severity severity) {
+	switch (severity) {
+		case sevError: return "error";
+		case sevWarning: return "warning";
+		default: return "note";
+	}
+}
+
+void ARMv6_Diagnostics::print(FILE* out) {
+	string text;
+	char buf[64];
+	for (auto record: inLineOrder()) {
+		const Record &it = *record;
+		const Unit* unit = unitOf(it.line);
+		if (unit != nullptr) {
+			text += unit->name;
+			snprintf(buf, sizeof(buf), ":%-6u %-7s ", it.line - unit->lineBase, severityName(it.severity));
+		}
+		else
+			snprintf(buf, sizeof(buf), "%6u: %-7s ", it.line, severityName(it.severity));
+		text += buf;
+		if (it.hasOpcode) {
+			snprintf(buf, sizeof(buf), it.i32 ? "[0x%08X] " : "[0x%04X]     ", it.opcode);
+			text += buf;
+		}
+		else {
+			text += it.message;
+			if (!it.source.empty())
+				text += ": ";
+		}
+		text += it.source;
+		text += '\n';
+	}
+	fwrite(text.data(), 1, text.size(), out);
+	fflush(out);
+}
+
+void ARMv6_Diagnostics::appendJSONString(string &out, const string &text) {
+	out += '"';
+	for (char c: text) {
+		if (c == '"' or c == '\\') {
+			out += '\\';
+			out += c;
+		}
+		else if ((unsigned char)c < 0x20) {
+			char buf[8];
+			snprintf(buf, sizeof(buf), "\\u%04x", c);
+			out += buf;
+		}
+		else
+			out += c;
+	}
+	out += '"';
+}
+
+bool ARMv6_Diagnostics::writeJSON(string path) {
+	FILE* file = fopen(path.c_str(), "w");
+	if (file == nullptr)
+		return false;
+
+	vector<const Record*> ordered = inLineOrder();
+	string text = "[\n";
+	char buf[64];
+	for (size_t i=0; i<ordered.size(); i++) {
+		const Record &it = *ordered[i];
+		const Unit* unit = unitOf(it.line);
+		text += "  {";
+		if (unit != nullptr) {
+			text += "\"file\": ";
+			appendJSONString(text, unit->name);
+			text += ", ";
+		}
+		snprintf(buf, sizeof(buf), "\"line\": %u, \"severity\": \"%s\", \"message\": ", it.line - (unit ? unit->lineBase : 0), severityName(it.severity));
+		text += buf;
+		appendJSONString(text, it.message);
+		if (!it.source.empty()) {
+			text += ", \"source\": ";
+			appendJSONString(text, it.source);
+		}
+		if (it.hasOpcode) {
+			snprintf(buf, sizeof(buf), ", \"opcode\": %u, \"size\": %d", it.opcode, it.i32 ? 4 : 2);
+			text += buf;
+		}
+		text += i+1 < ordered.size() ? "},\n" : "}\n";
+	}
+	text += "]\n";
+	fwrite(text.data(), 1, text.size(), file);
+	fclose(file);
+	return true;
+}
@@ -0,0 +1,77 @@
+#ifndef ARMV6_DIAGNOSTICS_H
+#define ARMV6_DIAGNOSTICS_H
+#include <cstdint>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Messages and listing entries produced while assembling, kept in memory and
+// written out once at the end instead of line by line
+class ARMv6_Diagnostics {
+	public:
+		enum Severity {
+			sevError = 1,
+			sevWarning = 2,
+			sevNote = 3
+		};
+		struct Record {
+			uint32_t line;			// Line in the source file starting from 1; 0 if not tied to a line
+			Severity severity;
+			string message;
+			string source;			// Source line for listing entries; empty otherwise
+			bool hasOpcode = false;
+			bool i32 = false;
+			uint32_t opcode = 0;
+		};
+
+		// Output levels, selected by the assembler's logLvl
+		const static int LOG_QUIET = 0;		// Nothing
+		const static int LOG_SUMMARY = 1;	// One summary line
+		const static int LOG_VERBOSE = 2;	// Every message and the full listing
+
+		void add(uint32_t line, Severity severity, string message);
+		void addListing(uint32_t line, string source, string message);
+		void addListing(uint32_t line, string source, uint32_t opcode, bool i32);
+		// Append records of a chunk whose line numbers start after lineBase
+		void append(ARMv6_Diagnostics &other, uint32_t lineBase);
+
+		// Keep records of lines up to keepUpTo; records after tailAfter move to tail with
+		// their lines renumbered from there, the rest are dropped
+		void split(uint32_t keepUpTo, uint32_t tailAfter, ARMv6_Diagnostics &tail);
+		// Drop records added after the first count
+		void truncate(size_t count);
+		// Lines from lineBase+1 on belong to the named file; only set when several files are
+		// linked, so records print as file:line instead of a single line number
+		void addUnit(uint32_t lineBase, string name);
+		// Where a line is in the source, as "line N" or "file:N"
+		string location(uint32_t line);
+
+		int count(Severity severity);
+		size_t size();
+		// Records in the order they were added
+		const vector<Record>& getRecords();
+
+		// Print all records in source order with a single write
+		void print(FILE* out);
+		// Write all records as a JSON array; False if the file cannot be written
+		bool writeJSON(string path);
+
+	private:
+		vector<Record> records;
+		struct Unit {
+			uint32_t lineBase;
+			string name;
+		};
+		// In line order
+		vector<Unit> units;
+
+		// Unit a line belongs to; nullptr for a single file or line 0
+		const Unit* unitOf(uint32_t line);
+
+		// Records ordered by line; stable so messages of a line stay ahead of its listing entry
+		vector<const Record*> inLineOrder();
+		static const char* severityName(Severity severity);
+		static void appendJSONString(string &out, const string &text);
+};
+
+#endif
@@ -0,0 +1,140 @@
+#include "ARMv6_Lexer.h"
+
+const ARMv6_Token ARMv6_Args::EMPTY = {};
+
+int ARMv6_Lexer::tokenize(string_view line, ARMv6_Token* tokens) {
+	int count = 0;
+	size_t i = 0;
+	while (i < line.size() and count < MAX_TOKENS) {
+		// Skip delimiters
+		char c = line[i];
+		if (c == ' ' or c == '\t' or c == ',' or c == '\r') {
+			i++;
+			continue;
+		}
+		size_t start = i;
+		while (i < line.size() and line[i] != ' ' and line[i] != '\t' and line[i] != ',' and line[i] != '\r') {
+			i++;
+		}
+		ARMv6_Token &token = tokens[count++];
+		token = ARMv6_Token();
+		token.text = line.substr(start, i - start);
+		classify(token);
+	}
+	return count;
+}
+
+int ARMv6_Lexer::parseRegister(string_view text) {
+	if (text.size() < 2 or text.size() > 3)
+		return -1;
+	char c0 = text[0] & ~0x20;		// Upper case
+	char c1 = text[1] & ~0x20;
+	if (text.size() == 2) {
+		if (c0 == 'S' and c1 == 'P')
+			return 13;
+		if (c0 == 'L' and c1 == 'R')
+			return 14;
+		if (c0 == 'P' and c1 == 'C')
+			return 15;
+	}
+	if (c0 != 'R' or text[1] < '0' or text[1] > '9')
+		return -1;
+	int reg = text[1] - '0';
+	if (text.size() == 3) {
+		// No leading zeros
+		if (reg == 0 or text[2] < '0' or text[2] > '9')
+			return -1;
+		reg = reg * 10 + text[2] - '0';
+	}
+	return reg < 16 ? reg : -1;
+}
+
+bool ARMv6_Lexer::parseInt(string_view text, int32_t &value) {
+	size_t i = 0;
+	bool negative = false;
+	if (i < text.size() and (text[i] == '-' or text[i] == '+')) {
+		negative = text[i] == '-';
+		i++;
+	}
+
+	int base = 10;
+	if (i + 1 < text.size() and text[i] == '0' and (text[i+1] == 'x' or text[i+1] == 'X')) {
+		base = 16;
+		i += 2;
+	}
+	else if (i < text.size() and text[i] == '0') {
+		base = 8;
+	}
+
+	int64_t result = 0;
+	size_t digitsStart = i;
+	for (; i < text.size(); i++) {
+		char c = text[i];
+		int digit;
+		if (c >= '0' and c <= '9')
+			digit = c - '0';
+		else if (c >= 'a' and c <= 'f')
+			digit = c - 'a' + 10;
+		else if (c >= 'A' and c <= 'F')
+			digit = c - 'A' + 10;
+		else
+			break;
+		if (digit >= base)
+			break;
+		// Saturate like strtol on overflow of a long
+		if (result < 0x100000000LL)
+			result = result * base + digit;
+	}
+	if (i == digitsStart)
+		return false;
+	value = (int32_t)(negative ? -result : result);
+	return true;
+}
+
+void ARMv6_Lexer::classify(ARMv6_Token &token) {
+	string_view core = token.text;
+
+	// Decorations around memory operands, register lists and writeback
+	if (!core.empty() and core.front() == '[') {
+		token.memOpen = true;
+		core.remove_prefix(1);
+	}
+	else if (!core.empty() and core.front() == '{') {
+		token.listOpen = true;
+		core.remove_prefix(1);
+	}
+	if (!core.empty() and core.back() == '!') {
+		token.writeback = true;
+		core.remove_suffix(1);
+	}
+	if (!core.empty() and core.back() == ']') {
+		token.memClose = true;
+		core.remove_suffix(1);
+	}
+	else if (!core.empty() and core.back() == '}') {
+		token.listClose = true;
+		core.remove_suffix(1);
+	}
+	if (!core.empty() and core.back() == '!') {
+		token.writeback = true;
+		core.remove_suffix(1);
+	}
+
+	if (!core.empty() and core.front() == '#') {
+		token.isImm = true;
+		parseInt(core.substr(1), token.imm);
+		return;
+	}
+
+	size_t dash = core.find('-');
+	if (dash != string_view::npos and dash > 0) {
+		// Register range
+		token.reg = parseRegister(core.substr(0, dash));
+		token.regEnd = parseRegister(core.substr(dash + 1));
+		return;
+	}
+
+	token.reg = parseRegister(core);
+	if (token.reg < 0)
+		parseInt(core, token.imm);
+}
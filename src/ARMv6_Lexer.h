@@ -0,0 +1,60 @@
+#ifndef ARMV6_LEXER_H
+#define ARMV6_LEXER_H
+#include <cstdint>
+#include <string_view>
+using namespace std;
+
+// One operand or mnemonic of an assembly line. Text points into the source line;
+// registers and immediates are classified while splitting so no token is copied.
+struct ARMv6_Token {
+	string_view text;		// As written, including brackets, braces, '#' and '!'
+	int reg = -1;			// Register number ignoring surrounding brackets, braces and '!'; -1 if none
+	int regEnd = -1;		// Last register of a range such as R0-R3; -1 if not a range or invalid
+	bool isImm = false;		// Starts with '#'
+	int32_t imm = 0;		// Leading number after an optional '#'; 0 if none
+	bool memOpen = false;	// Starts with '['
+	bool memClose = false;	// Ends with ']'
+	bool listOpen = false;	// Starts with '{'
+	bool listClose = false;	// Ends with '}'
+	bool writeback = false;	// Ends with '!'
+};
+
+// Tokens of a single line; indexing past either end gives an empty token
+class ARMv6_Args {
+	private:
+		const ARMv6_Token* tokens;
+		int count;
+		static const ARMv6_Token EMPTY;
+	public:
+		ARMv6_Args(const ARMv6_Token* tokens, int count) : tokens(tokens), count(count) {}
+
+		const ARMv6_Token& operator[](int i) const {
+			return (i >= 0 and i < count) ? tokens[i] : EMPTY;
+		}
+		int size() const {
+			return count;
+		}
+		// Tokens after the first one
+		ARMv6_Args next() const {
+			return count > 0 ? ARMv6_Args(tokens + 1, count - 1) : *this;
+		}
+};
+
+class ARMv6_Lexer {
+	public:
+		const static int MAX_TOKENS = 32;
+
+		// Split a line on spaces, tabs and commas into at most MAX_TOKENS tokens;
+		// returns the number of tokens. Nothing is allocated.
+		static int tokenize(string_view line, ARMv6_Token* tokens);
+
+		// Register number for R0-R15, SP, LR or PC in any case; -1 otherwise
+		static int parseRegister(string_view text);
+		// Parses a leading integer like strtol with base 0; False if there is no digit
+		static bool parseInt(string_view text, int32_t &value);
+
+	private:
+		static void classify(ARMv6_Token &token);
+};
+
+#endif
@@ -0,0 +1,135 @@
+#ifndef ARMV6_MNEMONICS_H
+#define ARMV6_MNEMONICS_H
+#include <cstdint>
+#include <string_view>
+
+// Instruction mnemonics and assembler directives known to ARMv6_Assembler, looked up
+// through a perfect hash built at compile time. Adding a name that collides changes
+// the seed; if no seed is found within the search limit the build fails.
+
+// Order must match MNEMONIC_NAMES
+enum ARMv6_Mnemonic : uint8_t {
+	// Cortex-M0+ Devices Generic User Guide 3.1
+	MN_ADCS, MN_ADD, MN_ADDS, MN_ADR, MN_ANDS, MN_ASRS,
+	MN_B, MN_BEQ, MN_BNE, MN_BCS, MN_BHS, MN_BCC, MN_BLO, MN_BMI, MN_BPL, MN_BVS, MN_BVC,
+	MN_BHI, MN_BLS, MN_BGE, MN_BLT, MN_BGT, MN_BLE, MN_BAL,
+	MN_BICS, MN_BKPT, MN_BL, MN_BLX, MN_BX, MN_CMN, MN_CMP, MN_CPSID, MN_CPSIE, MN_CPY,
+	MN_DMB, MN_DSB, MN_EORS, MN_ISB,
+	MN_LDM, MN_LDMIA, MN_LDMFD, MN_LDR, MN_LDRB, MN_LDRH, MN_LDRSB, MN_LDRSH, MN_LSLS, MN_LSRS,
+	MN_MOV, MN_MOVS, MN_MRS, MN_MSR, MN_MULS, MN_MVNS, MN_NOP, MN_ORRS, MN_POP, MN_PUSH,
+	MN_REV, MN_REV16, MN_REVSH, MN_RORS, MN_RSBS, MN_SBCS, MN_SEV,
+	MN_STM, MN_STMIA, MN_STMEA, MN_STR, MN_STRB, MN_STRH, MN_SUB, MN_SUBS, MN_SVC,
+	MN_SXTB, MN_SXTH, MN_TST, MN_UDF, MN_UXTB, MN_UXTH, MN_WFE, MN_WFI, MN_YIELD,
+	// Directives
+	DIR_ALIGN, DIR_EABI_ATTRIBUTE, DIR_CPU, DIR_FPU, DIR_ARCH, DIR_FILE, DIR_TEXT, DIR_SECTION,
+	DIR_IDENT, DIR_WORD, DIR_ASCII, DIR_P2ALIGN, DIR_GLOBAL, DIR_SYNTAX, DIR_CODE,
+	DIR_THUMB_FUNC, DIR_TYPE, DIR_SIZE,
+	MN_COUNT,
+	MN_UNKNOWN = MN_COUNT
+};
+
+constexpr const char* MNEMONIC_NAMES[MN_COUNT] = {
+	"ADCS", "ADD", "ADDS", "ADR", "ANDS", "ASRS",
+	"B", "BEQ", "BNE", "BCS", "BHS", "BCC", "BLO", "BMI", "BPL", "BVS", "BVC",
+	"BHI", "BLS", "BGE", "BLT", "BGT", "BLE", "BAL",
+	"BICS", "BKPT", "BL", "BLX", "BX", "CMN", "CMP", "CPSID", "CPSIE", "CPY",
+	"DMB", "DSB", "EORS", "ISB",
+	"LDM", "LDMIA", "LDMFD", "LDR", "LDRB", "LDRH", "LDRSB", "LDRSH", "LSLS", "LSRS",
+	"MOV", "MOVS", "MRS", "MSR", "MULS", "MVNS", "NOP", "ORRS", "POP", "PUSH",
+	"REV", "REV16", "REVSH", "RORS", "RSBS", "SBCS", "SEV",
+	"STM", "STMIA", "STMEA", "STR", "STRB", "STRH", "SUB", "SUBS", "SVC",
+	"SXTB", "SXTH", "TST", "UDF", "UXTB", "UXTH", "WFE", "WFI", "YIELD",
+	".ALIGN", ".EABI_ATTRIBUTE", ".CPU", ".FPU", ".ARCH", ".FILE", ".TEXT", ".SECTION",
+	".IDENT", ".WORD", ".ASCII", ".P2ALIGN", ".GLOBAL", ".SYNTAX", ".CODE",
+	".THUMB_FUNC", ".TYPE", ".SIZE"
+};
+
+namespace ARMv6_MnemonicHash {
+	const int TABLE_BITS = 12;
+	const int TABLE_SIZE = 1 << TABLE_BITS;
+	const uint32_t SEED_LIMIT = 100000;
+
+	constexpr char upper(char c) {
+		return (c >= 'a' and c <= 'z') ? c - 'a' + 'A' : c;
+	}
+
+	// Case-insensitive FNV-1a variant mixed with a seed
+	constexpr uint32_t hash(std::string_view text, uint32_t seed) {
+		uint32_t h = 2166136261u ^ (seed * 0x9E3779B9u);
+		for (size_t i=0; i<text.size(); i++) {
+			h = (h ^ (uint8_t)upper(text[i])) * 16777619u;
+		}
+		h ^= h >> 15;
+		return h & (TABLE_SIZE - 1);
+	}
+
+	constexpr bool collides(uint32_t seed) {
+		bool used[TABLE_SIZE] = {};
+		for (int i=0; i<MN_COUNT; i++) {
+			uint32_t slot = hash(MNEMONIC_NAMES[i], seed);
+			if (used[slot])
+				return true;
+			used[slot] = true;
+		}
+		return false;
+	}
+
+	constexpr uint32_t findSeed() {
+		for (uint32_t seed=0; seed<SEED_LIMIT; seed++) {
+			if (!collides(seed))
+				return seed;
+		}
+		return SEED_LIMIT;
+	}
+
+	const uint32_t SEED = findSeed();
+	static_assert(SEED < SEED_LIMIT, "No collision-free seed for the mnemonic table");
+
+	struct Table {
+		uint8_t slots[TABLE_SIZE];
+	};
+
+	constexpr Table buildTable() {
+		Table table = {};
+		for (int i=0; i<TABLE_SIZE; i++) {
+			table.slots[i] = MN_UNKNOWN;
+		}
+		for (int i=0; i<MN_COUNT; i++) {
+			table.slots[hash(MNEMONIC_NAMES[i], SEED)] = i;
+		}
+		return table;
+	}
+
+	constexpr Table TABLE = buildTable();
+
+	constexpr bool equalsIgnoreCase(const char* name, std::string_view text) {
+		size_t i = 0;
+		for (; name[i] != '\0'; i++) {
+			if (i >= text.size() or upper(text[i]) != name[i])
+				return false;
+		}
+		return i == text.size();
+	}
+}
+
+// Single table probe; MN_UNKNOWN if text is not a known mnemonic or directive
+constexpr ARMv6_Mnemonic lookupMnemonic(std::string_view text) {
+	uint8_t id = ARMv6_MnemonicHash::TABLE.slots[ARMv6_MnemonicHash::hash(text, ARMv6_MnemonicHash::SEED)];
+	if (id == MN_UNKNOWN or !ARMv6_MnemonicHash::equalsIgnoreCase(MNEMONIC_NAMES[id], text))
+		return MN_UNKNOWN;
+	return (ARMv6_Mnemonic)id;
+}
+
+// Every name must map back to itself
+constexpr bool mnemonicTableValid() {
+	for (int i=0; i<MN_COUNT; i++) {
+		if (lookupMnemonic(MNEMONIC_NAMES[i]) != i)
+			return false;
+	}
+	return true;
+}
+static_assert(mnemonicTableValid(), "Mnemonic table is not a perfect hash");
+static_assert(lookupMnemonic("adcs") == MN_ADCS and lookupMnemonic(".thumb_func") == DIR_THUMB_FUNC, "Lookup must be case-insensitive");
+static_assert(lookupMnemonic("ADC") == MN_UNKNOWN and lookupMnemonic("") == MN_UNKNOWN, "Unknown names must not match");
+
+#endif
@@ -0,0 +1,244 @@
+#include "ARMv6_Object.h"
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>			// For open()
+#include <fstream>
+#include <sys/mman.h>		// For mmap()
+#include <sys/stat.h>		// For fstat(), mkdir()
+#include <unistd.h>			// For close()
+
+static const char OBJECT_MAGIC[4] = {'M', '0', 'O', 'B'};
+
+static size_t align4(size_t size) {
+	return (size + 3) & ~(size_t)3;
+}
+
+ARMv6_Object::~ARMv6_Object() {
+	unload();
+}
+
+void ARMv6_Object::unload() {
+	if (file != nullptr)
+		munmap((void*)file, fileSize);
+	file = nullptr;
+	fileSize = 0;
+}
+
+uint64_t ARMv6_Object::hashSource(const char* data, size_t size) {
+	uint64_t hash = 0xcbf29ce484222325;
+	for (size_t i=0; i<size; i++) {
+		hash = (hash ^ (uint8_t)data[i]) * 0x100000001b3;
+	}
+	return hash;
+}
+
+bool ARMv6_Object::hashFile(string path, uint64_t &hash) {
+	int fd = open(path.c_str(), O_RDONLY);
+	struct stat st;
+	if (fd < 0 or fstat(fd, &st) != 0) {
+		if (fd >= 0)
+			close(fd);
+		return 0;
+	}
+	size_t size = st.st_size;
+	if (size == 0) {
+		close(fd);
+		hash = hashSource("", 0);
+		return 1;
+	}
+	const char* data = (const char*) mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return 0;
+	madvise((void*)data, size, MADV_SEQUENTIAL);
+	hash = hashSource(data, size);
+	munmap((void*)data, size);
+	return 1;
+}
+
+bool ARMv6_Object::hashFiles(const vector<string> &paths, uint64_t &hash) {
+	vector<uint64_t> hashes(paths.size());
+	for (size_t i=0; i<paths.size(); i++) {
+		if (!hashFile(paths[i], hashes[i]))
+			return 0;
+	}
+	hash = combineHashes(paths, hashes);
+	return 1;
+}
+
+uint64_t ARMv6_Object::combineHashes(const vector<string> &paths, const vector<uint64_t> &hashes) {
+	if (hashes.size() == 1)
+		return hashes[0];
+	// Paths are part of the hash since local labels are named after them
+	string key;
+	for (size_t i=0; i<hashes.size(); i++) {
+		key += paths[i];
+		key += '\0';
+		key.append((const char*)&hashes[i], sizeof(hashes[i]));
+	}
+	return hashSource(key.data(), key.size());
+}
+
+string ARMv6_Object::objectPath(string dirPath, uint64_t sourceHash) {
+	char name[32];
+	snprintf(name, sizeof(name), "/%016lx.obj", (unsigned long)sourceHash);
+	return dirPath + name;
+}
+
+bool ARMv6_Object::save(string dirPath, uint64_t sourceHash, const ARMv6_Program &program, const string &summary) {
+	// Code in memory order: big-endian halfwords
+	vector<uint8_t> code;
+	code.reserve(program.getCode().size() * 2 + 3);
+	for (uint16_t half: program.getCode()) {
+		code.push_back(half >> 8);
+		code.push_back(half);
+	}
+	vector<LineEntry> entries;
+	string pool;
+	entries.reserve(program.size());
+	for (size_t i=0; i<program.size(); i++) {
+		ARMv6_Program::Instruction inst = program.at(i);
+		uint32_t flags = (inst.i32 ? FLAG_I32 : 0) | (inst.label ? FLAG_LABEL : 0);
+		entries.push_back({inst.line, inst.addr, flags, (uint32_t)pool.size(), (uint32_t)inst.text.size()});
+		pool += inst.text;
+	}
+	vector<Symbol> symbols;
+	symbols.reserve(program.getLabels().size());
+	for (auto &it: program.getLabels()) {
+		symbols.push_back({it.second, (uint32_t)pool.size(), (uint32_t)it.first.size()});
+		pool += it.first;
+	}
+
+	Header header = {};
+	memcpy(header.magic, OBJECT_MAGIC, 4);
+	header.version = FORMAT_VERSION;
+	header.sourceHash = sourceHash;
+	header.baseAddr = program.getBaseAddr();
+	header.startAddr = program.getStartAddr();
+	header.codeBytes = code.size();
+	header.symbolCount = symbols.size();
+	header.lineCount = entries.size();
+	header.summaryOffset = pool.size();
+	header.summaryLength = summary.size();
+	pool += summary;
+	header.stringBytes = pool.size();
+	code.resize(align4(code.size()));
+
+	mkdir(dirPath.c_str(), 0755);
+	// Write to a temporary file first so concurrent runs never map a partial file
+	string path = objectPath(dirPath, sourceHash);
+	string tmpPath = path + ".tmp" + to_string(getpid());
+	ofstream out(tmpPath, ios::binary);
+	if (!out.is_open())
+		return false;
+	out.write((char*)&header, sizeof(header));
+	out.write((char*)code.data(), code.size());
+	out.write((char*)symbols.data(), symbols.size() * sizeof(Symbol));
+	out.write((char*)entries.data(), entries.size() * sizeof(LineEntry));
+	out.write(pool.data(), pool.size());
+	out.close();
+	if (out.fail() or rename(tmpPath.c_str(), path.c_str()) != 0) {
+		remove(tmpPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool ARMv6_Object::load(string dirPath, uint64_t sourceHash) {
+	unload();
+	int fd = open(objectPath(dirPath, sourceHash).c_str(), O_RDONLY);
+	if (fd < 0)
+		return 0;
+	struct stat st;
+	if (fstat(fd, &st) != 0 or st.st_size < (off_t)sizeof(Header)) {
+		close(fd);
+		return 0;
+	}
+	fileSize = st.st_size;
+	file = (const uint8_t*) mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (file == MAP_FAILED) {
+		file = nullptr;
+		return 0;
+	}
+
+	memcpy(&header, file, sizeof(header));
+	size_t symbolsPos = sizeof(header) + align4(header.codeBytes);
+	size_t linesPos = symbolsPos + (size_t)header.symbolCount * sizeof(Symbol);
+	size_t stringsPos = linesPos + (size_t)header.lineCount * sizeof(LineEntry);
+	if (
+			memcmp(header.magic, OBJECT_MAGIC, 4) != 0 or
+			header.version != FORMAT_VERSION or
+			header.sourceHash != sourceHash or
+			stringsPos + header.stringBytes != fileSize or
+			(size_t)header.summaryOffset + header.summaryLength > header.stringBytes
+		) {
+		unload();
+		return 0;
+	}
+	code = file + sizeof(header);
+	symbols = (const Symbol*)(file + symbolsPos);
+	lines = (const LineEntry*)(file + linesPos);
+	strings = (const char*)(file + stringsPos);
+
+	// Every reference must stay inside the file
+	for (uint32_t i=0; i<header.symbolCount; i++) {
+		if ((size_t)symbols[i].nameOffset + symbols[i].nameLength > header.stringBytes) {
+			unload();
+			return 0;
+		}
+	}
+	for (uint32_t i=0; i<header.lineCount; i++) {
+		const LineEntry &it = lines[i];
+		uint32_t size = (it.flags & FLAG_I32) ? 4 : 2;
+		if ((size_t)it.textOffset + it.textLength > header.stringBytes or it.addr < header.baseAddr
+				or (size_t)it.addr - header.baseAddr + size > header.codeBytes) {
+			unload();
+			return 0;
+		}
+	}
+	return 1;
+}
+
+const uint8_t* ARMv6_Object::getCode() {
+	return code;
+}
+
+uint32_t ARMv6_Object::getCodeSize() {
+	return header.codeBytes;
+}
+
+uint32_t ARMv6_Object::getBaseAddr() {
+	return header.baseAddr;
+}
+
+uint32_t ARMv6_Object::getStartAddr() {
+	return header.startAddr;
+}
+
+ARMv6_Program ARMv6_Object::getProgram() {
+	ARMv6_Program program(header.baseAddr);
+	program.reserve(header.lineCount);
+	for (uint32_t i=0; i<header.lineCount; i++) {
+		const LineEntry &it = lines[i];
+		const uint8_t* at = code + (it.addr - header.baseAddr);
+		bool i32 = it.flags & FLAG_I32;
+		uint32_t opcode = at[0] << 8 | at[1];
+		if (i32)
+			opcode = opcode << 16 | at[2] << 8 | at[3];
+		program.append(opcode, i32, it.flags & FLAG_LABEL, string_view(strings + it.textOffset, it.textLength), it.line);
+	}
+	unordered_map<string, uint32_t> labels;
+	for (uint32_t i=0; i<header.symbolCount; i++) {
+		labels[string(strings + symbols[i].nameOffset, symbols[i].nameLength)] = symbols[i].addr;
+	}
+	program.setLabels(move(labels));
+	program.setStartAddr(header.startAddr);
+	return program;
+}
+
+string ARMv6_Object::getSummary() {
+	if (file == nullptr)
+		return "";
+	return string(strings + header.summaryOffset, header.summaryLength);
+}
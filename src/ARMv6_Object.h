@@ -0,0 +1,90 @@
+#ifndef ARMV6_OBJECT_H
+#define ARMV6_OBJECT_H
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "ARMv6_Program.h"
+using namespace std;
+
+// Assembled program stored next to the translation cache so unchanged sources are not
+// assembled again. The file is mapped as is; the code section is already in guest
+// memory order and can be copied straight into the core.
+//
+// Layout: Header, code padded to 4 bytes, symbolCount Symbol entries, lineCount
+// LineEntry entries, then a pool of names, listing text and the summary.
+class ARMv6_Object {
+	public:
+		// Bumped whenever the layout or the assembler's output changes
+		const static uint32_t FORMAT_VERSION = 1;
+
+		struct Header {
+			char magic[4];
+			uint32_t version;
+			uint64_t sourceHash;	// Hash of the source file contents
+			uint32_t baseAddr;
+			uint32_t startAddr;
+			uint32_t codeBytes;
+			uint32_t symbolCount;
+			uint32_t lineCount;
+			uint32_t stringBytes;
+			uint32_t summaryOffset;	// Into the string pool
+			uint32_t summaryLength;
+		};
+		struct Symbol {
+			uint32_t addr;
+			uint32_t nameOffset;
+			uint32_t nameLength;
+		};
+		// One per instruction, in address order
+		struct LineEntry {
+			uint32_t line;			// Source line starting from 1
+			uint32_t addr;
+			uint32_t flags;			// FLAG_I32, FLAG_LABEL
+			uint32_t textOffset;	// Listing text in the string pool
+			uint32_t textLength;
+		};
+		const static uint32_t FLAG_I32 = 1;
+		const static uint32_t FLAG_LABEL = 2;
+
+		ARMv6_Object() {}
+		~ARMv6_Object();
+		ARMv6_Object(const ARMv6_Object&) = delete;
+		ARMv6_Object& operator=(const ARMv6_Object&) = delete;
+
+		// 64-bit FNV-1a of a source file's contents; False if it cannot be read
+		static bool hashFile(string path, uint64_t &hash);
+		static uint64_t hashSource(const char* data, size_t size);
+		// Hash of several files linked in the given order; a single file hashes as with hashFile()
+		static bool hashFiles(const vector<string> &paths, uint64_t &hash);
+		static uint64_t combineHashes(const vector<string> &paths, const vector<uint64_t> &hashes);
+
+		// Write the object of a source to the cache directory; True on success
+		static bool save(string dirPath, uint64_t sourceHash, const ARMv6_Program &program, const string &summary);
+		// Map the object of a source from the cache directory; False if there is none or it
+		// does not match the source hash and format version
+		bool load(string dirPath, uint64_t sourceHash);
+
+		// Code laid out as in guest memory, starting at getBaseAddr()
+		const uint8_t* getCode();
+		uint32_t getCodeSize();
+		uint32_t getBaseAddr();
+		uint32_t getStartAddr();
+		// Instructions, listing text and labels, as returned by ARMv6_Assembler::getProgram()
+		ARMv6_Program getProgram();
+		// Summary of the assembly that produced the object
+		string getSummary();
+
+	private:
+		const uint8_t* file = nullptr;
+		size_t fileSize = 0;
+		Header header = {};
+		const uint8_t* code = nullptr;
+		const Symbol* symbols = nullptr;
+		const LineEntry* lines = nullptr;
+		const char* strings = nullptr;
+
+		static string objectPath(string dirPath, uint64_t sourceHash);
+		void unload();
+};
+
+#endif
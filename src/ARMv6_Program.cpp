@@ -0,0 +1,116 @@
+#include "ARMv6_Program.h"
+
+void ARMv6_Program::reserve(size_t instructions) {
+	code.reserve(instructions);
+	textIds.reserve(instructions);
+	lines.reserve(instructions);
+	wideBits.reserve(instructions / 64 + 1);
+	labelBits.reserve(instructions / 64 + 1);
+	wideRank.reserve(instructions / 64 + 1);
+}
+
+void ARMv6_Program::append(uint32_t opcode, bool i32, bool label, string_view text, uint32_t line) {
+	size_t word = count / 64;
+	uint64_t bit = 1ULL << (count % 64);
+	if (word == wideBits.size()) {
+		wideRank.push_back(word == 0 ? 0 : wideRank.back() + __builtin_popcountll(wideBits.back()));
+		wideBits.push_back(0);
+		labelBits.push_back(0);
+	}
+	if (i32) {
+		wideBits[word] |= bit;
+		code.push_back(opcode >> 16);
+	}
+	code.push_back(opcode);
+	if (label)
+		labelBits[word] |= bit;
+	textIds.push_back(intern(text));
+	lines.push_back(line);
+	count++;
+}
+
+uint32_t ARMv6_Program::intern(string_view text) {
+	// FNV-1a; a colliding text that differs is stored again
+	uint64_t hash = 0xcbf29ce484222325;
+	for (char c: text) {
+		hash = (hash ^ (uint8_t)c) * 0x100000001b3;
+	}
+	auto found = textIndex.find(hash);
+	if (found != textIndex.end()) {
+		auto &it = texts[found->second];
+		if (string_view(arena).substr(it.first, it.second) == text)
+			return found->second;
+	}
+	uint32_t id = texts.size();
+	texts.push_back({(uint32_t)arena.size(), (uint32_t)text.size()});
+	arena += text;
+	textIndex.emplace(hash, id);
+	return id;
+}
+
+ARMv6_Program::Instruction ARMv6_Program::at(size_t i) const {
+	size_t word = i / 64;
+	int shift = i % 64;
+	uint64_t below = shift ? wideBits[word] << (64 - shift) : 0;
+	size_t half = i + wideRank[word] + __builtin_popcountll(below);
+
+	Instruction inst;
+	inst.addr = baseAddr + half * 2;
+	inst.i32 = (wideBits[word] >> shift) & 1;
+	inst.label = (labelBits[word] >> shift) & 1;
+	inst.opcode = inst.i32 ? (uint32_t)code[half] << 16 | code[half+1] : code[half];
+	auto &text = texts[textIds[i]];
+	inst.text = string_view(arena).substr(text.first, text.second);
+	inst.line = lines[i];
+	return inst;
+}
+
+bool ARMv6_Program::find(uint32_t addr, size_t &i) const {
+	if (addr < baseAddr or (addr - baseAddr) / 2 >= code.size())
+		return false;
+	size_t half = (addr - baseAddr) / 2;
+	// Last word of 64 instructions starting at or before the halfword
+	size_t lo = 0, hi = wideBits.size();
+	while (hi - lo > 1) {
+		size_t mid = (lo + hi) / 2;
+		if (mid * 64 + wideRank[mid] <= half)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	// Walk the word; each instruction covers one or two halfwords
+	size_t start = lo * 64 + wideRank[lo];
+	for (size_t inst=lo*64; inst<count; inst++) {
+		size_t next = start + 1 + ((wideBits[inst / 64] >> (inst % 64)) & 1);
+		if (half < next) {
+			i = inst;
+			return true;
+		}
+		start = next;
+	}
+	return false;
+}
+
+void ARMv6_Program::setLabels(unordered_map<string, uint32_t> labels) {
+	this -> labels = move(labels);
+}
+
+void ARMv6_Program::setStartAddr(uint32_t addr) {
+	startAddr = addr;
+}
+
+uint32_t ARMv6_Program::getBaseAddr() const {
+	return baseAddr;
+}
+
+uint32_t ARMv6_Program::getStartAddr() const {
+	return startAddr;
+}
+
+const vector<uint16_t>& ARMv6_Program::getCode() const {
+	return code;
+}
+
+const unordered_map<string, uint32_t>& ARMv6_Program::getLabels() const {
+	return labels;
+}
@@ -0,0 +1,76 @@
+#ifndef ARMV6_PROGRAM_H
+#define ARMV6_PROGRAM_H
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// Assembled program handed from the assembler or an object file to the core and the TUI,
+// which only borrow it. Opcodes are kept as the halfwords loaded into memory, per
+// instruction flags in bitsets and listing text once per distinct line.
+class ARMv6_Program {
+	public:
+		// One instruction as seen through the image; text points into the program
+		struct Instruction {
+			uint32_t addr;
+			uint32_t opcode;
+			bool i32;			// True for 32-bits instruction, False for 16-bits
+			bool label;			// True if line includes a label
+			string_view text;	// Source line as listed
+			uint32_t line;		// Source line starting from 1
+		};
+
+		ARMv6_Program(uint32_t baseAddr = 0) : baseAddr(baseAddr), startAddr(baseAddr) {}
+		ARMv6_Program(ARMv6_Program&&) = default;
+		ARMv6_Program& operator=(ARMv6_Program&&) = default;
+		ARMv6_Program(const ARMv6_Program&) = delete;
+		ARMv6_Program& operator=(const ARMv6_Program&) = delete;
+
+		void reserve(size_t instructions);
+		// Add the instruction following the last one
+		void append(uint32_t opcode, bool i32, bool label, string_view text, uint32_t line);
+		void setLabels(unordered_map<string, uint32_t> labels);
+		void setStartAddr(uint32_t addr);
+
+		// Number of instructions
+		size_t size() const {
+			return count;
+		}
+		Instruction at(size_t i) const;
+		// Index of the instruction covering an address; False if it is outside the program
+		bool find(uint32_t addr, size_t &i) const;
+
+		uint32_t getBaseAddr() const;
+		uint32_t getStartAddr() const;
+		// Halfwords as laid out in memory from the base address; upper halfword of 32-bit instructions first
+		const vector<uint16_t>& getCode() const;
+		const unordered_map<string, uint32_t>& getLabels() const;
+
+	private:
+		uint32_t baseAddr;
+		uint32_t startAddr;
+		size_t count = 0;
+		vector<uint16_t> code;
+
+		// One bit per instruction
+		vector<uint64_t> wideBits;		// 32-bit instruction
+		vector<uint64_t> labelBits;		// Line includes a label
+		// 32-bit instructions before each word of wideBits; locates an instruction's halfwords
+		vector<uint32_t> wideRank;
+
+		// Per instruction
+		vector<uint32_t> textIds;
+		vector<uint32_t> lines;
+		// Distinct listing texts stored back to back
+		string arena;
+		vector<pair<uint32_t, uint32_t>> texts;		// Offset and length in arena
+		unordered_map<uint64_t, uint32_t> textIndex;	// Hash of a text to its id
+
+		unordered_map<string, uint32_t> labels;
+
+		uint32_t intern(string_view text);
+};
+
+#endif
@@ -0,0 +1,639 @@
+#include "ARMv6_Reference.h"
+
+// ==== Pseudocode helpers from ARMv6-M Architecture Reference Manual A2.2 / D6
+
+struct ResultCarry {
+	uint32_t result;
+	bool carry;
+};
+
+struct ResultCarryOverflow {
+	uint32_t result;
+	bool carry;
+	bool overflow;
+};
+
+static ResultCarryOverflow addWithCarry(uint32_t x, uint32_t y, bool carryIn) {
+	uint64_t unsignedSum = (uint64_t)x + (uint64_t)y + carryIn;
+	int64_t signedSum = (int64_t)(int32_t)x + (int64_t)(int32_t)y + carryIn;
+	ResultCarryOverflow out;
+	out.result = (uint32_t)unsignedSum;
+	out.carry = (uint64_t)out.result != unsignedSum;
+	out.overflow = (int64_t)(int32_t)out.result != signedSum;
+	return out;
+}
+
+enum ShiftType {
+	LSL,
+	LSR,
+	ASR,
+	ROR
+};
+
+static ResultCarry shift_C(uint32_t value, ShiftType type, uint32_t amount, bool carryIn) {
+	if (amount == 0)
+		return {value, carryIn};
+
+	switch (type) {
+		case LSL:
+			if (amount > 32)
+				return {0, 0};
+			return {amount == 32 ? 0 : value << amount, (bool)((value >> (32-amount)) & 1)};
+		case LSR:
+			if (amount > 32)
+				return {0, 0};
+			return {amount == 32 ? 0 : value >> amount, (bool)((value >> (amount-1)) & 1)};
+		case ASR:
+			if (amount >= 32)
+				return {(value >> 31) ? 0xFFFFFFFF : 0, (bool)(value >> 31)};
+			return {(uint32_t)((int32_t)value >> amount), (bool)((value >> (amount-1)) & 1)};
+		case ROR:
+			{
+				uint32_t m = amount % 32;
+				uint32_t result = m == 0 ? value : (value >> m) | (value << (32-m));
+				return {result, (bool)(result >> 31)};
+			}
+	}
+	return {value, carryIn};
+}
+
+static int bitCount(uint32_t value) {
+	return __builtin_popcount(value);
+}
+
+static uint32_t signExtend(uint32_t value, int bits) {
+	uint32_t sign = 1u << (bits-1);
+	return (value ^ sign) - sign;
+}
+
+// ====
+
+ARMv6_Reference::ARMv6_Reference(uint32_t memSize, ReadFn read) {
+	this -> memSize = memSize;
+	this -> read = read;
+}
+
+bool ARMv6_Reference::accessible(uint32_t addr, int size) {
+	// Unaligned accesses fault on ARMv6-M
+	if (addr % size != 0)
+		return false;
+	return (uint64_t)addr + size <= memSize;
+}
+
+ARMv6_Reference::Outcome ARMv6_Reference::step(State &s, uint16_t op, vector<MemWrite> &writes) {
+	writes.clear();
+	Outcome out;
+
+	// A5.2 16-bit Thumb instruction encoding
+	uint8_t opcode6 = op >> 10;
+	if (opcode6 < 0b010000)
+		out = shiftAddSubMovCmp(s, op);
+	else if (opcode6 == 0b010000)
+		out = dataProcessing(s, op);
+	else if (opcode6 == 0b010001)
+		out = specialDataBranch(s, op);
+	else if ((op >> 11) == 0b01001) {
+		// LDR (literal)
+		uint8_t Rt = (op >> 8) & 0b111;
+		uint32_t addr = ((s.R[15] + 4) & ~3u) + (op & 0xFF) * 4;
+		if (!accessible(addr, 4))
+			return fault;
+		s.R[Rt] = read(addr, 4);
+		s.R[15] += 2;
+		out = executed;
+	}
+	else if (opcode6 < 0b101000)
+		out = loadStore(s, op, writes);
+	else if ((op >> 11) == 0b10100) {
+		// ADR
+		s.R[(op >> 8) & 0b111] = ((s.R[15] + 4) & ~3u) + (op & 0xFF) * 4;
+		s.R[15] += 2;
+		out = executed;
+	}
+	else if ((op >> 11) == 0b10101) {
+		// ADD (SP plus immediate) T1
+		s.R[(op >> 8) & 0b111] = s.R[13] + (op & 0xFF) * 4;
+		s.R[15] += 2;
+		out = executed;
+	}
+	else if ((op >> 12) == 0b1011)
+		out = misc(s, op, writes);
+	else if ((op >> 12) == 0b1100)
+		out = loadStoreMultiple(s, op, writes);
+	else if ((op >> 11) <= 0b11100)
+		out = branch(s, op);
+	else
+		// 32-bit instructions
+		out = unmodelled;
+
+	return out;
+}
+
+ARMv6_Reference::Outcome ARMv6_Reference::shiftAddSubMovCmp(State &s, uint16_t op) {
+	uint8_t Rd = op & 0b111;
+	uint8_t Rm = (op >> 3) & 0b111;
+	uint8_t imm5 = (op >> 6) & 0b11111;
+	uint8_t Rdn = (op >> 8) & 0b111;
+	uint8_t imm8 = op & 0xFF;
+
+	switch (op >> 11) {
+		case 0b000:		// LSLS (immediate); MOVS (register) when imm5 is 0
+		case 0b001:		// LSRS (immediate)
+		case 0b010:		// ASRS (immediate)
+			{
+				ShiftType type = (op >> 11) == 0 ? LSL : ((op >> 11) == 1 ? LSR : ASR);
+				uint32_t amount = imm5;
+				if (type != LSL and imm5 == 0)
+					amount = 32;
+				ResultCarry rc = shift_C(s.R[Rm], type, amount, s.C);
+				s.R[Rd] = rc.result;
+				s.N = rc.result >> 31;
+				s.Z = rc.result == 0;
+				s.C = rc.carry;
+			}
+			break;
+		case 0b011:
+			{
+				uint8_t Rn = (op >> 3) & 0b111;
+				uint32_t operand = (op >> 10) & 1 ? (op >> 6) & 0b111 : s.R[(op >> 6) & 0b111];
+				bool subtract = (op >> 9) & 1;
+				// ADDS/SUBS register or 3-bit immediate
+				ResultCarryOverflow r = subtract ? addWithCarry(s.R[Rn], ~operand, 1) : addWithCarry(s.R[Rn], operand, 0);
+				s.R[Rd] = r.result;
+				s.N = r.result >> 31;
+				s.Z = r.result == 0;
+				s.C = r.carry;
+				s.V = r.overflow;
+			}
+			break;
+		case 0b100:		// MOVS (immediate)
+			s.R[Rdn] = imm8;
+			s.N = 0;
+			s.Z = imm8 == 0;
+			break;
+		case 0b101:		// CMP (immediate)
+		case 0b110:		// ADDS (8-bit immediate)
+		case 0b111:		// SUBS (8-bit immediate)
+			{
+				bool add = (op >> 11) == 0b110;
+				ResultCarryOverflow r = add ? addWithCarry(s.R[Rdn], imm8, 0) : addWithCarry(s.R[Rdn], ~(uint32_t)imm8, 1);
+				if ((op >> 11) != 0b101)
+					s.R[Rdn] = r.result;
+				s.N = r.result >> 31;
+				s.Z = r.result == 0;
+				s.C = r.carry;
+				s.V = r.overflow;
+			}
+			break;
+	}
+	s.R[15] += 2;
+	return executed;
+}
+
+ARMv6_Reference::Outcome ARMv6_Reference::dataProcessing(State &s, uint16_t op) {
+	uint8_t Rdn = op & 0b111;
+	uint8_t Rm = (op >> 3) & 0b111;
+	uint32_t a = s.R[Rdn];
+	uint32_t b = s.R[Rm];
+	uint32_t result = 0;
+	bool writeResult = true;
+	bool arithmetic = false;
+	ResultCarryOverflow r = {0, s.C, s.V};
+
+	switch ((op >> 6) & 0xF) {
+		case 0b0000:	// ANDS
+			result = a & b;
+			break;
+		case 0b0001:	// EORS
+			result = a ^ b;
+			break;
+		case 0b0010:	// LSLS (register)
+		case 0b0011:	// LSRS (register)
+		case 0b0100:	// ASRS (register)
+		case 0b0111:	// RORS
+			{
+				uint8_t type = (op >> 6) & 0xF;
+				ShiftType shift = type == 0b0010 ? LSL : (type == 0b0011 ? LSR : (type == 0b0100 ? ASR : ROR));
+				ResultCarry rc = shift_C(a, shift, b & 0xFF, s.C);
+				result = rc.result;
+				r.carry = rc.carry;
+			}
+			break;
+		case 0b0101:	// ADCS
+			r = addWithCarry(a, b, s.C);
+			arithmetic = true;
+			break;
+		case 0b0110:	// SBCS
+			r = addWithCarry(a, ~b, s.C);
+			arithmetic = true;
+			break;
+		case 0b1000:	// TST
+			result = a & b;
+			writeResult = false;
+			break;
+		case 0b1001:	// RSBS; Rn is in bits 5:3
+			r = addWithCarry(~b, 0, 1);
+			arithmetic = true;
+			break;
+		case 0b1010:	// CMP (register)
+			r = addWithCarry(a, ~b, 1);
+			arithmetic = true;
+			writeResult = false;
+			break;
+		case 0b1011:	// CMN (register)
+			r = addWithCarry(a, b, 0);
+			arithmetic = true;
+			writeResult = false;
+			break;
+		case 0b1100:	// ORRS
+			result = a | b;
+			break;
+		case 0b1101:	// MULS; C and V are unchanged
+			result = a * b;
+			break;
+		case 0b1110:	// BICS
+			result = a & ~b;
+			break;
+		case 0b1111:	// MVNS
+			result = ~b;
+			break;
+	}
+
+	if (arithmetic) {
+		result = r.result;
+		s.V = r.overflow;
+	}
+	s.C = r.carry;
+	s.N = result >> 31;
+	s.Z = result == 0;
+	if (writeResult)
+		s.R[Rdn] = result;
+	s.R[15] += 2;
+	return executed;
+}
+
+ARMv6_Reference::Outcome ARMv6_Reference::specialDataBranch(State &s, uint16_t op) {
+	uint8_t Rm = (op >> 3) & 0xF;
+	uint8_t Rdn = (op & 0b111) | ((op >> 4) & 0b1000);
+	uint32_t pc = s.R[15];
+	// Reading PC gives the address of the instruction plus 4
+	auto readReg = [&s, pc](uint8_t n) {
+		return n == 15 ? pc + 4 : s.R[n];
+	};
+
+	switch ((op >> 8) & 0b11) {
+		case 0b00:		// ADD (register) T2
+			{
+				if (Rdn == 15 and Rm == 15)
+					return unpredictable;
+				uint32_t result = readReg(Rdn) + readReg(Rm);
+				if (Rdn == 15) {
+					s.R[15] = result & ~1u;
+					return executed;
+				}
+				s.R[Rdn] = result;
+			}
+			break;
+		case 0b01:		// CMP (register) T2
+			{
+				if ((Rdn < 8 and Rm < 8) or Rdn == 15 or Rm == 15)
+					return unpredictable;
+				ResultCarryOverflow r = addWithCarry(s.R[Rdn], ~s.R[Rm], 1);
+				s.N = r.result >> 31;
+				s.Z = r.result == 0;
+				s.C = r.carry;
+				s.V = r.overflow;
+			}
+			break;
+		case 0b10:		// MOV (register) T1
+			if (Rdn == 15) {
+				s.R[15] = readReg(Rm) & ~1u;
+				return executed;
+			}
+			s.R[Rdn] = readReg(Rm);
+			break;
+		case 0b11:		// BX, BLX
+			{
+				if ((op & 0b111) != 0 or Rm == 15)
+					return unpredictable;
+				uint32_t target = s.R[Rm];
+				// Clearing the Thumb bit raises HardFault
+				if ((target & 1) == 0)
+					return fault;
+				if ((op >> 7) & 1)
+					s.R[14] = (pc + 2) | 1;
+				s.R[15] = target & ~1u;
+				return executed;
+			}
+	}
+	s.R[15] += 2;
+	return executed;
+}
+
+ARMv6_Reference::Outcome ARMv6_Reference::loadStore(State &s, uint16_t op, vector<MemWrite> &writes) {
+	uint8_t Rt = op & 0b111;
+	uint8_t Rn = (op >> 3) & 0b111;
+	uint32_t addr;
+	int size;
+	bool load;
+	bool signedLoad = false;
+
+	if ((op >> 12) == 0b0101) {
+		// Register offset
+		addr = s.R[Rn] + s.R[(op >> 6) & 0b111];
+		switch ((op >> 9) & 0b111) {
+			case 0b000: size = 4; load = false; break;						// STR
+			case 0b001: size = 2; load = false; break;						// STRH
+			case 0b010: size = 1; load = false; break;						// STRB
+			case 0b011: size = 1; load = true; signedLoad = true; break;	// LDRSB
+			case 0b100: size = 4; load = true; break;						// LDR
+			case 0b101: size = 2; load = true; break;						// LDRH
+			case 0b110: size = 1; load = true; break;						// LDRB
+			default:    size = 2; load = true; signedLoad = true; break;	// LDRSH
+		}
+	}
+	else {
+		uint32_t imm5 = (op >> 6) & 0b11111;
+		load = (op >> 11) & 1;
+		switch (op >> 12) {
+			case 0b0110:	// STR, LDR (immediate)
+				size = 4;
+				addr = s.R[Rn] + imm5 * 4;
+				break;
+			case 0b0111:	// STRB, LDRB (immediate)
+				size = 1;
+				addr = s.R[Rn] + imm5;
+				break;
+			case 0b1000:	// STRH, LDRH (immediate)
+				size = 2;
+				addr = s.R[Rn] + imm5 * 2;
+				break;
+			default:		// STR, LDR (SP relative)
+				size = 4;
+				Rt = (op >> 8) & 0b111;
+				addr = s.R[13] + (op & 0xFF) * 4;
+				break;
+		}
+	}
+
+	if (!accessible(addr, size))
+		return fault;
+	if (load) {
+		uint32_t data = read(addr, size);
+		if (signedLoad)
+			data = signExtend(data, size * 8);
+		s.R[Rt] = data;
+	}
+	else {
+		uint32_t mask = size == 4 ? 0xFFFFFFFF : (1u << (size*8)) - 1;
+		writes.push_back({addr, size, s.R[Rt] & mask});
+	}
+	s.R[15] += 2;
+	return executed;
+}
+
+ARMv6_Reference::Outcome ARMv6_Reference::misc(State &s, uint16_t op, vector<MemWrite> &writes) {
+	uint8_t Rd = op & 0b111;
+	uint8_t Rm = (op >> 3) & 0b111;
+
+	switch ((op >> 5) & 0b1111111) {
+		case 0b0000000 ... 0b0000011:	// ADD (SP plus immediate) T2
+			s.R[13] += (op & 0x7F) * 4;
+			break;
+		case 0b0000100 ... 0b0000111:	// SUB (SP minus immediate)
+			s.R[13] -= (op & 0x7F) * 4;
+			break;
+		case 0b0010000 ... 0b0010111:	// SXTH, SXTB, UXTH, UXTB
+			switch ((op >> 6) & 0b11) {
+				case 0b00: s.R[Rd] = signExtend(s.R[Rm] & 0xFFFF, 16); break;
+				case 0b01: s.R[Rd] = signExtend(s.R[Rm] & 0xFF, 8); break;
+				case 0b10: s.R[Rd] = s.R[Rm] & 0xFFFF; break;
+				case 0b11: s.R[Rd] = s.R[Rm] & 0xFF; break;
+			}
+			break;
+		case 0b0100000 ... 0b0101111:	// PUSH
+			{
+				uint32_t regs = (op & 0xFF) | (((op >> 8) & 1) << 14);
+				if (bitCount(regs) < 1)
+					return unpredictable;
+				uint32_t addr = s.R[13] - 4 * bitCount(regs);
+				if (!accessible(addr, 4) or !accessible(addr + 4*(bitCount(regs)-1), 4))
+					return fault;
+				for (int i=0; i<15; i++) {
+					if ((regs >> i) & 1) {
+						writes.push_back({addr, 4, s.R[i]});
+						addr += 4;
+					}
+				}
+				s.R[13] -= 4 * bitCount(regs);
+			}
+			break;
+		case 0b0110011:					// CPS
+			return unmodelled;
+		case 0b1010000 ... 0b1010001:	// REV
+			{
+				uint32_t v = s.R[Rm];
+				s.R[Rd] = (v >> 24) | ((v >> 8) & 0xFF00) | ((v << 8) & 0xFF0000) | (v << 24);
+			}
+			break;
+		case 0b1010010 ... 0b1010011:	// REV16
+			{
+				uint32_t v = s.R[Rm];
+				s.R[Rd] = ((v >> 8) & 0x00FF00FF) | ((v << 8) & 0xFF00FF00);
+			}
+			break;
+		case 0b1010110 ... 0b1010111:	// REVSH
+			{
+				uint32_t v = s.R[Rm];
+				s.R[Rd] = signExtend(((v & 0xFF) << 8) | ((v >> 8) & 0xFF), 16);
+			}
+			break;
+		case 0b1100000 ... 0b1101111:	// POP
+			{
+				uint32_t regs = (op & 0xFF) | (((op >> 8) & 1) << 15);
+				if (bitCount(regs) < 1)
+					return unpredictable;
+				uint32_t addr = s.R[13];
+				if (!accessible(addr, 4) or !accessible(addr + 4*(bitCount(regs)-1), 4))
+					return fault;
+				uint32_t pc = s.R[15] + 2;
+				for (int i=0; i<16; i++) {
+					if ((regs >> i) & 1) {
+						uint32_t data = read(addr, 4);
+						if (i == 15) {
+							if ((data & 1) == 0)
+								return fault;
+							pc = data & ~1u;
+						}
+						else {
+							s.R[i] = data;
+						}
+						addr += 4;
+					}
+				}
+				s.R[13] += 4 * bitCount(regs);
+				s.R[15] = pc;
+				return executed;
+			}
+		case 0b1110000 ... 0b1110111:	// BKPT
+			return unmodelled;
+		case 0b1111000 ... 0b1111111:	// Hints
+			if ((op & 0xF) != 0)
+				return undefined;
+			// NOP, YIELD, WFE, WFI, SEV have no effect on compared state
+			break;
+		default:
+			return undefined;
+	}
+	s.R[15] += 2;
+	return executed;
+}
+
+ARMv6_Reference::Outcome ARMv6_Reference::loadStoreMultiple(State &s, uint16_t op, vector<MemWrite> &writes) {
+	uint8_t Rn = (op >> 8) & 0b111;
+	uint32_t regs = op & 0xFF;
+	bool load = (op >> 11) & 1;
+	if (bitCount(regs) < 1)
+		return unpredictable;
+
+	uint32_t addr = s.R[Rn];
+	if (!accessible(addr, 4) or !accessible(addr + 4*(bitCount(regs)-1), 4))
+		return fault;
+
+	if (load) {
+		for (int i=0; i<8; i++) {
+			if ((regs >> i) & 1) {
+				s.R[i] = read(addr, 4);
+				addr += 4;
+			}
+		}
+		// Base is written back only when not in the list
+		if (((regs >> Rn) & 1) == 0)
+			s.R[Rn] = addr;
+	}
+	else {
+		// Storing a written back base that is not the lowest register is UNPREDICTABLE
+		if (((regs >> Rn) & 1) and (regs & ((1u << Rn) - 1)))
+			return unpredictable;
+		for (int i=0; i<8; i++) {
+			if ((regs >> i) & 1) {
+				writes.push_back({addr, 4, s.R[i]});
+				addr += 4;
+			}
+		}
+		s.R[Rn] = addr;
+	}
+	s.R[15] += 2;
+	return executed;
+}
+
+ARMv6_Reference::Outcome ARMv6_Reference::branch(State &s, uint16_t op) {
+	if ((op >> 11) == 0b11100) {
+		// B T2
+		s.R[15] = s.R[15] + 4 + signExtend((op & 0x7FF) << 1, 12);
+		return executed;
+	}
+
+	uint8_t cond = (op >> 8) & 0xF;
+	if (cond == 0b1110)
+		return undefined;		// UDF
+	if (cond == 0b1111)
+		return unmodelled;		// SVC
+
+	// A6.3 condition codes
+	bool passed;
+	switch (cond >> 1) {
+		case 0b000: passed = s.Z; break;
+		case 0b001: passed = s.C; break;
+		case 0b010: passed = s.N; break;
+		case 0b011: passed = s.V; break;
+		case 0b100: passed = s.C and !s.Z; break;
+		case 0b101: passed = s.N == s.V; break;
+		default:    passed = s.N == s.V and !s.Z; break;
+	}
+	if (cond & 1)
+		passed = !passed;
+
+	if (passed)
+		s.R[15] = s.R[15] + 4 + signExtend((op & 0xFF) << 1, 9);
+	else
+		s.R[15] += 2;
+	return executed;
+}
+
+const char* ARMv6_Reference::mnemonic(uint16_t op) {
+	if ((op >> 11) >= 0b11101)
+		return "32-bit";
+	switch (op >> 11) {
+		case 0b00000: return ((op >> 6) & 0b11111) ? "LSLS(imm)" : "MOVS(reg)";
+		case 0b00001: return "LSRS(imm)";
+		case 0b00010: return "ASRS(imm)";
+		case 0b00011:
+			switch ((op >> 9) & 0b11) {
+				case 0b00: return "ADDS(reg)";
+				case 0b01: return "SUBS(reg)";
+				case 0b10: return "ADDS(imm3)";
+				default:   return "SUBS(imm3)";
+			}
+		case 0b00100: return "MOVS(imm)";
+		case 0b00101: return "CMP(imm)";
+		case 0b00110: return "ADDS(imm8)";
+		case 0b00111: return "SUBS(imm8)";
+		case 0b01001: return "LDR(lit)";
+		case 0b01100: return "STR(imm)";
+		case 0b01101: return "LDR(imm)";
+		case 0b01110: return "STRB(imm)";
+		case 0b01111: return "LDRB(imm)";
+		case 0b10000: return "STRH(imm)";
+		case 0b10001: return "LDRH(imm)";
+		case 0b10010: return "STR(sp)";
+		case 0b10011: return "LDR(sp)";
+		case 0b10100: return "ADR";
+		case 0b10101: return "ADD(sp,imm)";
+		case 0b11000: return "STM";
+		case 0b11001: return "LDM";
+		case 0b11100: return "B";
+	}
+	if ((op >> 10) == 0b010000) {
+		const char* names[16] = {
+			"ANDS", "EORS", "LSLS(reg)", "LSRS(reg)", "ASRS(reg)", "ADCS", "SBCS", "RORS",
+			"TST", "RSBS", "CMP(reg)", "CMN", "ORRS", "MULS", "BICS", "MVNS"
+		};
+		return names[(op >> 6) & 0xF];
+	}
+	if ((op >> 10) == 0b010001) {
+		switch ((op >> 8) & 0b11) {
+			case 0b00: return "ADD(hi)";
+			case 0b01: return "CMP(hi)";
+			case 0b10: return "MOV(hi)";
+			default:   return (op >> 7) & 1 ? "BLX" : "BX";
+		}
+	}
+	if ((op >> 12) == 0b0101) {
+		const char* names[8] = {"STR(reg)", "STRH(reg)", "STRB(reg)", "LDRSB", "LDR(reg)", "LDRH(reg)", "LDRB(reg)", "LDRSH"};
+		return names[(op >> 9) & 0b111];
+	}
+	if ((op >> 12) == 0b1101) {
+		uint8_t cond = (op >> 8) & 0xF;
+		return cond == 0b1110 ? "UDF" : (cond == 0b1111 ? "SVC" : "B<cond>");
+	}
+	// Miscellaneous 16-bit instructions
+	switch ((op >> 5) & 0b1111111) {
+		case 0b0000000 ... 0b0000011: return "ADD(sp)";
+		case 0b0000100 ... 0b0000111: return "SUB(sp)";
+		case 0b0010000 ... 0b0010111:
+			{
+				const char* names[4] = {"SXTH", "SXTB", "UXTH", "UXTB"};
+				return names[(op >> 6) & 0b11];
+			}
+		case 0b0100000 ... 0b0101111: return "PUSH";
+		case 0b0110011: return "CPS";
+		case 0b1010000 ... 0b1010001: return "REV";
+		case 0b1010010 ... 0b1010011: return "REV16";
+		case 0b1010110 ... 0b1010111: return "REVSH";
+		case 0b1100000 ... 0b1101111: return "POP";
+		case 0b1110000 ... 0b1110111: return "BKPT";
+		case 0b1111000 ... 0b1111111: return "HINT";
+	}
+	return "UNDEFINED";
+}
@@ -0,0 +1,62 @@
+#ifndef ARMV6_REFERENCE_H
+#define ARMV6_REFERENCE_H
+#include <cstdint>
+#include <functional>
+#include <vector>
+using namespace std;
+
+// Reference model of the 16-bit ARMv6-M Thumb instructions, written from the pseudocode
+// in the ARMv6-M Architecture Reference Manual and kept independent of CM0P_Core.
+// Memory is accessed through caller supplied functions.
+class ARMv6_Reference {
+	public:
+		struct State {
+			uint32_t R[16];		// R15 holds the address of the instruction being executed
+			bool N, Z, C, V;
+		};
+
+		struct MemWrite {
+			uint32_t addr;
+			int size;			// In bytes
+			uint32_t value;
+		};
+
+		enum Outcome {
+			executed,			// State was updated and can be compared
+			unpredictable,		// Architecturally UNPREDICTABLE encoding
+			undefined,			// UNDEFINED encoding
+			fault,				// Would raise HardFault (unaligned access, interworking)
+			unmodelled			// 32-bit instructions, exceptions, system state
+		};
+
+		// Read size bytes at address; only called for aligned addresses within memory
+		typedef function<uint32_t(uint32_t addr, int size)> ReadFn;
+
+	private:
+		uint32_t memSize;
+		ReadFn read;
+
+		// A5.2 decoding groups
+		Outcome shiftAddSubMovCmp(State &s, uint16_t op);
+		Outcome dataProcessing(State &s, uint16_t op);
+		Outcome specialDataBranch(State &s, uint16_t op);
+		Outcome loadStore(State &s, uint16_t op, vector<MemWrite> &writes);
+		Outcome misc(State &s, uint16_t op, vector<MemWrite> &writes);
+		Outcome loadStoreMultiple(State &s, uint16_t op, vector<MemWrite> &writes);
+		Outcome branch(State &s, uint16_t op);
+
+		// Checks alignment and range of an access
+		bool accessible(uint32_t addr, int size);
+
+	public:
+		ARMv6_Reference(uint32_t memSize, ReadFn read);
+
+		// Execute one instruction; memory writes are returned instead of performed.
+		// State is only meaningful when the outcome is executed.
+		Outcome step(State &s, uint16_t opcode, vector<MemWrite> &writes);
+
+		// Name of the instruction an opcode encodes
+		static const char* mnemonic(uint16_t opcode);
+};
+
+#endif
@@ -0,0 +1,660 @@
+#include "cortex-m0p_aot.h"
+#include "cortex-m0p_blockcache.h"
+#include <cstdio>
+#include <cstdlib>
+#include <dlfcn.h>			// For dlopen(), dlsym()
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <sys/stat.h>		// For stat(), mkdir()
+#include <unistd.h>			// For getpid()
+
+CM0P_AOT::~CM0P_AOT() {
+	unload();
+}
+
+void CM0P_AOT::unload() {
+	if (handle != nullptr)
+		dlclose(handle);
+	handle = nullptr;
+	lookupFn = nullptr;
+}
+
+// Stores write guest memory and may rewrite code
+static bool isStore(uint16_t opcode) {
+	// STR, STRH, STRB (register)
+	if ((opcode >> 9) >= 0b0101000 and (opcode >> 9) <= 0b0101010)
+		return true;
+	switch (opcode >> 11) {
+		case 0b01100:	// STR (immediate)
+		case 0b01110:	// STRB (immediate)
+		case 0b10000:	// STRH (immediate)
+		case 0b10010:	// STR (SP relative)
+		case 0b11000:	// STM
+			return true;
+	}
+	return false;
+}
+
+static string hexStr(uint32_t value, int width) {
+	char buf[16];
+	snprintf(buf, sizeof(buf), "%0*x", width, value);
+	return buf;
+}
+
+// Register name in generated code
+static string reg(int n) {
+	return "R[" + to_string(n) + "]";
+}
+
+static string hexConst(uint32_t value) {
+	return "0x" + hexStr(value, 8) + "u";
+}
+
+// Condition of B<cond> over the flags, as the interpreter tests it
+static string condExpr(uint8_t cond) {
+	switch (cond) {
+		case 0b0000: return "Z";
+		case 0b0001: return "!Z";
+		case 0b0010: return "C";
+		case 0b0011: return "!C";
+		case 0b0100: return "N";
+		case 0b0101: return "!N";
+		case 0b0110: return "V";
+		case 0b0111: return "!V";
+		case 0b1000: return "C && !Z";
+		case 0b1001: return "!C && Z";
+		case 0b1010: return "N == V";
+		case 0b1011: return "N != V";
+		case 0b1100: return "!Z && N == V";
+		case 0b1101: return "Z || N != V";
+	}
+	return "0";
+}
+
+// Emit the body of one instruction with its fields decoded. Follows exec_inst()
+// statement by statement, including the order registers are read and written, so both
+// give the same results; shift amounts that may reach 32 are masked as the host does
+// for the interpreter. Returns True if the body sets R[15]; otherwise the instruction
+// falls through to the next address.
+static bool emitInst(ostream &src, uint32_t addr, uint16_t opcode) {
+	int r0 = opcode & 0b111;
+	int r3 = (opcode >> 3) & 0b111;
+	int r6 = (opcode >> 6) & 0b111;
+	int r8 = (opcode >> 8) & 0b111;
+	uint32_t imm5 = (opcode >> 6) & 0b11111;
+	uint32_t imm8 = opcode & 0xFF;
+	uint32_t next = addr + 2;
+
+	// Register load and store forms share their address and data
+	auto load = [&](int width, string address, int Rt) {
+		src << "\t" << reg(Rt) << " = c->read" << width << "(c->core, " << address << ");\n";
+	};
+	auto loadSigned = [&](int width, string address, int Rt) {
+		uint32_t sign = width == 8 ? 0x80 : 0x8000;
+		src << "\t{\n";
+		src << "\t\tuint32_t data = c->read" << width << "(c->core, " << address << ");\n";
+		src << "\t\tif (data & " << hexConst(sign) << ")\n";
+		src << "\t\t\tdata |= " << hexConst(~(sign * 2 - 1)) << ";\n";
+		src << "\t\t" << reg(Rt) << " = data;\n";
+		src << "\t}\n";
+	};
+	auto store = [&](int width, string address, int Rt) {
+		src << "\tR[15] = " << hexConst(addr) << ";\n";
+		src << "\tc->write" << width << "(c->core, " << address << ", " << reg(Rt) << ");\n";
+	};
+	auto setNZ = [&](string value) {
+		src << "\tsetNZ(c, " << value << ");\n";
+	};
+
+	switch (opcode >> 10) {
+		case 0b000000 ... 0b001111:
+			switch (opcode >> 11) {
+				// LSLS (immediate)
+				case 0b000:
+					src << "\t" << reg(r0) << " = " << reg(r3) << " << " << imm5 << ";\n";
+					if (imm5 != 0)
+						src << "\tsetFlag(c, FLAG_C, (" << reg(r3) << " >> " << 32 - imm5 << ") & 1);\n";
+					setNZ(reg(r0));
+					break;
+				// LSRS (immediate)
+				case 0b001:
+					src << "\t" << reg(r0) << " = " << reg(r3) << " >> " << imm5 << ";\n";
+					if (imm5 != 0)
+						src << "\tsetFlag(c, FLAG_C, (" << reg(r3) << " >> " << imm5 - 1 << ") & 1);\n";
+					setNZ(reg(r0));
+					break;
+				// ASRS (immediate); sign taken from Rd before it is written
+				case 0b010:
+					src << "\t{\n";
+					src << "\t\tint msb = " << reg(r0) << " >> 31;\n";
+					src << "\t\t" << reg(r0) << " = " << reg(r3) << " >> " << imm5 << ";\n";
+					if (imm5 != 0) {
+						src << "\t\tif (msb)\n";
+						src << "\t\t\t" << reg(r0) << " |= " << hexConst(((1u << imm5) - 1) << (32 - imm5)) << ";\n";
+					}
+					src << "\t}\n";
+					if (imm5 != 0)
+						src << "\tsetFlag(c, FLAG_C, (" << reg(r3) << " >> " << imm5 - 1 << ") & 1);\n";
+					setNZ(reg(r0));
+					break;
+				// MOVS (immediate)
+				case 0b100:
+					src << "\t" << reg(r8) << " = " << imm8 << ";\n";
+					setNZ(reg(r8));
+					break;
+				// CMP (immediate)
+				case 0b101:
+					src << "\tsubFlags(c, " << reg(r8) << ", " << imm8 << ");\n";
+					break;
+				// ADDS, SUBS (8-bit immediate)
+				case 0b110:
+				case 0b111:
+					src << "\t" << reg(r8) << " = " << ((opcode >> 11) == 0b110 ? "addFlags" : "subFlags")
+						<< "(c, " << reg(r8) << ", " << imm8 << ");\n";
+					break;
+				// ADDS, SUBS (register and 3-bit immediate)
+				case 0b011:
+					{
+						bool sub = (opcode >> 9) & 1;
+						bool imm = (opcode >> 10) & 1;
+						src << "\t" << reg(r0) << " = " << (sub ? "subFlags" : "addFlags") << "(c, " << reg(r3)
+							<< ", " << (imm ? to_string(r6) : reg(r6)) << ");\n";
+					}
+					break;
+			}
+			break;
+
+		// Data processing
+		case 0b010000:
+			switch ((opcode >> 6) & 0xF) {
+				// ANDS, EORS, ORRS, BICS
+				case 0b0000:
+				case 0b0001:
+				case 0b1100:
+				case 0b1110:
+					{
+						uint8_t op = (opcode >> 6) & 0xF;
+						const char* assign = op == 0b0000 ? " &= " : op == 0b0001 ? " ^= " : op == 0b1100 ? " |= " : " &= ~";
+						src << "\t" << reg(r0) << assign << reg(r3) << ";\n";
+						setNZ(reg(r0));
+					}
+					break;
+				// LSLS (register)
+				case 0b0010:
+					src << "\t{\n";
+					src << "\t\tuint32_t n = " << reg(r3) << " & 0xFF;\n";
+					src << "\t\tuint32_t result = n >= 32 ? 0 : " << reg(r0) << " << n;\n";
+					src << "\t\tsetNZ(c, result);\n";
+					src << "\t\tif (n != 0)\n";
+					src << "\t\t\tsetFlag(c, FLAG_C, n >= 33 ? 0 : (" << reg(r0) << " >> ((32 - " << reg(r3) << ") & 31)) & 1);\n";
+					src << "\t\t" << reg(r0) << " = result;\n";
+					src << "\t}\n";
+					break;
+				// LSRS, ASRS (register)
+				case 0b0011:
+				case 0b0100:
+					src << "\t{\n";
+					src << "\t\tuint32_t n = " << reg(r3) << " & 0xFF;\n";
+					src << "\t\tuint32_t result = " << reg(r0) << " >> (n & 31);\n";
+					if (((opcode >> 6) & 0xF) == 0b0100) {
+						src << "\t\tif (" << reg(r0) << " >> 31)\n";
+						src << "\t\t\tresult |= ((1u << (n & 31)) - 1) << ((32 - n) & 31);\n";
+					}
+					src << "\t\tif (n >= 32)\n";
+					src << "\t\t\tresult = 0;\n";
+					src << "\t\tsetNZ(c, result);\n";
+					src << "\t\tif (n != 0)\n";
+					src << "\t\t\tsetFlag(c, FLAG_C, n >= 33 ? 0 : (" << reg(r0) << " >> ((n - 1) & 31)) & 1);\n";
+					src << "\t\t" << reg(r0) << " = result;\n";
+					src << "\t}\n";
+					break;
+				// ADCS, SBCS
+				case 0b0101:
+				case 0b0110:
+					src << "\t" << reg(r0) << " = " << (((opcode >> 6) & 0xF) == 0b0101 ? "addFlags" : "subFlags")
+						<< "(c, " << reg(r0) << ", " << reg(r3) << " + C);\n";
+					break;
+				// RORS; carry is taken from Rm after the result is written
+				case 0b0111:
+					src << "\t{\n";
+					src << "\t\tuint32_t n = " << reg(r3) << " & 0xFF;\n";
+					src << "\t\t" << reg(r0) << " = (" << reg(r0) << " >> (n & 31)) | (" << reg(r0) << " << ((32 - n) & 31));\n";
+					src << "\t\tif (n != 0)\n";
+					src << "\t\t\tsetFlag(c, FLAG_C, (" << reg(r3) << " >> ((n - 1) & 31)) & 1);\n";
+					src << "\t}\n";
+					setNZ(reg(r0));
+					break;
+				// TST
+				case 0b1000:
+					setNZ(reg(r3) + " & " + reg(r0));
+					break;
+				// RSBS; only the flags are kept
+				case 0b1001:
+					src << "\tsubFlags(c, 0, " << reg(r3) << ");\n";
+					break;
+				// CMP, CMN (register)
+				case 0b1010:
+				case 0b1011:
+					src << "\t" << (((opcode >> 6) & 0xF) == 0b1010 ? "subFlags" : "addFlags")
+						<< "(c, " << reg(r0) << ", " << reg(r3) << ");\n";
+					break;
+				// MULS
+				case 0b1101:
+					src << "\t" << reg(r0) << " *= " << reg(r3) << ";\n";
+					setNZ(reg(r0));
+					break;
+				// MVNS
+				case 0b1111:
+					src << "\t" << reg(r0) << " = ~" << reg(r3) << ";\n";
+					setNZ(reg(r0));
+					break;
+			}
+			break;
+
+		// Special data instructions and branch and exchange
+		case 0b010001:
+			switch ((opcode >> 8) & 0b11) {
+				// MOV (register)
+				case 0b10:
+					{
+						int Rm = ((opcode >> 3) & 0xF) | ((opcode >> 4) & 0b1000);
+						if (Rm == 15) {
+							src << "\tR[15] = " << hexConst((addr & ~2u) + 2) << ";\n";
+							return true;
+						}
+						src << "\t" << reg(r0) << " = " << reg(Rm) << ";\n";
+					}
+					break;
+				// BLX; BX does not branch
+				case 0b11:
+					if ((opcode >> 7) & 1) {
+						int Rm = (opcode >> 3) & 0xF;
+						src << "\tR[14] = " << hexConst(addr - 2) << ";\n";
+						if (Rm == 15)
+							src << "\tR[15] = " << hexConst(addr + 2) << ";\n";
+						else
+							src << "\tR[15] = " << reg(Rm) << " + 2;\n";
+						return true;
+					}
+					break;
+			}
+			break;
+
+		// Single data item loads and stores; immediate offsets are not scaled
+		case 0b010100 ... 0b100111:
+			{
+				string regOffset = reg(r6) + " + " + reg(r3);
+				string immOffset = to_string(imm5) + " + " + reg(r3);
+				string spOffset = to_string(imm8) + " + R[13]";
+				bool isLoad = (opcode >> 11) & 1;
+				switch (opcode >> 12) {
+					case 0b0101:
+						switch ((opcode >> 9) & 0b111) {
+							case 0b000: store(32, regOffset, r0); break;
+							case 0b001: store(16, regOffset, r0); break;
+							case 0b010: store(8, regOffset, r0); break;
+							case 0b011: loadSigned(8, regOffset, r0); break;
+							case 0b100: load(32, regOffset, r0); break;
+							case 0b101: load(16, regOffset, r0); break;
+							case 0b110: load(8, regOffset, r0); break;
+							case 0b111: loadSigned(16, regOffset, r0); break;
+						}
+						break;
+					case 0b0110:
+						isLoad ? load(32, immOffset, r0) : store(32, immOffset, r0);
+						break;
+					case 0b0111:
+						isLoad ? load(8, immOffset, r0) : store(8, immOffset, r0);
+						break;
+					case 0b1000:
+						isLoad ? load(16, immOffset, r0) : store(16, immOffset, r0);
+						break;
+					case 0b1001:
+						isLoad ? load(32, spOffset, r8) : store(32, spOffset, r8);
+						break;
+				}
+			}
+			break;
+
+		// ADR; the offset is not scaled
+		case 0b101000 ... 0b101001:
+			src << "\t" << reg(r8) << " = " << hexConst(addr + imm8) << ";\n";
+			break;
+
+		// ADD (SP plus immediate)
+		case 0b101010 ... 0b101011:
+			src << "\t" << reg(r8) << " = R[13] + " << imm8 << ";\n";
+			break;
+
+		// Miscellaneous; PUSH, POP, CPS, BKPT and hints do nothing
+		case 0b101100 ... 0b101111:
+			switch ((opcode >> 6) & 0b111111) {
+				case 0b000000 ... 0b000001:
+					src << "\tR[13] += " << (opcode & 0b1111111) << ";\n";
+					break;
+				case 0b000010 ... 0b000011:
+					src << "\tR[13] -= " << (opcode & 0b1111111) << ";\n";
+					break;
+				// SXTH, SXTB read memory at Rm like the interpreter
+				case 0b001000:
+					loadSigned(16, reg(r3), r0);
+					break;
+				case 0b001001:
+					loadSigned(8, reg(r3), r0);
+					break;
+				case 0b001010:
+					src << "\t" << reg(r0) << " = " << reg(r3) << " & 0xFFFF;\n";
+					break;
+				// UXTB takes the low byte of the opcode
+				case 0b001011:
+					src << "\t" << reg(r0) << " = " << (opcode & 0xFF) << ";\n";
+					break;
+				// REV
+				case 0b101000:
+					src << "\t" << reg(r0) << " = __builtin_bswap32(" << reg(r3) << ");\n";
+					break;
+				// REV16
+				case 0b101001:
+					src << "\t" << reg(r0) << " = ((" << reg(r3) << " >> 8) & 0x00FF00FF) | ((" << reg(r3) << " & 0x00FF00FF) << 8);\n";
+					break;
+				// REVSH
+				case 0b101011:
+					src << "\t" << reg(r0) << " = ((" << reg(r3) << " & 0xFF) << 8) | ((" << reg(r3) << " >> 8) & 0xFF);\n";
+					src << "\tif (" << reg(r0) << " & 0x8000)\n";
+					src << "\t\t" << reg(r0) << " |= 0xFFFF0000u;\n";
+					break;
+			}
+			break;
+
+		// STM, LDM; the address wraps at 8 bits and register i of the list is R[8-i]
+		case 0b110000 ... 0b110011:
+			{
+				bool isLoad = (opcode >> 11) & 1;
+				src << "\t{\n";
+				src << "\t\tuint8_t address = " << reg(r8) << ";\n";
+				if (!isLoad)
+					src << "\t\tR[15] = " << hexConst(addr) << ";\n";
+				for (int i=7; i>-1; i--) {
+					if (!((imm8 >> i) & 1))
+						continue;
+					if (isLoad)
+						src << "\t\t" << reg(8-i) << " = c->read32(c->core, address);\n";
+					else
+						src << "\t\tc->write32(c->core, address, " << reg(8-i) << ");\n";
+					src << "\t\taddress += 4;\n";
+				}
+				src << "\t\t" << reg(r8) << " = address;\n";
+				src << "\t}\n";
+			}
+			break;
+
+		// B<cond>; AL branches with a T2 offset and 0b1111 never branches
+		case 0b110100 ... 0b110111:
+			{
+				uint8_t cond = (opcode >> 8) & 0xF;
+				if (cond == 0b1110)
+					src << "\tR[15] = " << hexConst(addr + (opcode & 0x7FF) * 2 - 2048) << ";\n";
+				else
+					src << "\tR[15] = (" << condExpr(cond) << ") ? " << hexConst(addr + imm8 * 2 - 256)
+						<< " : " << hexConst(next) << ";\n";
+			}
+			return true;
+
+		// B
+		case 0b111000 ... 0b111001:
+			src << "\tR[15] = " << hexConst(addr + (opcode & 0x7FF) * 2 - 2048) << ";\n";
+			return true;
+	}
+	return false;
+}
+
+string CM0P_AOT::generate(const ARMv6_Program &program, uint32_t baseAddr) {
+	struct Inst {
+		uint32_t addr;
+		uint16_t opcode;
+		bool translatable;
+		string text;
+	};
+
+	// Lay out instructions the same way CM0P_Core loads them
+	vector<Inst> insts;
+	map<uint32_t, size_t> instAt;
+	uint32_t addr = baseAddr;
+	for (size_t i=0; i<program.size(); i++) {
+		ARMv6_Program::Instruction it = program.at(i);
+		Inst inst;
+		inst.addr = addr;
+		inst.text = it.text;
+		if (it.i32) {
+			inst.opcode = it.opcode >> 16;
+			inst.translatable = false;
+			addr += 2;
+		}
+		else {
+			inst.opcode = it.opcode;
+			inst.translatable = !CM0P_BlockCache::isUntranslatable(inst.opcode);
+		}
+		instAt[inst.addr] = insts.size();
+		insts.push_back(inst);
+		addr += 2;
+	}
+
+	// Statically known successors of a block ending instruction; empty if indirect
+	auto successors = [](uint32_t addr, uint16_t opcode) {
+		vector<uint32_t> out;
+		// Conditional branch; targets follow the interpreter's offset handling
+		if ((opcode >> 12) == 0b1101) {
+			uint8_t cond = (opcode >> 8) & 0xF;
+			if (cond < 0b1110)
+				out.push_back(addr + (opcode & 0xFF) * 2 - 256);
+			else if (cond == 0b1110)
+				out.push_back(addr + (opcode & 0x7FF) * 2 - 2048);
+			out.push_back(addr + 2);
+		}
+		// Unconditional branch
+		else if ((opcode >> 11) == 0b11100) {
+			out.push_back(addr + (opcode & 0x7FF) * 2 - 2048);
+		}
+		return out;
+	};
+
+	// Find block leaders
+	set<uint32_t> leaders;
+	if (!insts.empty())
+		leaders.insert(insts.front().addr);
+	for (auto &it: insts) {
+		if (!it.translatable or CM0P_BlockCache::isBlockEnd(it.opcode))
+			leaders.insert(it.addr + 2);
+		if (it.translatable and CM0P_BlockCache::isBlockEnd(it.opcode)) {
+			for (auto &target: successors(it.addr, it.opcode)) {
+				leaders.insert(target);
+			}
+		}
+	}
+
+	// Cut blocks; each entry holds indexes into insts
+	map<uint32_t, vector<size_t>> blocks;
+	for (auto &leader: leaders) {
+		if (instAt.find(leader) == instAt.end())
+			continue;
+		vector<size_t> block;
+		for (size_t i=instAt[leader]; i<insts.size(); i++) {
+			if (!insts[i].translatable)
+				break;
+			if (!block.empty() and leaders.count(insts[i].addr))
+				break;
+			block.push_back(i);
+			if (CM0P_BlockCache::isBlockEnd(insts[i].opcode))
+				break;
+		}
+		if (!block.empty())
+			blocks[leader] = block;
+	}
+
+	auto blockName = [](uint32_t addr) {
+		return "blk_" + hexStr(addr, 8);
+	};
+
+	ostringstream src;
+	src << "// Generated by pico_emu AOT translator version " << AOT_VERSION << "; do not edit\n";
+	src << "#include <stdint.h>\n\n";
+	src << "struct AOT_Context {\n";
+	src << "\tuint32_t* R;\n";
+	src << "\tuint8_t* flags;\n";
+	src << "\tvoid* core;\n";
+	src << "\tuint32_t (*read8)(void* core, uint32_t addr);\n";
+	src << "\tuint32_t (*read16)(void* core, uint32_t addr);\n";
+	src << "\tuint32_t (*read32)(void* core, uint32_t addr);\n";
+	src << "\tvoid (*write8)(void* core, uint32_t addr, uint32_t data);\n";
+	src << "\tvoid (*write16)(void* core, uint32_t addr, uint32_t data);\n";
+	src << "\tvoid (*write32)(void* core, uint32_t addr, uint32_t data);\n";
+	src << "\tuint64_t executed;\n";
+	src << "\tuint64_t budget;\n";
+	src << "\tuint32_t abort;\n";
+	src << "};\n\n";
+
+	// Flag helpers use the same expressions as CM0P_Core::update_flag_addition() and
+	// update_flag_subtraction()
+	src << "enum { FLAG_V, FLAG_C, FLAG_Z, FLAG_N };\n";
+	src << "#define N ((*c->flags >> FLAG_N) & 1)\n";
+	src << "#define Z ((*c->flags >> FLAG_Z) & 1)\n";
+	src << "#define C ((*c->flags >> FLAG_C) & 1)\n";
+	src << "#define V ((*c->flags >> FLAG_V) & 1)\n\n";
+	src << "static inline void setFlag(AOT_Context* c, int n, uint32_t bit) {\n";
+	src << "\tif (bit)\n";
+	src << "\t\t*c->flags |= 1 << n;\n";
+	src << "\telse\n";
+	src << "\t\t*c->flags &= ~(1 << n);\n";
+	src << "}\n\n";
+	src << "static inline void setNZ(AOT_Context* c, uint32_t result) {\n";
+	src << "\tsetFlag(c, FLAG_N, result >> 31);\n";
+	src << "\tsetFlag(c, FLAG_Z, result == 0);\n";
+	src << "}\n\n";
+	src << "static inline uint32_t addFlags(AOT_Context* c, uint32_t a, uint32_t b) {\n";
+	src << "\tuint32_t result = a + b;\n";
+	src << "\tsetNZ(c, result);\n";
+	src << "\tsetFlag(c, FLAG_C, a + b > 0xFFFFFFFF);\n";
+	src << "\tsetFlag(c, FLAG_V, ((result >> 31) && ~(a >> 31) && ~(b >> 31)) || (~(result >> 31) && (a >> 31) && (b >> 31)));\n";
+	src << "\treturn result;\n";
+	src << "}\n\n";
+	src << "static inline uint32_t subFlags(AOT_Context* c, uint32_t a, uint32_t b) {\n";
+	src << "\tuint32_t result = a - b;\n";
+	src << "\tsetNZ(c, result);\n";
+	src << "\tsetFlag(c, FLAG_C, a >= b);\n";
+	src << "\tsetFlag(c, FLAG_V, ((result >> 31) && ~(a >> 31) && (b >> 31)) || (~(result >> 31) && (a >> 31) && ~(b >> 31)));\n";
+	src << "\treturn result;\n";
+	src << "}\n\n";
+
+	src << "static void* dispatch(uint32_t pc);\n";
+	for (auto &it: blocks) {
+		src << "static void* " << blockName(it.first) << "(AOT_Context* c);\n";
+	}
+	src << "\n";
+
+	for (auto &it: blocks) {
+		vector<size_t> &block = it.second;
+		src << "static void* " << blockName(it.first) << "(AOT_Context* c) {\n";
+		src << "\tif (c->executed + " << block.size() << " > c->budget)\n";
+		src << "\t\treturn 0;\n";
+		src << "\tuint32_t* R = c->R;\n";
+		bool setsPC = false;
+		for (size_t i=0; i<block.size(); i++) {
+			Inst &inst = insts[block[i]];
+			src << "\t// " << hexStr(inst.addr, 8) << "  " << inst.text << "\n";
+			setsPC = emitInst(src, inst.addr, inst.opcode);
+			// A store that hit a watchpoint or rewrote code ends the block after it
+			if (isStore(inst.opcode)) {
+				src << "\tif (c->abort) {\n";
+				src << "\t\tR[15] = " << hexConst(inst.addr + 2) << ";\n";
+				src << "\t\tc->executed += " << i + 1 << ";\n";
+				src << "\t\treturn 0;\n";
+				src << "\t}\n";
+			}
+		}
+		Inst &last = insts[block.back()];
+		if (!setsPC)
+			src << "\tR[15] = " << hexConst(last.addr + 2) << ";\n";
+		src << "\tc->executed += " << block.size() << ";\n";
+
+		// Link statically known successors directly
+		vector<uint32_t> next;
+		if (CM0P_BlockCache::isBlockEnd(last.opcode))
+			next = successors(last.addr, last.opcode);
+		else
+			next.push_back(last.addr + 2);
+		for (auto &target: next) {
+			if (blocks.count(target)) {
+				src << "\tif (R[15] == " << hexConst(target) << ")\n";
+				src << "\t\treturn (void*)" << blockName(target) << ";\n";
+			}
+		}
+		src << "\treturn dispatch(R[15]);\n";
+		src << "}\n\n";
+	}
+
+	// Dispatcher for indirect branches
+	src << "static void* dispatch(uint32_t pc) {\n";
+	src << "\tswitch (pc) {\n";
+	for (auto &it: blocks) {
+		src << "\t\tcase 0x" << hexStr(it.first, 8) << ": return (void*)" << blockName(it.first) << ";\n";
+	}
+	src << "\t\tdefault: return 0;\n";
+	src << "\t}\n";
+	src << "}\n\n";
+	src << "extern \"C\" void* aot_lookup(uint32_t pc) {\n";
+	src << "\treturn dispatch(pc);\n";
+	src << "}\n";
+
+	return src.str();
+}
+
+bool CM0P_AOT::compile(string srcPath, string soPath) {
+	const char* cxx = getenv("CXX");
+	string cmd = (cxx != nullptr ? cxx : "c++");
+	cmd += " -O2 -shared -fPIC -o '" + soPath + "' '" + srcPath + "'";
+	return system(cmd.c_str()) == 0;
+}
+
+bool CM0P_AOT::open(string soPath) {
+	handle = dlopen(soPath.c_str(), RTLD_NOW | RTLD_LOCAL);
+	if (handle == nullptr)
+		return false;
+	lookupFn = (void* (*)(uint32_t)) dlsym(handle, "aot_lookup");
+	if (lookupFn == nullptr) {
+		unload();
+		return false;
+	}
+	return true;
+}
+
+bool CM0P_AOT::build(const ARMv6_Program &program, uint32_t baseAddr, uint64_t imageHash, string cacheDir) {
+	unload();
+	mkdir(cacheDir.c_str(), 0755);
+
+	char name[48];
+	snprintf(name, sizeof(name), "/%016lx.aot%u", (unsigned long)imageHash, AOT_VERSION);
+	string basePath = cacheDir + name;
+	string soPath = basePath + ".so";
+
+	// Reuse code compiled by an earlier run of the same image
+	struct stat st;
+	if (stat(soPath.c_str(), &st) == 0 and open(soPath))
+		return true;
+
+	string srcPath = basePath + ".cpp";
+	ofstream file(srcPath);
+	if (!file.is_open())
+		return false;
+	file << generate(program, baseAddr);
+	file.close();
+
+	// Compile to a temporary name so concurrent runs never load a partial object
+	string tmpPath = basePath + ".tmp" + to_string(getpid()) + ".so";
+	if (!compile(srcPath, tmpPath) or rename(tmpPath.c_str(), soPath.c_str()) != 0) {
+		remove(tmpPath.c_str());
+		return false;
+	}
+	return open(soPath);
+}
@@ -0,0 +1,70 @@
+#ifndef CORTEXM0P_AOT_H
+#define CORTEXM0P_AOT_H
+
+#include "ARMv6_Program.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// State shared with the generated code; layout must match the definition emitted by
+// CM0P_AOT::generate()
+struct AOT_Context {
+	uint32_t* R;						// Core registers
+	uint8_t* flags;						// N Z C V in bits 3 to 0
+	void* core;
+	// Guest memory accesses; stores set abort after writing code or hitting a watchpoint
+	uint32_t (*read8)(void* core, uint32_t addr);
+	uint32_t (*read16)(void* core, uint32_t addr);
+	uint32_t (*read32)(void* core, uint32_t addr);
+	void (*write8)(void* core, uint32_t addr, uint32_t data);
+	void (*write16)(void* core, uint32_t addr, uint32_t data);
+	void (*write32)(void* core, uint32_t addr, uint32_t data);
+	uint64_t executed;					// Instructions run so far
+	uint64_t budget;					// Blocks are not entered past this count
+	uint32_t abort;
+};
+
+// Ahead-of-time translation of an assembled program into one C++ function per basic
+// block, compiled with the system compiler and loaded with dlopen.
+// Each instruction is emitted with its fields decoded, working on the registers and
+// flags directly and on memory through the context; statically known branches are
+// linked directly. The interpreter stays the reference, checked with --lockstep.
+class CM0P_AOT {
+	public:
+		// Returns the next block to run, or nullptr to hand back to the interpreter
+		typedef void* (*BlockFn)(AOT_Context*);
+
+		// Bumped whenever the generated code changes
+		const static uint32_t AOT_VERSION = 2;
+
+	private:
+		void* handle = nullptr;
+		void* (*lookupFn)(uint32_t pc) = nullptr;
+
+		// Compile generated source into a shared object; True on success
+		bool compile(string srcPath, string soPath);
+		bool open(string soPath);
+
+	public:
+		~CM0P_AOT();
+
+		// Emit C++ source for the program placed at baseAddr
+		static string generate(const ARMv6_Program &program, uint32_t baseAddr);
+		// Generate, compile and load the program; reuses an earlier build in cacheDir
+		// with the same image hash. True if compiled code is available
+		bool build(const ARMv6_Program &program, uint32_t baseAddr, uint64_t imageHash, string cacheDir);
+		// Unload compiled code, e.g. after the program rewrote itself
+		void unload();
+
+		bool loaded() {
+			return lookupFn != nullptr;
+		}
+		// Get compiled block starting at address; nullptr if none
+		BlockFn lookup(uint32_t pc) {
+			return (BlockFn)lookupFn(pc);
+		}
+};
+
+#endif
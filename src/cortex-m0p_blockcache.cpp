@@ -0,0 +1,323 @@
+#include "cortex-m0p_blockcache.h"
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>			// For open()
+#include <fstream>
+#include <sys/mman.h>		// For mmap()
+#include <sys/stat.h>		// For fstat(), mkdir()
+#include <unistd.h>			// For close()
+
+// Layout of a persisted block cache file; followed by blockCount entries of
+// PersistEntry, each followed by its opcodes
+struct PersistHeader {
+	char magic[4];
+	uint32_t version;
+	uint64_t imageHash;
+	uint32_t baseAddr;
+	uint32_t blockCount;
+};
+struct PersistEntry {
+	uint32_t startAddr;
+	uint32_t length;
+};
+static const char PERSIST_MAGIC[4] = {'M', '0', 'B', 'C'};
+
+CM0P_BlockCache::CM0P_BlockCache() {}
+
+CM0P_BlockCache::~CM0P_BlockCache() {
+	stopWorkers();
+	lock_guard<mutex> lock(imageLock);
+	clearBlocks();
+}
+
+void CM0P_BlockCache::load(const vector<uint16_t> &code, uint32_t baseAddr, int workerCount) {
+	stopWorkers();
+	{
+		lock_guard<mutex> lock(imageLock);
+		clearBlocks();
+		this -> baseAddr = baseAddr;
+		image = code;
+		imageHash = hashImage();
+		imageModified = false;
+		slots = image.size();
+		blocks.reset(new atomic<Block*>[slots]);
+		hotness.reset(new atomic<uint16_t>[slots]);
+		for (size_t i=0; i<slots; i++) {
+			blocks[i].store(nullptr, memory_order_relaxed);
+			hotness[i].store(0, memory_order_relaxed);
+		}
+	}
+
+	stopping = false;
+	for (int i=0; i<workerCount and !synchronous; i++) {
+		workers.emplace_back(&CM0P_BlockCache::workerLoop, this);
+	}
+}
+
+void CM0P_BlockCache::setSynchronous() {
+	stopWorkers();
+	synchronous = true;
+}
+
+void CM0P_BlockCache::invalidate(const vector<uint16_t> &code) {
+	{
+		lock_guard<mutex> lock(queueLock);
+		queue.clear();
+	}
+	// Waits for any translation in progress to finish
+	lock_guard<mutex> lock(imageLock);
+	clearBlocks();
+	imageModified = true;
+	// Code region keeps its size; extra halfwords are dropped
+	for (size_t i=0; i<slots and i<code.size(); i++) {
+		image[i] = code[i];
+	}
+}
+
+void CM0P_BlockCache::clearBlocks() {
+	for (size_t i=0; i<slots; i++) {
+		delete blocks[i].exchange(nullptr, memory_order_acq_rel);
+		hotness[i].store(0, memory_order_relaxed);
+	}
+}
+
+void CM0P_BlockCache::stopWorkers() {
+	{
+		lock_guard<mutex> lock(queueLock);
+		stopping = true;
+		queue.clear();
+	}
+	queueCv.notify_all();
+	for (auto &it: workers) {
+		it.join();
+	}
+	workers.clear();
+}
+
+void CM0P_BlockCache::enqueue(uint32_t addr) {
+	if (synchronous) {
+		publish(addr);
+		return;
+	}
+	{
+		lock_guard<mutex> lock(queueLock);
+		queue.push_back(addr);
+	}
+	queueCv.notify_one();
+}
+
+void CM0P_BlockCache::workerLoop() {
+	while (true) {
+		uint32_t addr;
+		{
+			unique_lock<mutex> lock(queueLock);
+			queueCv.wait(lock, [this] { return stopping or !queue.empty(); });
+			if (stopping)
+				return;
+			addr = queue.front();
+			queue.pop_front();
+		}
+
+		publish(addr);
+	}
+}
+
+void CM0P_BlockCache::publish(uint32_t addr) {
+	lock_guard<mutex> lock(imageLock);
+	Block* block = translate(addr);
+	if (block == nullptr)
+		return;
+	// Core picks the block up on its next entry to the address
+	Block* expected = nullptr;
+	if (!blocks[(addr - baseAddr) >> 1].compare_exchange_strong(expected, block, memory_order_release))
+		delete block;
+}
+
+CM0P_BlockCache::Block* CM0P_BlockCache::translate(uint32_t addr) {
+	size_t idx = (addr - baseAddr) >> 1;
+	if (idx >= slots)
+		return nullptr;
+
+	Block* block = new Block;
+	block -> startAddr = addr;
+	for (size_t i=idx; i<slots and block->insts.size() < MAX_BLOCK_LEN; i++) {
+		uint16_t opcode = image[i];
+		if (isUntranslatable(opcode))
+			break;
+		block -> insts.push_back(opcode);
+		if (isBlockEnd(opcode))
+			break;
+	}
+
+	if (block -> insts.empty()) {
+		delete block;
+		return nullptr;
+	}
+	return block;
+}
+
+uint64_t CM0P_BlockCache::getImageHash() {
+	return imageHash;
+}
+
+uint64_t CM0P_BlockCache::hashImage() {
+	// 64-bit FNV-1a over engine version, base address and code
+	uint64_t hash = 0xcbf29ce484222325;
+	auto mix = [&hash](uint32_t data, int bytes) {
+		for (int i=0; i<bytes; i++) {
+			hash ^= (data >> (i*8)) & 0xFF;
+			hash *= 0x100000001b3;
+		}
+	};
+	mix(ENGINE_VERSION, 4);
+	mix(baseAddr, 4);
+	for (auto &it: image) {
+		mix(it, 2);
+	}
+	return hash;
+}
+
+static string persistPath(string dirPath, uint64_t hash) {
+	char name[32];
+	snprintf(name, sizeof(name), "/%016lx.blocks", (unsigned long)hash);
+	return dirPath + name;
+}
+
+int CM0P_BlockCache::loadPersistent(string dirPath) {
+	lock_guard<mutex> lock(imageLock);
+	uint64_t hash = imageHash;
+	if (imageModified)
+		return 0;
+
+	int fd = open(persistPath(dirPath, hash).c_str(), O_RDONLY);
+	if (fd < 0)
+		return 0;
+	struct stat st;
+	if (fstat(fd, &st) != 0 or st.st_size < (off_t)sizeof(PersistHeader)) {
+		close(fd);
+		return 0;
+	}
+	size_t fileSize = st.st_size;
+	uint8_t* file = (uint8_t*) mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (file == MAP_FAILED)
+		return 0;
+
+	int loaded = 0;
+	PersistHeader header;
+	memcpy(&header, file, sizeof(header));
+	if (
+			memcmp(header.magic, PERSIST_MAGIC, 4) == 0 and
+			header.version == ENGINE_VERSION and
+			header.imageHash == hash and
+			header.baseAddr == baseAddr
+		) {
+		size_t pos = sizeof(header);
+		for (uint32_t i=0; i<header.blockCount; i++) {
+			PersistEntry entry;
+			if (pos + sizeof(entry) > fileSize)
+				break;
+			memcpy(&entry, file+pos, sizeof(entry));
+			pos += sizeof(entry);
+			if (entry.length == 0 or pos + entry.length*2 > fileSize)
+				break;
+
+			size_t idx = (entry.startAddr - baseAddr) >> 1;
+			Block* block = new Block;
+			block -> startAddr = entry.startAddr;
+			block -> insts.resize(entry.length);
+			memcpy(block->insts.data(), file+pos, entry.length*2);
+			pos += entry.length*2;
+
+			// Only accept blocks that still match the code they were cut from
+			bool valid = idx + entry.length <= slots and (entry.startAddr & 1) == 0;
+			for (uint32_t j=0; valid and j<entry.length; j++) {
+				valid = image[idx+j] == block->insts[j];
+			}
+			Block* expected = nullptr;
+			if (valid and blocks[idx].compare_exchange_strong(expected, block, memory_order_release)) {
+				// Already translated; no need to warm up again
+				hotness[idx].store(HOT_THRESHOLD+1, memory_order_relaxed);
+				loaded++;
+			}
+			else {
+				delete block;
+			}
+		}
+	}
+
+	munmap(file, fileSize);
+	return loaded;
+}
+
+bool CM0P_BlockCache::savePersistent(string dirPath) {
+	mkdir(dirPath.c_str(), 0755);
+
+	lock_guard<mutex> lock(imageLock);
+	// Blocks of rewritten code would never match a fresh load of the image
+	if (imageModified)
+		return false;
+	vector<Block*> published;
+	for (size_t i=0; i<slots; i++) {
+		Block* block = blocks[i].load(memory_order_acquire);
+		if (block != nullptr)
+			published.push_back(block);
+	}
+	if (published.empty())
+		return false;
+
+	PersistHeader header = {};
+	memcpy(header.magic, PERSIST_MAGIC, 4);
+	header.version = ENGINE_VERSION;
+	header.imageHash = imageHash;
+	header.baseAddr = baseAddr;
+	header.blockCount = published.size();
+
+	// Write to a temporary file first so concurrent runs never map a partial file
+	string path = persistPath(dirPath, header.imageHash);
+	string tmpPath = path + ".tmp" + to_string(getpid());
+	ofstream file(tmpPath, ios::binary);
+	if (!file.is_open())
+		return false;
+	file.write((char*)&header, sizeof(header));
+	for (auto &it: published) {
+		PersistEntry entry = {it->startAddr, (uint32_t)it->insts.size()};
+		file.write((char*)&entry, sizeof(entry));
+		file.write((char*)it->insts.data(), it->insts.size()*2);
+	}
+	file.close();
+	if (file.fail() or rename(tmpPath.c_str(), path.c_str()) != 0) {
+		remove(tmpPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool CM0P_BlockCache::isUntranslatable(uint16_t opcode) {
+	// Empty memory halts the core
+	if (opcode == 0)
+		return true;
+	// First halfword of a 32-bit instruction
+	if ((opcode >> 11) >= 0b11101)
+		return true;
+	return false;
+}
+
+bool CM0P_BlockCache::isBlockEnd(uint16_t opcode) {
+	// Conditional branch, UDF, SVC
+	if ((opcode >> 12) == 0b1101)
+		return true;
+	// Unconditional branch
+	if ((opcode >> 11) == 0b11100)
+		return true;
+	// Special data instructions and branch and exchange; any of them may write PC
+	if ((opcode >> 10) == 0b010001)
+		return true;
+	// POP
+	if ((opcode >> 9) == 0b1011110)
+		return true;
+	// BKPT
+	if ((opcode >> 8) == 0b10111110)
+		return true;
+	return false;
+}
@@ -0,0 +1,113 @@
+#ifndef CORTEXM0P_BLOCKCACHE_H
+#define CORTEXM0P_BLOCKCACHE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Translates hot straight-line runs of code into blocks on background worker threads.
+// The core keeps interpreting an address until its block is published, so translation
+// never stalls execution.
+class CM0P_BlockCache {
+	public:
+		struct Block {
+			uint32_t startAddr;
+			vector<uint16_t> insts;		// Opcodes of the block; last one may change PC
+		};
+
+		// Number of entries into a block head before it is queued for translation
+		const static uint16_t HOT_THRESHOLD = 64;
+		// Upper limit of instructions in a single block
+		const static int MAX_BLOCK_LEN = 64;
+		// Bumped whenever translation changes; persisted blocks of other versions are ignored
+		const static uint32_t ENGINE_VERSION = 1;
+
+	private:
+		uint32_t baseAddr = 0;
+		size_t slots = 0;				// One slot per halfword of the code region
+
+		// Copy of the code region; workers only translate from this, never from guest memory
+		vector<uint16_t> image;
+		mutex imageLock;
+		uint64_t imageHash = 0;			// Hash of the code region as loaded
+		bool imageModified = false;		// Set once the program rewrote its own code
+
+		// Published blocks, swapped in by workers and read lock-free by the core
+		unique_ptr<atomic<Block*>[]> blocks;
+		// Execution count of each block head; only written by the core thread
+		unique_ptr<atomic<uint16_t>[]> hotness;
+
+		// Compile queue of block head addresses
+		deque<uint32_t> queue;
+		mutex queueLock;
+		condition_variable queueCv;
+		vector<thread> workers;
+		bool stopping = false;
+		bool synchronous = false;		// Translate on the core thread, without workers
+
+		void workerLoop();
+		// Translate the block at the given address and publish it
+		void publish(uint32_t addr);
+		// Hash the current code region
+		uint64_t hashImage();
+		// Build a block starting at the given address; nullptr if nothing can be translated
+		Block* translate(uint32_t addr);
+		// Drop every published block and reset hotness; caller holds imageLock
+		void clearBlocks();
+		void stopWorkers();
+
+	public:
+		CM0P_BlockCache();
+		~CM0P_BlockCache();
+
+		// Set the code region to translate from and start the worker threads
+		void load(const vector<uint16_t> &code, uint32_t baseAddr, int workerCount=1);
+		// Stop the workers and translate blocks as soon as they become hot, on the thread
+		// that runs the core. Blocks then appear at the same point on every run
+		void setSynchronous();
+		// Replace the code region after it was modified; all blocks are dropped
+		void invalidate(const vector<uint16_t> &code);
+
+		// Hash of the loaded code region and engine version; names the persisted cache file
+		uint64_t getImageHash();
+		// Publish blocks stored by an earlier run of the same image; returns number loaded
+		int loadPersistent(string dirPath);
+		// Store all published blocks for later runs; True on success
+		bool savePersistent(string dirPath);
+
+		// True if the opcode may write PC or otherwise has to end a block
+		static bool isBlockEnd(uint16_t opcode);
+		// True if the opcode can not be placed inside a block at all
+		static bool isUntranslatable(uint16_t opcode);
+
+		// Get published block starting at address; nullptr if none
+		Block* lookup(uint32_t addr) {
+			uint32_t idx = (addr - baseAddr) >> 1;
+			if (idx >= slots or (addr & 1))
+				return nullptr;
+			return blocks[idx].load(memory_order_acquire);
+		}
+		// Count an entry into a block head, queueing it once it becomes hot
+		void recordEntry(uint32_t addr) {
+			uint32_t idx = (addr - baseAddr) >> 1;
+			if (idx >= slots or (addr & 1))
+				return;
+			uint16_t count = hotness[idx].load(memory_order_relaxed);
+			if (count > HOT_THRESHOLD)
+				return;
+			hotness[idx].store(count+1, memory_order_relaxed);
+			if (count+1 == HOT_THRESHOLD)
+				enqueue(addr);
+		}
+		void enqueue(uint32_t addr);
+};
+
+#endif
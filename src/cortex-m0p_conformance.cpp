@@ -0,0 +1,261 @@
+#include "cortex-m0p_conformance.h"
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <thread>
+
+// splitmix64; deterministic per opcode and trial so failures can be reproduced
+static uint64_t nextRandom(uint64_t &state) {
+	uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+CM0P_Conformance::CM0P_Conformance(uint32_t trials) {
+	this -> trials = trials;
+	results.resize(0x10000);
+}
+
+uint8_t CM0P_Conformance::pattern(uint32_t addr) {
+	return (addr * 0x9D) ^ (addr >> 8) ^ 0x5A;
+}
+
+uint8_t CM0P_Conformance::baseline(uint32_t addr) {
+	if (addr - DATA_BASE < DATA_SIZE)
+		return pattern(addr);
+	return 0;
+}
+
+const CM0P_Conformance::OpcodeResult& CM0P_Conformance::getResult(uint16_t opcode) {
+	return results[opcode];
+}
+
+void CM0P_Conformance::runOpcode(CM0P_Core &core, ARMv6_Reference &ref, uint16_t opcode) {
+	// Values likely to hit carry, overflow and shift edge cases
+	const uint32_t edges[] = {0, 1, 0x7FFFFFFF, 0x80000000, 0xFFFFFFFF, 0x80000001, 0xFFFF, 0x8000};
+	OpcodeResult &result = results[opcode];
+	CM0P_Memory* mem = core.getMemPtr();
+	uint32_t* R = core.getCoreRegisters();
+	vector<ARMv6_Reference::MemWrite> writes;
+	char buf[96];
+
+	for (uint32_t t=0; t<trials; t++) {
+		uint64_t rng = ((uint64_t)opcode << 32) | t;
+
+		// Registers point into the data region often enough to exercise loads and stores
+		ARMv6_Reference::State s;
+		for (int i=0; i<15; i++) {
+			uint64_t r = nextRandom(rng);
+			switch (r & 3) {
+				case 0: s.R[i] = DATA_BASE + 0x1000 + ((r >> 8) % (DATA_SIZE - 0x2000)) / 4 * 4; break;
+				case 1: s.R[i] = (r >> 8) & 0x3F; break;
+				case 2: s.R[i] = r >> 32; break;
+				case 3: s.R[i] = edges[(r >> 8) % 8]; break;
+			}
+		}
+		uint64_t r = nextRandom(rng);
+		s.R[13] = DATA_BASE + 0x1000 + (r % (DATA_SIZE - 0x2000)) / 4 * 4;
+		s.R[15] = CODE_BASE + ((r >> 32) % 0x800) * 2;
+		s.N = (r >> 16) & 1;
+		s.Z = (r >> 17) & 1;
+		s.C = (r >> 18) & 1;
+		s.V = (r >> 19) & 1;
+
+		for (int i=0; i<16; i++) {
+			R[i] = s.R[i];
+		}
+		core.update_flag('N', s.N);
+		core.update_flag('Z', s.Z);
+		core.update_flag('C', s.C);
+		core.update_flag('V', s.V);
+		uint32_t pc = s.R[15];
+		uint32_t initial[16];
+		copy(s.R, s.R + 16, initial);
+		mem -> write_halfword(pc, opcode);
+		uint64_t generation = mem -> getGeneration();
+
+		// Reference reads memory before the core can change it
+		ARMv6_Reference::Outcome outcome = ref.step(s, opcode, writes);
+		core.step_inst();
+
+		uint32_t mask = 0;
+		string example;
+		if (outcome == ARMv6_Reference::executed) {
+			for (int i=0; i<16; i++) {
+				if (R[i] != s.R[i]) {
+					mask |= 1 << i;
+					if (example.empty()) {
+						snprintf(buf, sizeof(buf), "R%d=%08x,expected=%08x", i, R[i], s.R[i]);
+						example = buf;
+					}
+				}
+			}
+			const char flagNames[] = {'N', 'Z', 'C', 'V'};
+			bool flags[] = {s.N, s.Z, s.C, s.V};
+			for (int i=0; i<4; i++) {
+				if (core.get_flag(flagNames[i]) != flags[i]) {
+					mask |= 1 << (MASK_FLAGS + i);
+					if (example.empty()) {
+						snprintf(buf, sizeof(buf), "%c=%d,expected=%d", flagNames[i], !flags[i], flags[i]);
+						example = buf;
+					}
+				}
+			}
+			for (auto &it: writes) {
+				uint32_t value = it.size == 4 ? mem->read_word(it.addr) : (it.size == 2 ? mem->read_halfword(it.addr) : mem->read_byte(it.addr));
+				if (value != it.value) {
+					mask |= 1 << MASK_MEMORY;
+					if (example.empty()) {
+						snprintf(buf, sizeof(buf), "[%08x]=%0*x,expected=%0*x", it.addr, it.size*2, value, it.size*2, it.value);
+						example = buf;
+					}
+				}
+			}
+		}
+
+		// Check bytes outside the expected writes and restore memory for the next trial.
+		// Writes land near an address held in a register before or after the instruction;
+		// all pages are scanned only if the last write is not found there.
+		uint64_t lastGeneration = mem -> getGeneration();
+		vector<uint32_t> pages;
+		if (lastGeneration != generation) {
+			bool lastFound = false;
+			for (int i=0; i<32; i++) {
+				uint32_t value = i < 16 ? initial[i] : R[i-16];
+				for (uint32_t addr: {value - 64, value, value + 1023}) {
+					uint32_t page = addr >> CM0P_Memory::PAGE_BITS;
+					if (page >= (uint32_t)mem->getPageCount() or mem->getPageGeneration(page) <= generation)
+						continue;
+					if (find(pages.begin(), pages.end(), page) == pages.end())
+						pages.push_back(page);
+					lastFound = lastFound or mem->getPageGeneration(page) == lastGeneration;
+				}
+			}
+			if (!lastFound) {
+				pages.clear();
+				for (int page=0; page<mem->getPageCount(); page++) {
+					if (mem->getPageGeneration(page) > generation)
+						pages.push_back(page);
+				}
+			}
+		}
+		mem -> write_halfword(pc, 0);
+		for (auto page: pages) {
+			const BYTE* data = mem -> getPage(page);
+			uint32_t pageAddr = page << CM0P_Memory::PAGE_BITS;
+			for (int i=0; i<CM0P_Memory::PAGE_SIZE; i++) {
+				uint32_t addr = pageAddr + i;
+				if (data[i] == baseline(addr))
+					continue;
+				bool written = false;
+				for (auto &it: writes) {
+					written = written or addr - it.addr < (uint32_t)it.size;
+				}
+				if (!written and outcome == ARMv6_Reference::executed) {
+					mask |= 1 << MASK_MEMORY;
+					if (example.empty()) {
+						snprintf(buf, sizeof(buf), "[%08x]=%02x,expected=%02x", addr, data[i], baseline(addr));
+						example = buf;
+					}
+				}
+				mem -> write_byte(addr, baseline(addr));
+			}
+		}
+
+		if (outcome != ARMv6_Reference::executed) {
+			result.skipped++;
+			continue;
+		}
+		result.compared++;
+		if (mask != 0) {
+			result.failed++;
+			result.mask |= mask;
+			if (result.example.empty()) {
+				snprintf(buf, sizeof(buf), "trial=%u,", t);
+				result.example = buf + example;
+			}
+		}
+	}
+}
+
+void CM0P_Conformance::runShard(int shard, int shards) {
+	CM0P_Core core((ARMv6_Program()));
+	CM0P_Memory* mem = core.getMemPtr();
+	for (uint32_t addr=DATA_BASE; addr<DATA_BASE+DATA_SIZE; addr++) {
+		mem -> write_byte(addr, pattern(addr));
+	}
+	ARMv6_Reference ref(mem->getSize(), [mem](uint32_t addr, int size) {
+		if (size == 4)
+			return mem -> read_word(addr);
+		if (size == 2)
+			return (uint32_t)mem -> read_halfword(addr);
+		return (uint32_t)mem -> read_byte(addr);
+	});
+
+	for (uint32_t opcode=shard; opcode<0x10000; opcode+=shards) {
+		runOpcode(core, ref, opcode);
+	}
+}
+
+int CM0P_Conformance::run() {
+	int shards = thread::hardware_concurrency();
+	if (shards < 1)
+		shards = 1;
+	vector<thread> workers;
+	for (int i=0; i<shards; i++) {
+		workers.emplace_back(&CM0P_Conformance::runShard, this, i, shards);
+	}
+	for (auto &it: workers) {
+		it.join();
+	}
+
+	int failing = 0;
+	for (auto &it: results) {
+		failing += it.failed > 0;
+	}
+	return failing;
+}
+
+bool CM0P_Conformance::writeDatabase(string path) {
+	FILE* file = fopen(path.c_str(), "w");
+	if (file == nullptr)
+		return false;
+	fprintf(file, "# opcode mnemonic failed/compared skipped mask example; %u trials per opcode\n", trials);
+	for (uint32_t opcode=0; opcode<0x10000; opcode++) {
+		OpcodeResult &it = results[opcode];
+		if (it.failed == 0)
+			continue;
+		fprintf(file, "%04x %s %u/%u %u %06x %s\n", opcode, ARMv6_Reference::mnemonic(opcode),
+			it.failed, it.compared, it.skipped, it.mask, it.example.c_str());
+	}
+	fclose(file);
+	return true;
+}
+
+void CM0P_Conformance::printSummary() {
+	struct Totals {
+		uint32_t opcodes = 0;
+		uint32_t failingOpcodes = 0;
+		uint64_t compared = 0;
+		uint64_t failed = 0;
+		uint32_t mask = 0;
+	};
+	map<string, Totals> totals;
+	for (uint32_t opcode=0; opcode<0x10000; opcode++) {
+		OpcodeResult &it = results[opcode];
+		Totals &total = totals[ARMv6_Reference::mnemonic(opcode)];
+		total.opcodes++;
+		total.failingOpcodes += it.failed > 0;
+		total.compared += it.compared;
+		total.failed += it.failed;
+		total.mask |= it.mask;
+	}
+
+	printf("%-12s %8s %8s %12s %12s %s\n", "mnemonic", "opcodes", "failing", "compared", "failed", "mask");
+	for (auto &it: totals) {
+		Totals &t = it.second;
+		printf("%-12s %8u %8u %12lu %12lu %06x\n", it.first.c_str(), t.opcodes, t.failingOpcodes,
+			(unsigned long)t.compared, (unsigned long)t.failed, t.mask);
+	}
+}
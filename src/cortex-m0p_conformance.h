@@ -0,0 +1,60 @@
+#ifndef CORTEXM0P_CONFORMANCE_H
+#define CORTEXM0P_CONFORMANCE_H
+
+#include "cortex-m0p_core.h"
+#include "ARMv6_Reference.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Runs every 16-bit opcode through CM0P_Core::step_inst against randomised register,
+// flag and memory states and checks the result with the ARMv6_Reference model.
+// Opcodes are sharded over all host threads; each thread owns its own core.
+class CM0P_Conformance {
+	public:
+		// Bits of the mismatch mask
+		const static int MASK_FLAGS = 16;		// Bits 16-19 for N, Z, C, V; bits 0-15 for R0-R15
+		const static int MASK_MEMORY = 20;
+
+		struct OpcodeResult {
+			uint32_t compared = 0;		// Trials where the reference executed the instruction
+			uint32_t failed = 0;
+			uint32_t skipped = 0;		// Trials the reference treats as UNPREDICTABLE, faulting or unmodelled
+			uint32_t mask = 0;			// Union of mismatching state over all failed trials
+			string example;				// First mismatch seen
+		};
+
+	private:
+		uint32_t trials;
+		vector<OpcodeResult> results;
+
+		// Region filled with a known byte pattern that generated addresses point into
+		const static uint32_t DATA_BASE = 0x100000;
+		const static uint32_t DATA_SIZE = 0x10000;
+		// Page the instruction under test is placed in
+		const static uint32_t CODE_BASE = 0x1000;
+
+		static uint8_t pattern(uint32_t addr);
+		// Expected content of untouched memory
+		static uint8_t baseline(uint32_t addr);
+
+		// Test opcodes shard, shard + shards, ... on one core
+		void runShard(int shard, int shards);
+		void runOpcode(CM0P_Core &core, ARMv6_Reference &ref, uint16_t opcode);
+
+	public:
+		CM0P_Conformance(uint32_t trials);
+
+		// Sweep all opcodes; returns number of opcodes with at least one mismatch
+		int run();
+		const OpcodeResult& getResult(uint16_t opcode);
+
+		// One line per mismatching opcode: opcode, mnemonic, failed/compared, skipped, mask, example
+		bool writeDatabase(string path);
+		// Per mnemonic totals
+		void printSummary();
+};
+
+#endif
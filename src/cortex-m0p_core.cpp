@@ -1,24 +1,97 @@
 #include "cortex-m0p_core.h"
+#include <cstdio>
 
-CM0P_Core::CM0P_Core(vector<ARMv6_Assembler::OpcodeResult> opcodes, uint32_t startAddr) {
+CM0P_Core::CM0P_Core(const ARMv6_Program &program) {
+	// Write opcodes into memory
+	const vector<uint16_t> &code = program.getCode();
+	for (size_t i=0; i<code.size(); i++) {
+		memory.write_halfword(INST_BASEADDR+i*2, code[i]);
+	}
+	initCode(code, program.getStartAddr());
+}
+
+CM0P_Core::CM0P_Core(const uint8_t* image, uint32_t imageSize, uint32_t startAddr) {
+	// Image is already in memory order; copied in one go
+	memory.write_block(INST_BASEADDR, image, imageSize);
+	vector<uint16_t> code(imageSize / 2);
+	for (size_t i=0; i<code.size(); i++) {
+		code[i] = image[i*2] << 8 | image[i*2+1];
+	}
+	initCode(code, startAddr);
+}
+
+void CM0P_Core::initCode(const vector<uint16_t> &code, uint32_t startAddr) {
 	// Initialize registers
 	for (int i=0; i<16; i++) {
 		R[i] = 0;
 	}
+	setPC(startAddr);
 
-	// Write opcodes into memory
-	int i=0;
-	for (auto &it: opcodes) {
-		if (it.i32) {
-			memory.write_word(INST_BASEADDR+i, it.opcode);
-			i+=2;
+	// Start translating the loaded code in the background
+	codeSize = code.size() * 2;
+	updateBreakBits();
+	memory.setCodeRegion(INST_BASEADDR, codeSize);
+	blockCache.load(code, INST_BASEADDR);
+	lastCodeWrites = memory.getCodeWrites();
+
+	aotCtx.R = R;
+	aotCtx.flags = &condFlags;
+	aotCtx.core = this;
+	aotCtx.read8 = aotRead8;
+	aotCtx.read16 = aotRead16;
+	aotCtx.read32 = aotRead32;
+	aotCtx.write8 = aotWrite8;
+	aotCtx.write16 = aotWrite16;
+	aotCtx.write32 = aotWrite32;
+}
+
+uint32_t CM0P_Core::patchCode(const ARMv6_Program &program) {
+	const vector<uint16_t> &code = program.getCode();
+	uint32_t written = 0;
+	for (size_t i=0; i<code.size(); i++) {
+		uint32_t addr = INST_BASEADDR + i*2;
+		if (memory.fetch_halfword(addr) != code[i]) {
+			memory.write_halfword(addr, code[i]);
+			written++;
 		}
-		else {
-			memory.write_halfword(INST_BASEADDR+i, it.opcode);
+	}
+	// Clear what is left of a longer program so the core halts at the new end
+	for (uint32_t addr=INST_BASEADDR+code.size()*2; addr<INST_BASEADDR+codeSize; addr+=2) {
+		if (memory.fetch_halfword(addr) != 0) {
+			memory.write_halfword(addr, 0);
+			written++;
 		}
-		i+=2;
 	}
-	setPC(startAddr);
+
+	// Translated and compiled code was made from the old program
+	codeSize = code.size() * 2;
+	// Probes stay on their addresses; those past the new end are dropped
+	updateBreakBits();
+	memory.setCodeRegion(INST_BASEADDR, codeSize);
+	blockCache.load(code, INST_BASEADDR);
+	lastCodeWrites = memory.getCodeWrites();
+	aot.unload();
+	atBlockHead = true;
+	// Counts belong to the old program
+	if (profiling)
+		enableProfile();
+	return written;
+}
+
+void CM0P_Core::enableProfile() {
+	profiling = true;
+	profile.assign(codeSize / 2, 0);
+	profileTotal = 0;
+}
+
+uint64_t CM0P_Core::getProfileCount(uint32_t addr) {
+	if (addr - INST_BASEADDR >= profile.size() * 2)
+		return 0;
+	return profile[(addr - INST_BASEADDR) >> 1];
+}
+
+uint64_t CM0P_Core::getProfileTotal() {
+	return profileTotal;
 }
 
 uint32_t CM0P_Core::getBaseAddr() {
@@ -93,12 +166,314 @@ void CM0P_Core::update_flag(char flag, bool bit) {
 }
 
 void CM0P_Core::step_inst() {
-	uint16_t opcode = memory.read_halfword(R[15]);
+	uint16_t opcode = memory.fetch_halfword(R[15]);
 	if (opcode == 0)
 		return;
+	exec_inst(opcode);
+}
+
+bool CM0P_Core::isHalted() {
+	return memory.fetch_halfword(*PC) == 0;
+}
+
+bool CM0P_Core::toggleBreakpoint(uint32_t addr) {
+	if (hasBreakpoint(addr)) {
+		clearProbe(addr);
+		return false;
+	}
+	return setProbe(addr, CM0P_Probe());
+}
+
+bool CM0P_Core::setProbe(uint32_t addr, const CM0P_Probe &probe) {
+	if (addr - INST_BASEADDR >= codeSize or (addr & 1))
+		return false;
+	probes[addr] = probe;
+	updateBreakBits();
+	return true;
+}
+
+void CM0P_Core::clearProbe(uint32_t addr) {
+	if (probes.erase(addr))
+		updateBreakBits();
+}
+
+const CM0P_Probe* CM0P_Core::getProbe(uint32_t addr) {
+	auto it = probes.find(addr);
+	return it == probes.end() ? nullptr : &it->second;
+}
+
+void CM0P_Core::updateBreakBits() {
+	breakBits.assign((codeSize / 2 + 63) / 64, 0);
+	for (auto it=probes.begin(); it!=probes.end();) {
+		if (it->first - INST_BASEADDR >= codeSize) {
+			it = probes.erase(it);
+			continue;
+		}
+		uint32_t idx = (it->first - INST_BASEADDR) >> 1;
+		breakBits[idx >> 6] |= 1ULL << (idx & 63);
+		it++;
+	}
+	breakCount = probes.size();
+}
+
+bool CM0P_Core::hitProbe() {
+	CM0P_Probe &probe = probes.at(*PC);
+	if (!probe.condition.empty() and probe.condition.eval(*this) == 0)
+		return false;
+	probe.hits++;
+	if (probe.stop)
+		return true;
+	CM0P_TraceBuffer::Record &record = trace.push();
+	record.addr = *PC;
+	record.hit = probe.hits;
+	record.count = probe.values.size();
+	for (uint32_t i=0; i<record.count; i++) {
+		record.values[i] = probe.values[i].eval(*this);
+	}
+	return false;
+}
+
+bool CM0P_Core::setWatchpoint(uint32_t addr, uint32_t length, uint8_t kinds) {
+	bool set = memory.addWatchpoint(addr, length, kinds);
+	updateWatching();
+	return set;
+}
+
+bool CM0P_Core::clearWatchpoint(uint32_t addr) {
+	bool cleared = memory.removeWatchpoint(addr);
+	updateWatching();
+	return cleared;
+}
+
+void CM0P_Core::updateWatching() {
+	watching = !memory.getWatchpoints().empty();
+	watchingReads = false;
+	for (auto &it: memory.getWatchpoints()) {
+		watchingReads = watchingReads or (it.kinds & CM0P_Memory::WATCH_READ);
+	}
+}
+
+bool CM0P_Core::stoppedAtWatchpoint() {
+	return watchStopped;
+}
+
+uint32_t CM0P_Core::getWatchPC() {
+	return watchPC;
+}
+
+CM0P_TraceBuffer& CM0P_Core::getTrace() {
+	return trace;
+}
+
+bool CM0P_Core::writeTrace(string path) {
+	FILE* file = fopen(path.c_str(), "w");
+	if (file == nullptr)
+		return false;
+	for (uint32_t i=0; i<trace.size(); i++) {
+		const CM0P_TraceBuffer::Record &record = trace.at(i);
+		fprintf(file, "0x%08x #%lu", record.addr, (unsigned long)record.hit);
+		// Values are named after the tracepoint if it is still the one that recorded them
+		const CM0P_Probe* probe = getProbe(record.addr);
+		bool named = probe != nullptr and !probe->stop and probe->values.size() == record.count;
+		for (uint32_t v=0; v<record.count; v++) {
+			if (named)
+				fprintf(file, "  %s=0x%08x", probe->values[v].getText().c_str(), record.values[v]);
+			else
+				fprintf(file, "  0x%08x", record.values[v]);
+		}
+		fprintf(file, "\n");
+	}
+	return fclose(file) == 0;
+}
+
+bool CM0P_Core::hasBreakpoint(uint32_t addr) {
+	uint32_t idx = (addr - INST_BASEADDR) >> 1;
+	if (addr - INST_BASEADDR >= codeSize)
+		return false;
+	return (breakBits[idx >> 6] >> (idx & 63)) & 1;
+}
+
+bool CM0P_Core::atBreakpoint() {
+	if (breakCount == 0 or !hasBreakpoint(*PC))
+		return false;
+	const CM0P_Probe &probe = probes.at(*PC);
+	return probe.stop and (probe.condition.empty() or probe.condition.eval(*this) != 0);
+}
+
+uint32_t CM0P_Core::getBreakpointCount() {
+	return breakCount;
+}
+
+bool CM0P_Core::breakInRange(uint32_t addr, uint32_t halfwords) {
+	if (halfwords == 0)
+		return false;
+	uint32_t first = (addr - INST_BASEADDR) >> 1;
+	uint32_t last = first + halfwords - 1;
+	for (uint32_t word=first>>6; word<=last>>6 and word<breakBits.size(); word++) {
+		uint64_t bits = breakBits[word];
+		if (word == first >> 6)
+			bits &= ~0ULL << (first & 63);
+		if (word == last >> 6)
+			bits &= ~0ULL >> (63 - (last & 63));
+		if (bits != 0)
+			return true;
+	}
+	return false;
+}
+
+uint64_t CM0P_Core::run(uint64_t maxInsts) {
+	uint64_t executed = 0;
+	uint32_t watchHits = memory.getWatchHits();
+	watchStopped = false;
+	while (executed < maxInsts) {
+		if (watching and memory.getWatchHits() != watchHits)
+			break;
+		// Only marked instructions pay for evaluating their probe
+		if (breakCount > 0 and hasBreakpoint(*PC) and hitProbe())
+			break;
+
+		// Compiled code runs as far as it can before handing back; it does not check
+		// probes, only notices watchpoints at stores and does not count profiles
+		if (aot.loaded() and breakCount == 0 and !watchingReads and !profiling) {
+			CM0P_AOT::BlockFn fn = aot.lookup(*PC);
+			if (fn != nullptr) {
+				aotCtx.executed = executed;
+				aotCtx.budget = maxInsts;
+				aotCtx.abort = 0;
+				while (fn != nullptr) {
+					fn = (CM0P_AOT::BlockFn) fn(&aotCtx);
+				}
+				if (aotCtx.executed != executed) {
+					executed = aotCtx.executed;
+					atBlockHead = true;
+					if (memory.getCodeWrites() != lastCodeWrites)
+						refreshCode();
+					continue;
+				}
+			}
+		}
+
+		CM0P_BlockCache::Block* block = blockCache.lookup(*PC);
+		// Blocks holding a probe past their first instruction run one at a time
+		if (block != nullptr and breakCount > 0 and breakInRange(*PC + 2, block->insts.size() - 1))
+			block = nullptr;
+		if (block != nullptr and block->insts.size() <= maxInsts - executed) {
+			uint64_t first = executed;
+			for (auto opcode: block->insts) {
+				exec_inst(opcode);
+				executed++;
+				// Remaining opcodes of the block may be stale
+				if (memory.getCodeWrites() != lastCodeWrites)
+					break;
+				if (watching and memory.getWatchHits() != watchHits) {
+					watchPC = block->startAddr + 2 * (executed - first - 1);
+					break;
+				}
+			}
+			atBlockHead = true;
+		}
+		else {
+			uint16_t opcode = memory.fetch_halfword(*PC);
+			// Empty memory halts the core
+			if (opcode == 0)
+				break;
+			if (atBlockHead)
+				blockCache.recordEntry(*PC);
+			if (watching)
+				watchPC = *PC;
+			exec_inst(opcode);
+			executed++;
+			atBlockHead = CM0P_BlockCache::isBlockEnd(opcode);
+		}
+
+		if (memory.getCodeWrites() != lastCodeWrites) {
+			refreshCode();
+			atBlockHead = true;
+		}
+	}
+	watchStopped = watching and memory.getWatchHits() != watchHits;
+	return executed;
+}
+
+void CM0P_Core::refreshCode() {
+	vector<uint16_t> code;
+	for (uint32_t addr=INST_BASEADDR; addr<INST_BASEADDR+codeSize; addr+=2) {
+		code.push_back(memory.fetch_halfword(addr));
+	}
+	blockCache.invalidate(code);
+	lastCodeWrites = memory.getCodeWrites();
+	// Compiled code no longer matches memory
+	aot.unload();
+}
+
+void CM0P_Core::setSyncTranslation() {
+	blockCache.setSynchronous();
+}
+
+int CM0P_Core::loadTranslationCache(string dirPath) {
+	return blockCache.loadPersistent(dirPath);
+}
+
+bool CM0P_Core::saveTranslationCache(string dirPath) {
+	return blockCache.savePersistent(dirPath);
+}
+
+bool CM0P_Core::enableAOT(const ARMv6_Program &program, string cacheDir) {
+	return aot.build(program, INST_BASEADDR, blockCache.getImageHash(), cacheDir);
+}
+
+uint32_t CM0P_Core::aotRead8(void* core, uint32_t addr) {
+	return ((CM0P_Core*)core) -> memory.read_byte(addr);
+}
+
+uint32_t CM0P_Core::aotRead16(void* core, uint32_t addr) {
+	return ((CM0P_Core*)core) -> memory.read_halfword(addr);
+}
+
+uint32_t CM0P_Core::aotRead32(void* core, uint32_t addr) {
+	return ((CM0P_Core*)core) -> memory.read_word(addr);
+}
+
+void CM0P_Core::aotWrite8(void* core, uint32_t addr, uint32_t data) {
+	CM0P_Core* self = (CM0P_Core*)core;
+	uint32_t watchHits = self->memory.getWatchHits();
+	self -> memory.write_byte(addr, data);
+	self -> aotStored(watchHits);
+}
+
+void CM0P_Core::aotWrite16(void* core, uint32_t addr, uint32_t data) {
+	CM0P_Core* self = (CM0P_Core*)core;
+	uint32_t watchHits = self->memory.getWatchHits();
+	self -> memory.write_halfword(addr, data);
+	self -> aotStored(watchHits);
+}
+
+void CM0P_Core::aotWrite32(void* core, uint32_t addr, uint32_t data) {
+	CM0P_Core* self = (CM0P_Core*)core;
+	uint32_t watchHits = self->memory.getWatchHits();
+	self -> memory.write_word(addr, data);
+	self -> aotStored(watchHits);
+}
+
+void CM0P_Core::aotStored(uint32_t watchHits) {
+	if (memory.getCodeWrites() != lastCodeWrites)
+		aotCtx.abort = 1;
+	// Compiled code sets PC to the storing instruction first
+	if (watching and memory.getWatchHits() != watchHits) {
+		watchPC = *PC;
+		aotCtx.abort = 1;
+	}
+}
+
+void CM0P_Core::exec_inst(uint16_t opcode) {
 	// Indicate whether PC should be incremented at the end
 	bool incrementPC = 1;
 
+	if (profiling and *PC - INST_BASEADDR < codeSize) {
+		profile[(*PC - INST_BASEADDR) >> 1]++;
+		profileTotal++;
+	}
+
 	// From ARMv6-M Architecture Reference Manual A5.2
 	switch (opcode >> 10) {
 		case 0b000000 ... 0b001111:
@@ -2,9 +2,13 @@
 #define CORTEXM0P_CORE_H
 
 #include "cortex-m0p_memory.h"
-#include "ARMv6_Assembler.h"
+#include "cortex-m0p_blockcache.h"
+#include "cortex-m0p_aot.h"
+#include "cortex-m0p_probe.h"
+#include "ARMv6_Program.h"
 #include <cstdint>
 #include <string>
+#include <unordered_map>
 
 using namespace std;
 
@@ -29,15 +33,115 @@ class CM0P_Core {
 
 		CM0P_Memory memory;
 
+		// Translated blocks of the code region
+		CM0P_BlockCache blockCache;
+		uint32_t codeSize = 0;				// Size of code region in bytes
+		uint32_t lastCodeWrites = 0;		// Code writes seen when blocks were last refreshed
+		// Block heads are addresses reached right after a block ending instruction
+		bool atBlockHead = true;
+
+		// Ahead-of-time compiled program, if enabled
+		CM0P_AOT aot;
+		AOT_Context aotCtx;
+		// Memory accesses of compiled code
+		static uint32_t aotRead8(void* core, uint32_t addr);
+		static uint32_t aotRead16(void* core, uint32_t addr);
+		static uint32_t aotRead32(void* core, uint32_t addr);
+		static void aotWrite8(void* core, uint32_t addr, uint32_t data);
+		static void aotWrite16(void* core, uint32_t addr, uint32_t data);
+		static void aotWrite32(void* core, uint32_t addr, uint32_t data);
+		// Stop compiled code after a store that wrote code or hit a watchpoint
+		void aotStored(uint32_t watchHits);
+
+		// One bit per halfword of the code region with a probe; run() checks the probe
+		// before running a marked instruction
+		vector<uint64_t> breakBits;
+		uint32_t breakCount = 0;
+		unordered_map<uint32_t, CM0P_Probe> probes;
+		CM0P_TraceBuffer trace;
+		// True if a breakpoint is set on any of the halfwords from addr on
+		bool breakInRange(uint32_t addr, uint32_t halfwords);
+		// Apply the probe at the PC; True if the core should stop
+		bool hitProbe();
+		// Rebuild the bitmap from probes, dropping those outside the code region
+		void updateBreakBits();
+
+		// Watchpoints are checked by memory; run() stops after an instruction that hit one
+		bool watching = false;
+		bool watchingReads = false;		// Compiled code only stops at stores
+		bool watchStopped = false;
+		uint32_t watchPC = 0;			// Instruction that hit the watchpoint
+		void updateWatching();
+
+		// Execution count per halfword of the code region, while profiling
+		bool profiling = false;
+		vector<uint64_t> profile;
+		uint64_t profileTotal = 0;
+
+		// Execute a single fetched instruction
+		void exec_inst(uint16_t opcode);
+		// Reload translation input after the program modified its own code
+		void refreshCode();
+		// Reset registers and start translating code already written to memory
+		void initCode(const vector<uint16_t> &code, uint32_t startAddr);
+
 		uint32_t update_flag_addition(uint32_t a, uint32_t b);
 		uint32_t update_flag_subtraction(uint32_t a, uint32_t b);
 		void stackPush(uint32_t data);
 	public:
-		CM0P_Core(vector<ARMv6_Assembler::OpcodeResult>, uint32_t startAddr);	// Constructor
+		CM0P_Core(const ARMv6_Program &program);	// Constructor
+		// Load a program image laid out as in memory, such as the code of an object file
+		CM0P_Core(const uint8_t* image, uint32_t imageSize, uint32_t startAddr);
 		uint32_t getBaseAddr();
 		bool get_flag(char flag);
 		void update_flag(char flag, bool bit);
-		void step_inst();		// Run instruction in memory
+		void step_inst();		// Run instruction in memory; breakpoints are ignored
+		bool isHalted();		// True if the next instruction is empty memory
+		// Run up to maxInsts instructions or until the core halts or reaches a breakpoint;
+		// returns number executed
+		uint64_t run(uint64_t maxInsts);
+		// Set or clear a breakpoint on an instruction of the code region; returns True if
+		// it is now set. Compiled code is not used while any breakpoint or tracepoint is set
+		bool toggleBreakpoint(uint32_t addr);
+		// Set a probe on an instruction of the code region, replacing any there; False
+		// outside the code region
+		bool setProbe(uint32_t addr, const CM0P_Probe &probe);
+		void clearProbe(uint32_t addr);
+		// Probe at addr; nullptr if none
+		const CM0P_Probe* getProbe(uint32_t addr);
+		bool hasBreakpoint(uint32_t addr);
+		// True if a breakpoint stops the core before the next instruction
+		bool atBreakpoint();
+		uint32_t getBreakpointCount();
+		// Values recorded by tracepoints
+		CM0P_TraceBuffer& getTrace();
+		// Write the recorded values, oldest first, one hit per line; False on failure
+		bool writeTrace(string path);
+		// Stop after instructions that access [addr, addr+length) as given by kinds, see
+		// CM0P_Memory::addWatchpoint(); False outside memory
+		bool setWatchpoint(uint32_t addr, uint32_t length, uint8_t kinds);
+		bool clearWatchpoint(uint32_t addr);
+		// True if the last run() stopped for a watchpoint, and the instruction that hit it
+		bool stoppedAtWatchpoint();
+		uint32_t getWatchPC();
+		// Translate blocks on the thread that runs the core instead of in the background, so
+		// repeated runs take the same path through blocks
+		void setSyncTranslation();
+		// Load and store translated blocks in a cache directory shared between runs
+		int loadTranslationCache(string dirPath);
+		bool saveTranslationCache(string dirPath);
+		// Compile the loaded program ahead of time; compiled code is kept in cacheDir
+		bool enableAOT(const ARMv6_Program &program, string cacheDir);
+		// Replace the loaded program after it was reassembled. Only changed halfwords are
+		// written; registers and the rest of memory are kept. Returns halfwords written
+		uint32_t patchCode(const ARMv6_Program &program);
+		// Count how often each instruction of the code region runs; counts restart when
+		// the code is patched
+		void enableProfile();
+		// Times the instruction at addr ran; 0 outside the code region
+		uint64_t getProfileCount(uint32_t addr);
+		// Instructions counted over the whole code region
+		uint64_t getProfileTotal();
 		void setPC(uint32_t addr);			// Setter for PC
 		uint32_t* getCoreRegisters();		// Returns R
 
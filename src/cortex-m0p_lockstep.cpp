@@ -0,0 +1,157 @@
+#include "cortex-m0p_lockstep.h"
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+CM0P_Lockstep::CM0P_Lockstep(CoreFactory makeRef, CoreFactory makeTest) {
+	this -> makeRef = makeRef;
+	this -> makeTest = makeTest;
+}
+
+uint64_t CM0P_Lockstep::advance(CM0P_Core &ref, CM0P_Core &test, uint64_t n) {
+	// Reference engine single steps
+	uint64_t refRan = 0;
+	while (refRan < n and !ref.isHalted()) {
+		ref.step_inst();
+		refRan++;
+	}
+	test.run(refRan);
+	return refRan;
+}
+
+bool CM0P_Lockstep::compare(CM0P_Core &ref, CM0P_Core &test, Report &report) {
+	char buf[96];
+	bool equal = true;
+
+	uint32_t* refRegs = ref.getCoreRegisters();
+	uint32_t* testRegs = test.getCoreRegisters();
+	for (int i=0; i<16; i++) {
+		if (refRegs[i] != testRegs[i]) {
+			snprintf(buf, sizeof(buf), "R%-2d  ref 0x%08x  test 0x%08x", i, refRegs[i], testRegs[i]);
+			report.differences.push_back(buf);
+			equal = false;
+		}
+	}
+	for (char flag: {'N', 'Z', 'C', 'V'}) {
+		if (ref.get_flag(flag) != test.get_flag(flag)) {
+			snprintf(buf, sizeof(buf), "%c    ref %d  test %d", flag, ref.get_flag(flag), test.get_flag(flag));
+			report.differences.push_back(buf);
+			equal = false;
+		}
+	}
+
+	// Only pages written by either core since the last check can differ
+	CM0P_Memory* refMem = ref.getMemPtr();
+	CM0P_Memory* testMem = test.getMemPtr();
+	for (int page=0; page<refMem->getPageCount(); page++) {
+		if (refMem->getPageGeneration(page) <= refGenChecked and testMem->getPageGeneration(page) <= testGenChecked)
+			continue;
+		const BYTE* refPage = refMem -> getPage(page);
+		const BYTE* testPage = testMem -> getPage(page);
+		if (memcmp(refPage, testPage, CM0P_Memory::PAGE_SIZE) == 0)
+			continue;
+		for (int i=0; i<CM0P_Memory::PAGE_SIZE; i++) {
+			if (refPage[i] != testPage[i]) {
+				uint32_t addr = ((uint32_t)page << CM0P_Memory::PAGE_BITS) + i;
+				snprintf(buf, sizeof(buf), "[%08x]  ref 0x%02x  test 0x%02x", addr, refPage[i], testPage[i]);
+				report.differences.push_back(buf);
+				equal = false;
+				break;
+			}
+		}
+	}
+	if (equal) {
+		refGenChecked = refMem -> getGeneration();
+		testGenChecked = testMem -> getGeneration();
+	}
+	return equal;
+}
+
+void CM0P_Lockstep::start(unique_ptr<CM0P_Core> &ref, unique_ptr<CM0P_Core> &test) {
+	ref.reset(makeRef());
+	test.reset(makeTest());
+	// Blocks must appear at the same point on every replay
+	test -> setSyncTranslation();
+	refGenChecked = testGenChecked = 0;
+}
+
+uint64_t CM0P_Lockstep::runSlices(CM0P_Core &ref, CM0P_Core &test, uint64_t count, uint64_t interval) {
+	uint64_t executed = 0;
+	while (executed < count) {
+		uint64_t n = advance(ref, test, min(interval, count - executed));
+		if (n == 0)
+			break;
+		executed += n;
+	}
+	return executed;
+}
+
+CM0P_Lockstep::Report CM0P_Lockstep::run(uint64_t maxInsts, uint64_t interval) {
+	Report report;
+	if (interval == 0)
+		interval = 1;
+
+	unique_ptr<CM0P_Core> ref, test;
+	start(ref, test);
+
+	// Coarse pass; full state is only compared every interval instructions
+	uint64_t executed = 0;
+	uint64_t windowStart = 0;
+	bool diverged = false;
+	while (executed < maxInsts) {
+		windowStart = executed;
+		uint64_t n = advance(*ref, *test, min(interval, maxInsts - executed));
+		executed += n;
+		Report scratch;
+		if (!compare(*ref, *test, scratch)) {
+			diverged = true;
+			break;
+		}
+		if (n == 0)
+			break;
+	}
+	if (!diverged) {
+		report.executed = executed;
+		return report;
+	}
+
+	// Halve the failing interval. Every replay starts over and runs the same slices as the
+	// coarse pass with a shorter last one, so the test engine still enters its blocks and
+	// compiled code instead of stepping
+	uint64_t good = windowStart, bad = executed;
+	while (bad - good > 1) {
+		uint64_t mid = good + (bad - good) / 2;
+		start(ref, test);
+		uint64_t n = runSlices(*ref, *test, mid, interval);
+		Report scratch;
+		if (n == mid and compare(*ref, *test, scratch))
+			good = mid;
+		else
+			bad = mid;
+	}
+
+	// Instruction after the last agreeing state, then the state it left behind
+	start(ref, test);
+	runSlices(*ref, *test, good, interval);
+	report.executed = good;
+	report.pc = ref->getCoreRegisters()[15];
+	report.opcode = ref->getMemPtr()->fetch_halfword(report.pc);
+	start(ref, test);
+	runSlices(*ref, *test, bad, interval);
+	report.diverged = true;
+	if (compare(*ref, *test, report))
+		report.differences.push_back("divergence did not reproduce on replay");
+	return report;
+}
+
+void CM0P_Lockstep::printReport(Report &report) {
+	if (!report.diverged) {
+		printf("[LOCKSTEP] No divergence in %lu instructions.\n", (unsigned long)report.executed);
+		return;
+	}
+	printf("[LOCKSTEP] Divergence after %lu instructions at PC 0x%08x (opcode 0x%04x):\n",
+		(unsigned long)report.executed, report.pc, report.opcode);
+	for (auto &it: report.differences) {
+		printf("  %s\n", it.c_str());
+	}
+}
@@ -0,0 +1,55 @@
+#ifndef CORTEXM0P_LOCKSTEP_H
+#define CORTEXM0P_LOCKSTEP_H
+
+#include "cortex-m0p_core.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Runs the stepping interpreter and the fast execution path (run()) side by side on
+// the same program and compares registers, flags and written memory between them.
+class CM0P_Lockstep {
+	public:
+		struct Report {
+			bool diverged = false;
+			uint64_t executed = 0;			// Instructions both engines agreed on
+			uint32_t pc = 0;				// Address of the diverging instruction
+			uint16_t opcode = 0;
+			vector<string> differences;		// One line per differing register, flag or byte
+		};
+
+		// Creates a fresh core with the program loaded
+		typedef function<CM0P_Core*()> CoreFactory;
+
+	private:
+		CoreFactory makeRef, makeTest;
+		// Written memory already compared equal, per core
+		uint64_t refGenChecked = 0, testGenChecked = 0;
+
+		// Compare both cores; differences are added to the report
+		bool compare(CM0P_Core &ref, CM0P_Core &test, Report &report);
+		// Advance both cores by up to n instructions; returns number run, 0 once halted
+		uint64_t advance(CM0P_Core &ref, CM0P_Core &test, uint64_t n);
+		// Replace both cores with fresh ones
+		void start(unique_ptr<CM0P_Core> &ref, unique_ptr<CM0P_Core> &test);
+		// Advance both cores by count instructions in slices of interval, as the coarse
+		// pass does; returns number run
+		uint64_t runSlices(CM0P_Core &ref, CM0P_Core &test, uint64_t count, uint64_t interval);
+
+	public:
+		CM0P_Lockstep(CoreFactory makeRef, CoreFactory makeTest);
+
+		// Compare every interval instructions for up to maxInsts instructions.
+		// On divergence the failing interval is halved by replaying both engines
+		// from the start until the first differing instruction is found. Blocks and
+		// compiled code run whole, so within them this is the last instruction run.
+		Report run(uint64_t maxInsts, uint64_t interval);
+
+		static void printReport(Report &report);
+};
+
+#endif
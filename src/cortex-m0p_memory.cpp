@@ -1,46 +1,395 @@
 #include "cortex-m0p_memory.h"
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#ifdef CM0P_MEM_HEATMAP
+#define COUNT_ACCESS(address, write) countAccess(address, write)
+#else
+#define COUNT_ACCESS(address, write)
+#endif
+
+// Unwatched memory only pays for a load of the page's watch count
+#define CHECK_WATCH(address, width, write, value) \
+	if (address < size and pageWatches[address >> PAGE_BITS] != 0) \
+		checkWatch(address, width, write, value)
+
+void CM0P_Memory::countAccess(uint32_t address, bool write) {
+	if (!HEATMAP or address >= size)
+		return;
+	uint64_t* &lines = heatPages[address >> PAGE_BITS];
+	// Counters of a page are only allocated once it is accessed
+	if (lines == nullptr)
+		lines = (uint64_t*)calloc(2 << (PAGE_BITS - HEATMAP_LINE_BITS), sizeof(uint64_t));
+	lines[((address & (PAGE_SIZE - 1)) >> HEATMAP_LINE_BITS) * 2 + write]++;
+}
 
 BYTE CM0P_Memory:: read_byte(uint32_t address) {
+	COUNT_ACCESS(address, false);
+	CHECK_WATCH(address, 1, false, 0);
+	return peek_byte(address);
+}
+
+HALFWORD CM0P_Memory:: read_halfword(uint32_t address) {
+	COUNT_ACCESS(address, false);
+	CHECK_WATCH(address, 2, false, 0);
+	return peek_halfword(address);
+}
+
+WORD CM0P_Memory:: read_word(uint32_t address) {
+	COUNT_ACCESS(address, false);
+	CHECK_WATCH(address, 4, false, 0);
+	return peek_word(address);
+}
+
+HALFWORD CM0P_Memory:: fetch_halfword(uint32_t address) {
+	COUNT_ACCESS(address, false);
+	return peek_halfword(address);
+}
+
+BYTE CM0P_Memory:: peek_byte(uint32_t address) {
 	if (address >= size)
 		return 0;
 	return memory[address];
 }
 
-HALFWORD CM0P_Memory:: read_halfword(uint32_t address) {
-	return read_byte(address) << 8 | read_byte(address+1);
+HALFWORD CM0P_Memory:: peek_halfword(uint32_t address) {
+	if (address < size - 1)
+		return memory[address] << 8 | memory[address+1];
+	return peek_byte(address) << 8 | peek_byte(address+1);
 }
 
-WORD CM0P_Memory:: read_word(uint32_t address) {
-	return read_halfword(address) << 16 | read_halfword(address+2);
+WORD CM0P_Memory:: peek_word(uint32_t address) {
+	if (address < size - 3)
+		return memory[address] << 24 | memory[address+1] << 16 | memory[address+2] << 8 | memory[address+3];
+	return peek_halfword(address) << 16 | peek_halfword(address+2);
 }
 
 
 void CM0P_Memory:: write_byte(uint32_t address, BYTE data) {
-	if (address < size)
-		memory[address] = data;
+	COUNT_ACCESS(address, true);
+	CHECK_WATCH(address, 1, true, data);
+	uint64_t g = generation + 1;
+	store_byte(address, data, g);
 }
 
 void CM0P_Memory:: write_halfword(uint32_t address, HALFWORD data) {
-	write_byte(address, data >> 8);
-	write_byte(address+1, data & 0xFF);
+	COUNT_ACCESS(address, true);
+	CHECK_WATCH(address, 2, true, data);
+	uint64_t g = generation + 1;
+	store_byte(address, data >> 8, g);
+	store_byte(address+1, data & 0xFF, g);
 }
 
 void CM0P_Memory:: write_word(uint32_t address, WORD data) {
-	write_halfword(address, data >> 16);
-	write_halfword(address+2, data & 0xFFFF);
+	COUNT_ACCESS(address, true);
+	CHECK_WATCH(address, 4, true, data);
+	uint64_t g = generation + 1;
+	store_byte(address, data >> 24, g);
+	store_byte(address+1, data >> 16, g);
+	store_byte(address+2, data >> 8, g);
+	store_byte(address+3, data & 0xFF, g);
+}
+
+void CM0P_Memory:: store_byte(uint32_t address, BYTE data, uint64_t g) {
+	if (address < size) {
+		memory[address] = data;
+		pageGeneration[address >> PAGE_BITS] = generation = g;
+	}
+	if (address - codeBase < codeSize)
+		codeWrites++;
+}
+
+void CM0P_Memory:: write_block(uint32_t address, const BYTE* data, uint32_t length) {
+	if (address >= size or length == 0)
+		return;
+	if (length > size - address)
+		length = size - address;
+	memcpy(memory + address, data, length);
+#ifdef CM0P_MEM_HEATMAP
+	for (uint32_t line=address>>HEATMAP_LINE_BITS; line<=(address+length-1)>>HEATMAP_LINE_BITS; line++) {
+		countAccess(line << HEATMAP_LINE_BITS, true);
+	}
+#endif
+	generation++;
+	for (uint32_t page=address>>PAGE_BITS; page<=(address+length-1)>>PAGE_BITS; page++) {
+		pageGeneration[page] = generation;
+	}
+	// Overlaps the code region
+	if (address < codeBase + codeSize and codeBase < address + length)
+		codeWrites++;
 }
 
 CM0P_Memory::CM0P_Memory() {
-	// memory = (uint32_t*)calloc(size, sizeof(uint32_t));
-	memory = new uint8_t[size]();		// Zero init memory
+	// Zero init memory; pages are only backed once touched
+	memory = (uint8_t*)calloc(size, sizeof(uint8_t));
+	pageGeneration = (uint64_t*)calloc(size >> PAGE_BITS, sizeof(uint64_t));
+	pageWatches = (uint16_t*)calloc(size >> PAGE_BITS, sizeof(uint16_t));
+#ifdef CM0P_MEM_HEATMAP
+	heatPages = (uint64_t**)calloc(size >> PAGE_BITS, sizeof(uint64_t*));
+#endif
 }
 
 CM0P_Memory::~CM0P_Memory() {
 	free(memory);
+	free(pageGeneration);
+	free(pageWatches);
+#ifdef CM0P_MEM_HEATMAP
+	for (int page=0; page<getPageCount(); page++) {
+		free(heatPages[page]);
+	}
+	free(heatPages);
+#endif
 }
 
 int CM0P_Memory::getSize() {
 	return size;
 }
 
+void CM0P_Memory::setCodeRegion(uint32_t base, uint32_t size) {
+	codeBase = base;
+	codeSize = size;
+}
+
+uint32_t CM0P_Memory::getCodeWrites() {
+	return codeWrites;
+}
+
+uint64_t CM0P_Memory::getGeneration() {
+	return generation;
+}
+
+uint64_t CM0P_Memory::getPageGeneration(uint32_t page) {
+	return pageGeneration[page];
+}
+
+bool CM0P_Memory::changedSince(uint32_t address, uint32_t length, uint64_t g) {
+	if (address >= size or length == 0)
+		return false;
+	if (length > size - address)
+		length = size - address;
+	for (uint32_t page=address>>PAGE_BITS; page<=(address+length-1)>>PAGE_BITS; page++) {
+		if (pageGeneration[page] > g)
+			return true;
+	}
+	return false;
+}
+
+int CM0P_Memory::getPageCount() {
+	return size >> PAGE_BITS;
+}
+
+uint64_t CM0P_Memory::getReadCount(uint32_t address) {
+	if (!HEATMAP or address >= size or heatPages[address >> PAGE_BITS] == nullptr)
+		return 0;
+	return heatPages[address >> PAGE_BITS][((address & (PAGE_SIZE - 1)) >> HEATMAP_LINE_BITS) * 2];
+}
+
+uint64_t CM0P_Memory::getWriteCount(uint32_t address) {
+	if (!HEATMAP or address >= size or heatPages[address >> PAGE_BITS] == nullptr)
+		return 0;
+	return heatPages[address >> PAGE_BITS][((address & (PAGE_SIZE - 1)) >> HEATMAP_LINE_BITS) * 2 + 1];
+}
+
+bool CM0P_Memory::writeHeatmap(string path) {
+	if (!HEATMAP)
+		return false;
+	FILE* file = fopen(path.c_str(), "w");
+	if (file == nullptr)
+		return false;
+	fprintf(file, "address,reads,writes\n");
+	for (int page=0; page<getPageCount(); page++) {
+		if (heatPages[page] == nullptr)
+			continue;
+		for (uint32_t line=0; line<(PAGE_SIZE >> HEATMAP_LINE_BITS); line++) {
+			uint64_t reads = heatPages[page][line*2], writes = heatPages[page][line*2 + 1];
+			if (reads or writes)
+				fprintf(file, "0x%08x,%lu,%lu\n", (page << PAGE_BITS) + (line << HEATMAP_LINE_BITS), (unsigned long)reads, (unsigned long)writes);
+		}
+	}
+	return fclose(file) == 0;
+}
+
+const BYTE* CM0P_Memory::getPage(uint32_t page) {
+	return memory + ((size_t)page << PAGE_BITS);
+}
+
+// Bit i set if the width-aligned group of bytes at chunk[i] equals pattern under mask;
+// pattern and mask hold the value repeated over 16 bytes
+static inline uint32_t matchChunk(const BYTE* chunk, const BYTE* pattern, const BYTE* mask, int width) {
+#ifdef __SSE2__
+	__m128i data = _mm_loadu_si128((const __m128i*)chunk);
+	data = _mm_and_si128(data, _mm_loadu_si128((const __m128i*)mask));
+	uint32_t m = _mm_movemask_epi8(_mm_cmpeq_epi8(data, _mm_loadu_si128((const __m128i*)pattern)));
+#else
+	uint32_t m = 0;
+	for (int i=0; i<16; i++) {
+		if ((chunk[i] & mask[i]) == pattern[i])
+			m |= 1 << i;
+	}
+#endif
+	// Every byte of a group must match
+	if (width == 2)
+		m &= (m >> 1) & 0x5555;
+	else if (width == 4)
+		m &= (m >> 1) & (m >> 2) & (m >> 3) & 0x1111;
+	return m;
+}
+
+bool CM0P_Memory::search(uint32_t start, uint32_t value, uint32_t mask, int width, bool backward, uint32_t &found) {
+	if (width != 1 and width != 2 and width != 4)
+		return false;
+	// Guest memory is big-endian
+	BYTE pattern[16], maskBytes[16];
+	for (int i=0; i<16; i++) {
+		int shift = (width - 1 - i % width) * 8;
+		maskBytes[i] = mask >> shift;
+		pattern[i] = (value & mask) >> shift;
+	}
+	// Pages never written hold zeros and are not read
+	uint32_t widthMask = width == 4 ? 0xFFFFFFFF : (1u << (width * 8)) - 1;
+	bool zeroMatches = (value & mask & widthMask) == 0;
+
+	if (!backward) {
+		uint64_t addr = ((uint64_t)start + width - 1) & ~(uint64_t)(width - 1);
+		for (uint64_t page=addr>>PAGE_BITS; page<(uint64_t)getPageCount(); page++) {
+			uint32_t pageStart = page << PAGE_BITS;
+			uint32_t from = addr > pageStart ? addr - pageStart : 0;
+			if (!pageWritten(page)) {
+				if (!zeroMatches)
+					continue;
+				found = pageStart + from;
+				return true;
+			}
+			for (uint32_t chunk=from&~15; chunk<PAGE_SIZE; chunk+=16) {
+				uint32_t m = matchChunk(memory + pageStart + chunk, pattern, maskBytes, width);
+				if (chunk < from)
+					m &= ~0u << (from - chunk);
+				if (m != 0) {
+					found = pageStart + chunk + __builtin_ctz(m);
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	uint32_t addr = (start < (uint32_t)size ? start : size - 1) & ~(uint32_t)(width - 1);
+	for (int64_t page=addr>>PAGE_BITS; page>=0; page--) {
+		uint32_t pageStart = page << PAGE_BITS;
+		uint32_t to = addr - pageStart < PAGE_SIZE ? addr - pageStart : PAGE_SIZE - 1;
+		if (!pageWritten(page)) {
+			if (!zeroMatches)
+				continue;
+			found = pageStart + (to & ~(uint32_t)(width - 1));
+			return true;
+		}
+		for (int64_t chunk=to&~15; chunk>=0; chunk-=16) {
+			uint32_t m = matchChunk(memory + pageStart + chunk, pattern, maskBytes, width);
+			if (chunk + 15 > to)
+				m &= (2u << (to - chunk)) - 1;
+			if (m != 0) {
+				found = pageStart + chunk + 31 - __builtin_clz(m);
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+void CM0P_Memory::checkWatch(uint32_t address, int width, bool write, uint32_t value) {
+	uint32_t old = width == 1 ? peek_byte(address) : width == 2 ? peek_halfword(address) : peek_word(address);
+	for (Watchpoint &watch: watchpoints) {
+		// Overlapping bytes only
+		if (address >= watch.address + watch.length or watch.address >= address + width)
+			continue;
+		bool hit = write ? (watch.kinds & WATCH_WRITE) : (watch.kinds & WATCH_READ);
+		if (write and !hit and (watch.kinds & WATCH_CHANGE)) {
+			// Compare the watched bytes only, most significant byte at the lowest address
+			for (int i=0; i<width; i++) {
+				uint32_t byteAddr = address + i;
+				int shift = (width - 1 - i) * 8;
+				if (byteAddr >= watch.address and byteAddr - watch.address < watch.length
+						and ((old >> shift) & 0xFF) != ((value >> shift) & 0xFF))
+					hit = true;
+			}
+		}
+		if (!hit)
+			continue;
+		watch.hits++;
+		watchHits++;
+		lastWatchHit = {watch.address, address, width, write, old, write ? value : old};
+		return;
+	}
+}
+
+void CM0P_Memory::markWatchPages(const Watchpoint &watch, int delta) {
+	uint32_t first = watch.address < 3 ? 0 : watch.address - 3;
+	for (uint32_t page=first>>PAGE_BITS; page<=(watch.address+watch.length-1)>>PAGE_BITS; page++) {
+		pageWatches[page] += delta;
+	}
+}
+
+bool CM0P_Memory::addWatchpoint(uint32_t address, uint32_t length, uint8_t kinds) {
+	if (address >= size or length == 0 or length > size - address or kinds == 0)
+		return false;
+	removeWatchpoint(address);
+	Watchpoint watch;
+	watch.address = address;
+	watch.length = length;
+	watch.kinds = kinds;
+	watchpoints.push_back(watch);
+	markWatchPages(watch, 1);
+	return true;
+}
+
+bool CM0P_Memory::removeWatchpoint(uint32_t address) {
+	for (size_t i=0; i<watchpoints.size(); i++) {
+		if (watchpoints[i].address == address) {
+			markWatchPages(watchpoints[i], -1);
+			watchpoints.erase(watchpoints.begin() + i);
+			return true;
+		}
+	}
+	return false;
+}
+
+const vector<CM0P_Memory::Watchpoint>& CM0P_Memory::getWatchpoints() {
+	return watchpoints;
+}
+
+bool CM0P_Memory::isWatched(uint32_t address, uint32_t length) {
+	if (address >= size or pageWatches[address >> PAGE_BITS] == 0)
+		return false;
+	for (const Watchpoint &watch: watchpoints) {
+		if (address < watch.address + watch.length and watch.address < address + length)
+			return true;
+	}
+	return false;
+}
+
+uint8_t CM0P_Memory::parseWatchKinds(const string &text) {
+	uint8_t kinds = 0;
+	for (char c: text) {
+		if (c == 'r')
+			kinds |= WATCH_READ;
+		else if (c == 'w')
+			kinds |= WATCH_WRITE;
+		else if (c == 'c')
+			kinds |= WATCH_CHANGE;
+		else
+			return 0;
+	}
+	return kinds;
+}
+
+uint32_t CM0P_Memory::getWatchHits() {
+	return watchHits;
+}
+
+const CM0P_Memory::WatchHit& CM0P_Memory::getLastWatchHit() {
+	return lastWatchHit;
+}
@@ -3,8 +3,17 @@
 
 #include <cstdint>
 #include <string>
+#include <vector>
 #include <exception>
 
+using namespace std;
+
+// Build with -DCM0P_MEM_HEATMAP (make heatmap) to count reads and writes per line of
+// 1 << CM0P_MEM_HEATMAP_LINE_BITS bytes; without it the counting compiles away
+#ifndef CM0P_MEM_HEATMAP_LINE_BITS
+#define CM0P_MEM_HEATMAP_LINE_BITS 6
+#endif
+
 using WORD = uint32_t;
 using HALFWORD = uint16_t;
 using BYTE = uint8_t;
@@ -19,20 +28,131 @@ class CM0P_Memory {
 		void check_endian();
 		// Check address validity; Called by all read and write functions
 		bool valid_address(uint32_t address);
+		// Region holding program code; writes into it are counted
+		uint32_t codeBase = 0;
+		uint32_t codeSize = 0;
+		uint32_t codeWrites = 0;
+		// Generation of the last write into each page; 0 if never written. 64 bits so the
+		// counter never wraps back to values already handed out
+		uint64_t* pageGeneration;
+		uint64_t generation = 0;
+		// Every store stamps its page with a generation of at least 1, and the 64-bit
+		// counter does not wrap, so a page still at 0 holds only zeros
+		bool pageWritten(uint32_t page) {
+			return pageGeneration[page] != 0;
+		}
+		// Per page, reads and writes of each heatmap line; nullptr until accessed
+		uint64_t** heatPages = nullptr;
+
+		void countAccess(uint32_t address, bool write);
+		// Store a byte of a write call that moves the generation to g; all bytes of one
+		// call share g, and calls that land outside memory do not advance it
+		void store_byte(uint32_t address, BYTE data, uint64_t g);
+
 	public:
+		enum WatchKind : uint8_t {
+			WATCH_READ = 1,
+			WATCH_WRITE = 2,
+			WATCH_CHANGE = 4		// Writes that change the watched bytes
+		};
+		struct Watchpoint {
+			uint32_t address;
+			uint32_t length;
+			uint8_t kinds;			// WatchKind bits
+			uint64_t hits = 0;
+		};
+		// Access that triggered a watchpoint
+		struct WatchHit {
+			uint32_t watchAddress;	// Start of the watchpoint
+			uint32_t address;		// Accessed address and width in bytes
+			int width;
+			bool write;
+			uint32_t oldValue;		// Value before the access
+			uint32_t value;			// Value read or written
+		};
+
+	private:
+		// Watchpoints per page, counting those reaching up to 3 bytes before the page so
+		// accesses starting there are caught; only accesses to marked pages are compared
+		uint16_t* pageWatches;
+		vector<Watchpoint> watchpoints;
+		uint32_t watchHits = 0;
+		WatchHit lastWatchHit = {};
+
+		// Compare an access on a marked page with the watchpoints
+		void checkWatch(uint32_t address, int width, bool write, uint32_t value);
+		void markWatchPages(const Watchpoint &watch, int delta);
+
+	public:
+		// Size of a page used for change tracking
+		const static int PAGE_BITS = 12;
+		const static int PAGE_SIZE = 1 << PAGE_BITS;
+
+#ifdef CM0P_MEM_HEATMAP
+		const static bool HEATMAP = true;
+#else
+		const static bool HEATMAP = false;
+#endif
+		const static int HEATMAP_LINE_BITS = CM0P_MEM_HEATMAP_LINE_BITS;
+
 		// Read data inside memory
 		BYTE		read_byte(uint32_t address);
 		HALFWORD	read_halfword(uint32_t address);
 		WORD		read_word(uint32_t address);
+		// Read an instruction; never triggers watchpoints
+		HALFWORD	fetch_halfword(uint32_t address);
+		// Read without counting an access, for views of memory
+		BYTE		peek_byte(uint32_t address);
+		HALFWORD	peek_halfword(uint32_t address);
+		WORD		peek_word(uint32_t address);
 		// Write data to memory
 		void		write_byte(uint32_t address, BYTE data);
 		void		write_halfword(uint32_t address, HALFWORD data);
 		void		write_word(uint32_t address, WORD data);
+		// Copy bytes already laid out in guest order; counts as one write per page touched
+		void		write_block(uint32_t address, const BYTE* data, uint32_t length);
 		// Constructor
 		CM0P_Memory();
 		// Deconstructor
 		~CM0P_Memory();
 
 		int getSize();
+		// Set region holding program code to watch for self-modifying writes
+		void setCodeRegion(uint32_t base, uint32_t size);
+		// Number of writes made into the code region so far
+		uint32_t getCodeWrites();
+
+		// Generation counter bumped by every write call
+		uint64_t getGeneration();
+		// Generation of the last write into a page; pages changed since generation g have a larger value
+		uint64_t getPageGeneration(uint32_t page);
+		// True if a page overlapping [address, address+length) was written after generation g
+		bool changedSince(uint32_t address, uint32_t length, uint64_t g);
+		int getPageCount();
+		// Find the first address from start on, or the last one up to start going backward,
+		// where a byte, halfword or word (width 1, 2, 4) equals value under mask. Only
+		// multiples of width are checked. Pages never written are not read. False if none
+		bool search(uint32_t start, uint32_t value, uint32_t mask, int width, bool backward, uint32_t &found);
+		// Reads and writes of the heatmap line holding address; 0 without CM0P_MEM_HEATMAP
+		uint64_t getReadCount(uint32_t address);
+		uint64_t getWriteCount(uint32_t address);
+		// Write the counts of every accessed line as CSV; False without CM0P_MEM_HEATMAP
+		bool writeHeatmap(string path);
+		// Read-only view of a page for bulk comparison
+		const BYTE* getPage(uint32_t page);
+
+		// Watch reads, writes or changes of [address, address+length) by read_* and write_*,
+		// replacing a watchpoint starting at the same address; False outside memory
+		bool addWatchpoint(uint32_t address, uint32_t length, uint8_t kinds);
+		// False if no watchpoint starts at address
+		bool removeWatchpoint(uint32_t address);
+		const vector<Watchpoint>& getWatchpoints();
+		// True if a watchpoint covers part of [address, address+length)
+		bool isWatched(uint32_t address, uint32_t length);
+		// WatchKind bits of letters r, w and c such as "rw"; 0 if invalid
+		static uint8_t parseWatchKinds(const string &text);
+		// Accesses that triggered a watchpoint so far, and the last of them
+		uint32_t getWatchHits();
+		const WatchHit& getLastWatchHit();
 };
 #endif
@@ -0,0 +1,295 @@
+#include "cortex-m0p_probe.h"
+#include "cortex-m0p_core.h"
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+// Binary operators by precedence, loosest first
+struct BinaryOp {
+	const char* token;
+	CM0P_Expr::Op op;
+};
+static const vector<vector<BinaryOp>> BINARY_LEVELS = {
+	{{"||", CM0P_Expr::LOR}},
+	{{"&&", CM0P_Expr::LAND}},
+	{{"|", CM0P_Expr::OR}},
+	{{"^", CM0P_Expr::XOR}},
+	{{"&", CM0P_Expr::AND}},
+	{{"==", CM0P_Expr::EQ}, {"!=", CM0P_Expr::NE}},
+	{{"<=", CM0P_Expr::LE}, {">=", CM0P_Expr::GE}, {"<", CM0P_Expr::LT}, {">", CM0P_Expr::GT}},
+	{{"<<", CM0P_Expr::SHL}, {">>", CM0P_Expr::SHR}},
+	{{"+", CM0P_Expr::ADD}, {"-", CM0P_Expr::SUB}},
+	{{"*", CM0P_Expr::MUL}}
+};
+
+void CM0P_Expr::emit(Op op, uint32_t arg, int pushed) {
+	code.push_back({op, arg});
+	depth += pushed;
+	if (depth > maxDepth)
+		maxDepth = depth;
+}
+
+void CM0P_Expr::skipSpace() {
+	while (isspace((unsigned char)*pos)) {
+		pos++;
+	}
+}
+
+bool CM0P_Expr::accept(const char* token) {
+	skipSpace();
+	size_t len = strlen(token);
+	if (strncmp(pos, token, len) != 0)
+		return false;
+	// A single | & < > is not the start of a doubled operator
+	if (len == 1 and strchr("|&<>", token[0]) and pos[1] == token[0])
+		return false;
+	pos += len;
+	return true;
+}
+
+void CM0P_Expr::parseBinary(int level) {
+	if (level == (int)BINARY_LEVELS.size()) {
+		parseUnary();
+		return;
+	}
+	parseBinary(level + 1);
+	while (error.empty()) {
+		const BinaryOp* found = nullptr;
+		for (const BinaryOp &it: BINARY_LEVELS[level]) {
+			if (accept(it.token)) {
+				found = &it;
+				break;
+			}
+		}
+		if (found == nullptr)
+			return;
+		parseBinary(level + 1);
+		emit(found->op, 0, -1);
+	}
+}
+
+void CM0P_Expr::parseUnary() {
+	if (accept("-")) {
+		parseUnary();
+		emit(NEG, 0, 0);
+	}
+	else if (accept("!")) {
+		parseUnary();
+		emit(NOT, 0, 0);
+	}
+	else if (accept("~")) {
+		parseUnary();
+		emit(INV, 0, 0);
+	}
+	else {
+		parsePrimary();
+	}
+}
+
+void CM0P_Expr::parsePrimary() {
+	skipSpace();
+	if (!error.empty())
+		return;
+	if (accept("(")) {
+		parseBinary(0);
+		if (error.empty() and !accept(")"))
+			error = "Missing )";
+		return;
+	}
+	if (isdigit((unsigned char)*pos)) {
+		bool hex = pos[0] == '0' and (pos[1] == 'x' or pos[1] == 'X');
+		char* end;
+		unsigned long long value = strtoull(pos, &end, hex ? 16 : 10);
+		if (value > 0xFFFFFFFF or isalnum((unsigned char)*end)) {
+			error = "Invalid number " + string(pos, end - pos);
+			return;
+		}
+		pos = end;
+		emit(PUSH, value, 1);
+		return;
+	}
+
+	string name;
+	while (isalnum((unsigned char)*pos) or *pos == '_') {
+		name += tolower(*pos++);
+	}
+	if (name.empty()) {
+		error = *pos ? string("Unexpected ") + *pos : "Unexpected end";
+		return;
+	}
+	if (name == "mem8" or name == "mem16" or name == "mem32") {
+		if (!accept("[")) {
+			error = "Missing [ after " + name;
+			return;
+		}
+		parseBinary(0);
+		if (error.empty() and !accept("]"))
+			error = "Missing ]";
+		emit(name == "mem8" ? MEM8 : name == "mem16" ? MEM16 : MEM32, 0, 0);
+		return;
+	}
+	if (name == "sp" or name == "lr" or name == "pc") {
+		emit(REG, name == "sp" ? 13 : name == "lr" ? 14 : 15, 1);
+		return;
+	}
+	if (name.size() == 1 and strchr("nzcv", name[0])) {
+		emit(FLAG, toupper(name[0]), 1);
+		return;
+	}
+	if (name[0] == 'r' and name.size() > 1 and name.size() <= 3 and isdigit((unsigned char)name[1])) {
+		int reg = atoi(name.c_str() + 1);
+		if (reg <= 15 and to_string(reg) == name.substr(1)) {
+			emit(REG, reg, 1);
+			return;
+		}
+	}
+	error = "Unknown name " + name;
+}
+
+bool CM0P_Expr::parse(const string &text, string &error) {
+	code.clear();
+	size_t first = text.find_first_not_of(" \t");
+	this -> text = first == string::npos ? "" : text.substr(first, text.find_last_not_of(" \t") - first + 1);
+	this -> error = "";
+	pos = this->text.c_str();
+	depth = maxDepth = 0;
+	parseBinary(0);
+	skipSpace();
+	if (this->error.empty() and *pos != '\0')
+		this -> error = string("Unexpected ") + *pos;
+	if (this->error.empty() and maxDepth > MAX_DEPTH)
+		this -> error = "Expression too deep";
+	if (this->error.empty() and code.empty())
+		this -> error = "Empty expression";
+	pos = nullptr;
+	error = this -> error;
+	if (!error.empty()) {
+		code.clear();
+		this -> text = "";
+		return false;
+	}
+	return true;
+}
+
+uint32_t CM0P_Expr::eval(CM0P_Core &core) const {
+	uint32_t stack[MAX_DEPTH];
+	int top = -1;
+	uint32_t* R = core.getCoreRegisters();
+	CM0P_Memory* mem = core.getMemPtr();
+	for (const Inst &inst: code) {
+		uint32_t b = top >= 0 ? stack[top] : 0;
+		// Binary operators leave their result in place of the left operand
+		uint32_t &a = stack[top > 0 ? top - 1 : 0];
+		switch (inst.op) {
+			case PUSH:	stack[++top] = inst.arg; break;
+			case REG:	stack[++top] = R[inst.arg]; break;
+			case FLAG:	stack[++top] = core.get_flag(inst.arg); break;
+			case MEM8:	stack[top] = mem->peek_byte(b); break;
+			case MEM16:	stack[top] = mem->peek_halfword(b); break;
+			case MEM32:	stack[top] = mem->peek_word(b); break;
+			case NEG:	stack[top] = -b; break;
+			case NOT:	stack[top] = !b; break;
+			case INV:	stack[top] = ~b; break;
+			case MUL:	a = a * b; top--; break;
+			case ADD:	a = a + b; top--; break;
+			case SUB:	a = a - b; top--; break;
+			case SHL:	a = b < 32 ? a << b : 0; top--; break;
+			case SHR:	a = b < 32 ? a >> b : 0; top--; break;
+			case LT:	a = a < b; top--; break;
+			case LE:	a = a <= b; top--; break;
+			case GT:	a = a > b; top--; break;
+			case GE:	a = a >= b; top--; break;
+			case EQ:	a = a == b; top--; break;
+			case NE:	a = a != b; top--; break;
+			case AND:	a = a & b; top--; break;
+			case XOR:	a = a ^ b; top--; break;
+			case OR:	a = a | b; top--; break;
+			case LAND:	a = a and b; top--; break;
+			case LOR:	a = a or b; top--; break;
+		}
+	}
+	return top >= 0 ? stack[top] : 0;
+}
+
+bool CM0P_Expr::empty() const {
+	return code.empty();
+}
+
+const string& CM0P_Expr::getText() const {
+	return text;
+}
+
+// Position of a top-level "if" keyword, or npos
+static size_t findIf(const string &spec) {
+	int nesting = 0;
+	for (size_t i=0; i<spec.size(); i++) {
+		char c = spec[i];
+		if (c == '(' or c == '[')
+			nesting++;
+		else if (c == ')' or c == ']')
+			nesting--;
+		else if (nesting == 0 and spec.compare(i, 2, "if") == 0
+				and (i == 0 or isspace((unsigned char)spec[i-1]))
+				and (i + 2 == spec.size() or isspace((unsigned char)spec[i+2]) or spec[i+2] == '('))
+			return i;
+	}
+	return string::npos;
+}
+
+static bool isBlank(const string &text) {
+	for (char c: text) {
+		if (!isspace((unsigned char)c))
+			return false;
+	}
+	return true;
+}
+
+bool CM0P_Probe::parse(const string &spec, bool stop, string &error) {
+	this -> stop = stop;
+	condition = CM0P_Expr();
+	values.clear();
+	hits = 0;
+
+	size_t at = findIf(spec);
+	string list = spec.substr(0, at);
+	if (at != string::npos and !condition.parse(spec.substr(at + 2), error)) {
+		error = "Condition: " + error;
+		return false;
+	}
+	if (isBlank(list))
+		return true;
+	if (stop) {
+		error = "Breakpoints only take a condition";
+		return false;
+	}
+
+	// Values are separated by top-level commas
+	int nesting = 0;
+	size_t start = 0;
+	for (size_t i=0; i<=list.size(); i++) {
+		char c = i < list.size() ? list[i] : ',';
+		if (c == '(' or c == '[')
+			nesting++;
+		else if (c == ')' or c == ']')
+			nesting--;
+		else if (c == ',' and nesting == 0) {
+			if (values.size() == TRACE_VALUES) {
+				error = "At most " + to_string(TRACE_VALUES) + " values";
+				return false;
+			}
+			values.emplace_back();
+			if (!values.back().parse(list.substr(start, i - start), error)) {
+				error = "Value " + to_string(values.size()) + ": " + error;
+				return false;
+			}
+			start = i + 1;
+		}
+	}
+	return true;
+}
+
+char CM0P_Probe::kind() const {
+	if (!stop)
+		return 'T';
+	return condition.empty() ? 'B' : 'C';
+}
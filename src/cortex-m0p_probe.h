@@ -0,0 +1,113 @@
+#ifndef CORTEXM0P_PROBE_H
+#define CORTEXM0P_PROBE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class CM0P_Core;
+
+// Expression over the core state such as `r0 == 0x20 && mem32[sp+4] > 100`, parsed once
+// into bytecode for a small stack machine. Values are unsigned 32-bit; comparisons and
+// logic operators give 0 or 1.
+//
+// Operands: numbers (decimal or 0x hex), r0-r15, sp, lr, pc, the flags n, z, c, v and
+// mem8[], mem16[], mem32[] of an address expression. Operators in C precedence:
+// unary - ! ~, * + - << >> < <= > >= == != & ^ | && ||, and parentheses.
+class CM0P_Expr {
+	public:
+		enum Op : uint8_t {
+			PUSH, REG, FLAG, MEM8, MEM16, MEM32,
+			NEG, NOT, INV,
+			MUL, ADD, SUB, SHL, SHR, LT, LE, GT, GE, EQ, NE, AND, XOR, OR, LAND, LOR
+		};
+		// Deepest stack an expression may need
+		const static int MAX_DEPTH = 32;
+
+	private:
+		struct Inst {
+			Op op;
+			uint32_t arg;		// Value of PUSH, register of REG, flag of FLAG
+		};
+		vector<Inst> code;
+		string text;
+
+		// Recursive descent state, only used while parsing
+		const char* pos = nullptr;
+		string error;
+		int depth = 0, maxDepth = 0;
+
+		void emit(Op op, uint32_t arg, int pushed);
+		void skipSpace();
+		bool accept(const char* token);
+		void parseBinary(int level);
+		void parseUnary();
+		void parsePrimary();
+
+	public:
+		// Replace the expression with text; False with a message in error if it is invalid,
+		// leaving the expression empty
+		bool parse(const string &text, string &error);
+		// Value of the expression in the current state of the core; memory reads are not
+		// counted as guest accesses
+		uint32_t eval(CM0P_Core &core) const;
+		bool empty() const;
+		const string& getText() const;
+};
+
+// Action at a code address: a breakpoint stops the core before the instruction, a
+// tracepoint records values and lets it run. Either may have a condition that must hold.
+struct CM0P_Probe {
+	// Values recorded per tracepoint hit
+	const static int TRACE_VALUES = 4;
+
+	bool stop = true;
+	CM0P_Expr condition;		// Empty to always apply
+	vector<CM0P_Expr> values;	// Recorded by tracepoints
+	uint64_t hits = 0;			// Times the probe applied
+
+	// Parse "[value, ...] [if condition]"; False with a message in error if invalid
+	bool parse(const string &spec, bool stop, string &error);
+	// Short form shown in the assembly window: B breakpoint, C conditional, T tracepoint
+	char kind() const;
+};
+
+// Values recorded by tracepoints; the oldest records are overwritten when full
+class CM0P_TraceBuffer {
+	public:
+		struct Record {
+			uint32_t addr;
+			uint32_t count;			// Values used
+			uint64_t hit;			// Hit number of the tracepoint, from 1
+			uint32_t values[CM0P_Probe::TRACE_VALUES];
+		};
+		const static uint32_t CAPACITY = 4096;
+
+	private:
+		vector<Record> records = vector<Record>(CAPACITY);
+		uint64_t written = 0;
+
+	public:
+		Record& push() {
+			return records[written++ % CAPACITY];
+		}
+		// Records held, at most CAPACITY
+		uint32_t size() const {
+			return written < CAPACITY ? written : CAPACITY;
+		}
+		// Held records from the oldest on
+		const Record& at(uint32_t i) const {
+			return records[(written - size() + i) % CAPACITY];
+		}
+		// Records ever written, including overwritten ones
+		uint64_t getWritten() const {
+			return written;
+		}
+		void clear() {
+			written = 0;
+		}
+};
+
+#endif
@@ -0,0 +1,133 @@
+#include "cortex-m0p_runner.h"
+#include <chrono>
+#include <pthread.h>		// For pthread_getcpuclockid()
+#include <time.h>			// For clock_gettime()
+
+CM0P_Runner::CM0P_Runner(CM0P_Core &core) : core(core) {
+	worker = thread(&CM0P_Runner::loop, this);
+}
+
+CM0P_Runner::~CM0P_Runner() {
+	send(QUIT);
+	release();
+	worker.join();
+}
+
+void CM0P_Runner::loop() {
+	while (true) {
+		Command cmd;
+		while (commands.pop(cmd)) {
+			switch (cmd) {
+				case RUN:
+					// Continuing from a breakpoint runs its instruction first
+					if (core.atBreakpoint() and !core.isHalted()) {
+						core.step_inst();
+						executed.fetch_add(1, memory_order_relaxed);
+					}
+					state.store(core.isHalted() ? HALTED : RUNNING, memory_order_relaxed);
+					break;
+				case PAUSE:
+					if (state.load(memory_order_relaxed) == RUNNING)
+						state.store(PAUSED, memory_order_relaxed);
+					break;
+				case STEP:
+					if (!core.isHalted()) {
+						core.step_inst();
+						executed.fetch_add(1, memory_order_relaxed);
+					}
+					state.store(core.isHalted() ? HALTED : PAUSED, memory_order_relaxed);
+					break;
+				case HOLD:
+					held.store(true, memory_order_release);
+					// Holds are short except while the UI prompts for input
+					for (int spins=0; held.load(memory_order_acquire); spins++) {
+						if (spins < 1000)
+							this_thread::yield();
+						else
+							this_thread::sleep_for(chrono::milliseconds(1));
+					}
+					break;
+				case QUIT:
+					return;
+			}
+		}
+
+		if (state.load(memory_order_relaxed) == RUNNING) {
+			uint64_t n = core.run(SLICE_INSTS);
+			executed.fetch_add(n, memory_order_relaxed);
+			if (core.stoppedAtWatchpoint())
+				state.store(WATCHPOINT, memory_order_relaxed);
+			else if (n < SLICE_INSTS and core.atBreakpoint())
+				state.store(BREAKPOINT, memory_order_relaxed);
+			else if (n < SLICE_INSTS and core.isHalted())
+				state.store(HALTED, memory_order_relaxed);
+		}
+		else {
+			this_thread::sleep_for(chrono::milliseconds(1));
+		}
+	}
+}
+
+void CM0P_Runner::send(Command cmd) {
+	// The queue only fills if the core thread stalls; wait for it rather than drop keys
+	while (!commands.push(cmd)) {
+		this_thread::yield();
+	}
+}
+
+void CM0P_Runner::hold() {
+	if (holding)
+		return;
+	send(HOLD);
+	while (!held.load(memory_order_acquire)) {
+		this_thread::yield();
+	}
+	holding = true;
+}
+
+void CM0P_Runner::release() {
+	if (!holding)
+		return;
+	holding = false;
+	held.store(false, memory_order_release);
+}
+
+bool CM0P_Runner::isRunning() {
+	return state.load(memory_order_relaxed) == RUNNING;
+}
+
+CM0P_Runner::State CM0P_Runner::getState() {
+	return state.load(memory_order_relaxed);
+}
+
+double CM0P_Runner::threadCpuTime() {
+	clockid_t clock;
+	struct timespec ts;
+	if (pthread_getcpuclockid(worker.native_handle(), &clock) != 0 or clock_gettime(clock, &ts) != 0)
+		return 0;
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+CM0P_Runner::Stats CM0P_Runner::sample() {
+	double now = chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+	double cpu = threadCpuTime();
+	Stats stats;
+	stats.state = getState();
+	stats.executed = getExecuted();
+	stats.mips = 0;
+	stats.hostLoad = 0;
+	stats.virtualTime = (double)stats.executed / CLOCK_HZ;
+	double elapsed = now - lastSampleTime;
+	if (lastSampleTime > 0 and elapsed > 0) {
+		stats.mips = (stats.executed - lastSampleExecuted) / elapsed / 1e6;
+		stats.hostLoad = (cpu - lastSampleCpu) / elapsed;
+	}
+	lastSampleTime = now;
+	lastSampleCpu = cpu;
+	lastSampleExecuted = stats.executed;
+	return stats;
+}
+
+uint64_t CM0P_Runner::getExecuted() {
+	return executed.load(memory_order_relaxed);
+}
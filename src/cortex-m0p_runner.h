@@ -0,0 +1,115 @@
+#ifndef CORTEXM0P_RUNNER_H
+#define CORTEXM0P_RUNNER_H
+
+#include "cortex-m0p_core.h"
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+using namespace std;
+
+// Bounded queue for one producer and one consumer thread; never blocks or allocates
+template <typename T, uint32_t N>
+class SPSC_Queue {
+	static_assert((N & (N - 1)) == 0, "Queue size must be a power of two");
+	private:
+		T items[N];
+		alignas(64) atomic<uint32_t> head{0};	// Next item to pop; written by the consumer
+		alignas(64) atomic<uint32_t> tail{0};	// Next free slot; written by the producer
+
+	public:
+		// False if the queue is full
+		bool push(const T &item) {
+			uint32_t t = tail.load(memory_order_relaxed);
+			if (t - head.load(memory_order_acquire) == N)
+				return false;
+			items[t % N] = item;
+			tail.store(t + 1, memory_order_release);
+			return true;
+		}
+		// False if the queue is empty
+		bool pop(T &item) {
+			uint32_t h = head.load(memory_order_relaxed);
+			if (h == tail.load(memory_order_acquire))
+				return false;
+			item = items[h % N];
+			head.store(h + 1, memory_order_release);
+			return true;
+		}
+};
+
+// Runs a core on its own thread so it is not limited by the UI waiting for keys.
+// The UI sends commands through a lock-free queue and holds the core while it reads
+// or changes its state; the core stops at the next slice of instructions and stays
+// still until released, so the UI always sees a consistent state.
+class CM0P_Runner {
+	public:
+		enum Command : uint8_t {
+			RUN,		// Run until paused, halted or at a breakpoint or watchpoint
+			PAUSE,
+			STEP,		// Pause and run a single instruction
+			HOLD,		// Sent by hold()
+			QUIT
+		};
+		enum State : uint8_t {
+			PAUSED,
+			RUNNING,
+			HALTED,		// Next instruction is empty memory
+			BREAKPOINT,	// Stopped before an instruction with a breakpoint
+			WATCHPOINT	// Stopped after an instruction that hit a watchpoint
+		};
+		// Telemetry over the time between two calls to sample()
+		struct Stats {
+			State state;
+			uint64_t executed;		// Instructions run since the runner was started
+			double mips;			// Guest instructions per second, in millions
+			double hostLoad;		// Share of one host CPU used by the core thread
+			double virtualTime;		// Seconds the executed instructions take on the target
+		};
+		// Target clock for virtual time; the core does not model cycles, so every
+		// instruction counts as one cycle
+		const static uint64_t CLOCK_HZ = 125000000;
+
+	private:
+		// Instructions run between checks for commands
+		const static uint64_t SLICE_INSTS = 1 << 16;
+
+		CM0P_Core &core;
+		SPSC_Queue<Command, 64> commands;
+		thread worker;
+
+		atomic<State> state{PAUSED};
+		atomic<bool> held{false};
+		atomic<uint64_t> executed{0};
+		// Only used by the thread calling hold() and sample()
+		bool holding = false;
+		double lastSampleTime = 0, lastSampleCpu = 0;
+		uint64_t lastSampleExecuted = 0;
+
+		// Seconds of CPU time used by the core thread
+		double threadCpuTime();
+
+		void loop();
+
+	public:
+		CM0P_Runner(CM0P_Core &core);
+		// Stops the thread; the core is left as it is
+		~CM0P_Runner();
+		CM0P_Runner(const CM0P_Runner&) = delete;
+		CM0P_Runner& operator=(const CM0P_Runner&) = delete;
+
+		void send(Command cmd);
+		// Wait until the core is stopped; the caller may then use it until release().
+		// Both are called from the same thread; holding twice is the same as once
+		void hold();
+		void release();
+
+		// True while running continuously
+		bool isRunning();
+		State getState();
+		Stats sample();
+		// Instructions run since the runner was started
+		uint64_t getExecuted();
+};
+
+#endif
@@ -0,0 +1,48 @@
+#include "fileWatcher.h"
+#include <sys/inotify.h>
+#include <unistd.h>			// For read(), close()
+
+FileWatcher::FileWatcher(string path) {
+	string dirPath = ".";
+	fileName = path;
+	size_t slash = path.rfind('/');
+	if (slash != string::npos) {
+		dirPath = slash == 0 ? "/" : path.substr(0, slash);
+		fileName = path.substr(slash + 1);
+	}
+
+	fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd < 0)
+		return;
+	wd = inotify_add_watch(fd, dirPath.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+}
+
+FileWatcher::~FileWatcher() {
+	if (fd >= 0)
+		close(fd);
+}
+
+bool FileWatcher::valid() {
+	return fd >= 0 and wd >= 0;
+}
+
+bool FileWatcher::changed() {
+	if (!valid())
+		return false;
+
+	bool found = false;
+	alignas(struct inotify_event) char buf[4096];
+	while (true) {
+		ssize_t len = read(fd, buf, sizeof(buf));
+		// Nothing queued
+		if (len <= 0)
+			break;
+		for (char* pos=buf; pos<buf+len;) {
+			struct inotify_event* event = (struct inotify_event*) pos;
+			if (event->len > 0 and fileName == event->name)
+				found = true;
+			pos += sizeof(struct inotify_event) + event->len;
+		}
+	}
+	return found;
+}
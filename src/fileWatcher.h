@@ -0,0 +1,26 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <string>
+
+using namespace std;
+
+// Watches a single file for changes with inotify. The directory is watched so
+// editors that save by writing a new file and renaming it are seen as well.
+class FileWatcher {
+	private:
+		int fd = -1;
+		int wd = -1;
+		string fileName;
+
+	public:
+		FileWatcher(string path);
+		~FileWatcher();
+
+		// False if inotify is unavailable or the directory cannot be watched
+		bool valid();
+		// True if the file was written or replaced since the last call; never blocks
+		bool changed();
+};
+
+#endif
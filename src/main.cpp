@@ -1,26 +1,280 @@
+#include <chrono>
 #include <iostream>
+#include <memory>
 #include <ncurses.h>
 #include "cortex-m0p_core.h"
+#include "cortex-m0p_lockstep.h"
+#include "cortex-m0p_conformance.h"
+#include "cortex-m0p_runner.h"
 #include "ARMv6_Assembler.h"
+#include "ARMv6_Object.h"
+#include "fileWatcher.h"
 #include "ncursesTUI.h"
 using namespace std;
 
+// Directory shared between runs for translated blocks and assembled objects
+const string TRANSLATION_CACHE_DIR = ".pico_emu_cache";
+// Mismatch database written by --conformance
+const string CONFORMANCE_DB_PATH = "conformance.db";
+// Memory access counts written after headless runs of a heatmap build
+const string HEATMAP_PATH = "heatmap.csv";
+// Values recorded by tracepoints, written after headless runs and on request in the TUI
+const string TRACE_PATH = "trace.log";
+// How often --watch checks the source file while waiting for keys
+const int WATCH_POLL_MS = 200;
+// Time between redraws while the core runs
+const int FRAME_INTERVAL_MS = 33;
+// Time between telemetry samples shown in the status bar
+const int STATS_INTERVAL_MS = 500;
+
 bool universalKeys(int key) {
 	return 1;
 }
 
+// Set a probe from "<label or hex address>[:] [spec]", see CM0P_Probe::parse()
+bool addProbe(CM0P_Core &core, const ARMv6_Program &program, string arg, bool stop, string &error) {
+	size_t end = arg.find_first_of(": \t");
+	string where = arg.substr(0, end);
+	string spec = end == string::npos ? "" : arg.substr(end + (arg[end] == ':'));
+	uint32_t addr;
+	auto label = program.getLabels().find(where);
+	if (label != program.getLabels().end()) {
+		addr = label->second;
+	}
+	else {
+		char* rest;
+		addr = strtoul(where.c_str(), &rest, 16);
+		if (where.empty() or *rest != '\0') {
+			error = "No label " + where;
+			return false;
+		}
+	}
+	CM0P_Probe probe;
+	if (!probe.parse(spec, stop, error))
+		return false;
+	if (!core.setProbe(addr, probe)) {
+		error = "Not an instruction address: " + where;
+		return false;
+	}
+	return true;
+}
+
+// Set a watchpoint from "<kinds>:<hex address>[+<length>]", e.g. "c:1ff0+4"; the length
+// defaults to a word
+bool addWatchpoint(CM0P_Core &core, string arg, string &error) {
+	size_t colon = arg.find(':');
+	uint8_t kinds = colon == string::npos ? 0 : CM0P_Memory::parseWatchKinds(arg.substr(0, colon));
+	if (kinds == 0) {
+		error = "Expected r, w, c or a mix of them before :";
+		return false;
+	}
+	char* rest;
+	uint32_t addr = strtoul(arg.c_str() + colon + 1, &rest, 16);
+	uint32_t length = 4;
+	if (*rest == '+')
+		length = strtoul(rest + 1, &rest, 0);
+	if (rest == arg.c_str() + colon + 1 or *rest != '\0' or !core.setWatchpoint(addr, length, kinds)) {
+		error = "Invalid address or length";
+		return false;
+	}
+	return true;
+}
+
+// Run the core without the TUI and print the final state
+int runHeadless(CM0P_Core &core, uint64_t maxInsts) {
+	auto start = chrono::steady_clock::now();
+	uint64_t executed = 0;
+	while (executed < maxInsts) {
+		uint64_t n = core.run(maxInsts - executed);
+		// Core halted
+		if (n == 0)
+			break;
+		executed += n;
+		if (core.stoppedAtWatchpoint())
+			break;
+	}
+	double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	if (core.atBreakpoint())
+		printf("Stopped at breakpoint 0x%08x\n", core.getCoreRegisters()[15]);
+	if (core.stoppedAtWatchpoint()) {
+		const CM0P_Memory::WatchHit &hit = core.getMemPtr()->getLastWatchHit();
+		printf("Stopped at watchpoint 0x%08x: %s of 0x%0*x at 0x%08x", hit.watchAddress, hit.write ? "write" : "read",
+			hit.width * 2, hit.value, hit.address);
+		if (hit.write)
+			printf(" (was 0x%0*x)", hit.width * 2, hit.oldValue);
+		printf(" by instruction 0x%08x\n", core.getWatchPC());
+	}
+
+	uint32_t* coreRegs = core.getCoreRegisters();
+	for (int i=0; i<16; i++) {
+		printf("R%-2d  0x%08x\n", i, coreRegs[i]);
+	}
+	printf("N=%d Z=%d C=%d V=%d\n", core.get_flag('N'), core.get_flag('Z'), core.get_flag('C'), core.get_flag('V'));
+	printf("Executed %lu instructions in %.3f s\n", (unsigned long)executed, elapsed);
+	return 0;
+}
+
 int main (int argc, char *argv[]) {
+	vector<string> asmPaths;
+	bool useAOT = false;
+	bool headless = false;
+	bool watch = false;
+	uint64_t headlessInsts = 0;
+	uint64_t lockstepInterval = 0;
+	uint32_t conformanceTrials = 0;
+	int asmLogLvl = ARMv6_Diagnostics::LOG_SUMMARY;
+	string asmJsonPath;
+	// Breakpoint and tracepoint arguments, set once the program is loaded
+	vector<pair<string, bool>> probeArgs;
+	vector<string> watchArgs;
+	for (int i=1; i<argc; i++) {
+		string arg = argv[i];
+		if (arg == "--aot") {
+			useAOT = true;
+		}
+		else if (arg == "--run" and i+1 < argc) {
+			headless = true;
+			headlessInsts = strtoull(argv[++i], NULL, 0);
+		}
+		else if (arg == "--lockstep" and i+1 < argc) {
+			lockstepInterval = strtoull(argv[++i], NULL, 0);
+		}
+		else if (arg == "--conformance" and i+1 < argc) {
+			conformanceTrials = strtoul(argv[++i], NULL, 0);
+		}
+		else if (arg == "--quiet") {
+			asmLogLvl = ARMv6_Diagnostics::LOG_QUIET;
+		}
+		else if (arg == "--verbose") {
+			asmLogLvl = ARMv6_Diagnostics::LOG_VERBOSE;
+		}
+		else if (arg == "--diagnostics" and i+1 < argc) {
+			asmJsonPath = argv[++i];
+		}
+		else if (arg == "--watch") {
+			watch = true;
+		}
+		else if (arg == "--break" and i+1 < argc) {
+			probeArgs.push_back({argv[++i], true});
+		}
+		else if (arg == "--trace" and i+1 < argc) {
+			probeArgs.push_back({argv[++i], false});
+		}
+		else if (arg == "--watchpoint" and i+1 < argc) {
+			watchArgs.push_back(argv[++i]);
+		}
+		else {
+			asmPaths.push_back(arg);
+		}
+	}
+	if (asmPaths.empty())
+		asmPaths.push_back("main.c.s");
 
-	ARMv6_Assembler assembler("main.c.s");
-	// assembler.hashUniqueCheck();
-	cout << endl << endl;
-	vector<pair<string, ARMv6_Assembler::OpcodeResult>> asmResults = assembler.getFinalResult();
-	vector<ARMv6_Assembler::OpcodeResult> opcodes;
-	for (auto &it: asmResults) {
-		opcodes.push_back(it.second);
+	// Check every 16-bit opcode against the reference model; no program needed
+	if (conformanceTrials > 0) {
+		CM0P_Conformance conformance(conformanceTrials);
+		auto start = chrono::steady_clock::now();
+		int failing = conformance.run();
+		double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		conformance.printSummary();
+		conformance.writeDatabase(CONFORMANCE_DB_PATH);
+		printf("[CONFORMANCE] %d of 65536 opcodes mismatch; %.1f s; written to %s\n", failing, elapsed, CONFORMANCE_DB_PATH.c_str());
+		return failing > 0;
+	}
+
+	// Unchanged sources are loaded from their cached object unless the full listing is
+	// wanted or the program may be reassembled later
+	ARMv6_Object object;
+	uint64_t sourceHash;
+	bool cached = !watch and asmLogLvl < ARMv6_Diagnostics::LOG_VERBOSE and asmJsonPath.empty()
+		and ARMv6_Object::hashFiles(asmPaths, sourceHash) and object.load(TRANSLATION_CACHE_DIR, sourceHash);
+	unique_ptr<ARMv6_Assembler> assembler;
+	// Built once and borrowed by the core and the TUI
+	ARMv6_Program program;
+	bool imageOnly = false;
+	if (cached) {
+		if (asmLogLvl > ARMv6_Diagnostics::LOG_QUIET)
+			cout << object.getSummary() << "; cached object" << endl;
+		// A plain headless run only needs the code
+		imageOnly = headless and !useAOT and lockstepInterval == 0 and probeArgs.empty();
+		if (!imageOnly)
+			program = object.getProgram();
+	}
+	else {
+		assembler.reset(new ARMv6_Assembler(asmPaths, asmLogLvl));
+		if (!asmJsonPath.empty() and !assembler->writeDiagnostics(asmJsonPath))
+			cout << "[ASSEMBLER] Unable to write diagnostics to " << asmJsonPath << endl;
+		program = assembler->getProgram();
+		assembler -> saveObject(TRANSLATION_CACHE_DIR, program);
 	}
+	if (asmLogLvl > ARMv6_Diagnostics::LOG_QUIET)
+		cout << endl;
 
-	CM0P_Core core(opcodes, assembler.getStartAddr());
+	// Check the fast execution path against the stepping interpreter
+	if (lockstepInterval > 0) {
+		CM0P_Lockstep lockstep(
+			[&]() {
+				return new CM0P_Core(program);
+			},
+			[&]() {
+				CM0P_Core* core = new CM0P_Core(program);
+				if (useAOT)
+					core -> enableAOT(program, TRANSLATION_CACHE_DIR);
+				return core;
+			}
+		);
+		CM0P_Lockstep::Report report = lockstep.run(headless ? headlessInsts : 100000000, lockstepInterval);
+		CM0P_Lockstep::printReport(report);
+		return report.diverged;
+	}
+
+	// An object's code is copied into memory as is
+	unique_ptr<CM0P_Core> corePtr(imageOnly
+		? new CM0P_Core(object.getCode(), object.getCodeSize(), object.getStartAddr())
+		: new CM0P_Core(program));
+	CM0P_Core &core = *corePtr;
+	int cachedBlocks = core.loadTranslationCache(TRANSLATION_CACHE_DIR);
+	if (cachedBlocks > 0)
+		cout << "[CORE] Loaded " << cachedBlocks << " translated blocks from cache." << endl;
+	if (useAOT) {
+		if (core.enableAOT(program, TRANSLATION_CACHE_DIR))
+			cout << "[CORE] Running ahead-of-time compiled program." << endl;
+		else
+			cout << "[CORE] Ahead-of-time compilation failed; using interpreter." << endl;
+	}
+
+	for (auto &it: probeArgs) {
+		string error;
+		if (!addProbe(core, program, it.first, it.second, error)) {
+			cout << "[CORE] " << (it.second ? "--break " : "--trace ") << it.first << ": " << error << endl;
+			return 1;
+		}
+	}
+	for (auto &it: watchArgs) {
+		string error;
+		if (!addWatchpoint(core, it, error)) {
+			cout << "[CORE] --watchpoint " << it << ": " << error << endl;
+			return 1;
+		}
+	}
+
+	if (headless) {
+		int ret = runHeadless(core, headlessInsts);
+		if (core.getTrace().getWritten() > 0) {
+			if (core.writeTrace(TRACE_PATH))
+				printf("[CORE] %lu tracepoint hits, last %u written to %s\n", (unsigned long)core.getTrace().getWritten(), core.getTrace().size(), TRACE_PATH.c_str());
+			else
+				printf("[CORE] Unable to write tracepoint hits to %s\n", TRACE_PATH.c_str());
+		}
+		core.saveTranslationCache(TRANSLATION_CACHE_DIR);
+		if (CM0P_Memory::HEATMAP) {
+			if (core.getMemPtr()->writeHeatmap(HEATMAP_PATH))
+				printf("[MEMORY] Access counts per %d bytes written to %s\n", 1 << CM0P_Memory::HEATMAP_LINE_BITS, HEATMAP_PATH.c_str());
+			else
+				printf("[MEMORY] Unable to write access counts to %s\n", HEATMAP_PATH.c_str());
+		}
+		return ret;
+	}
 	/*
 	for (auto &it: asmResults) {
 		core.step_inst();
@@ -37,19 +291,106 @@ int main (int argc, char *argv[]) {
 	return 0;
 	*/
 
-	ApplicationTUI appTui(&core, assembler.getLabels(), asmResults);
+	// Execution counts for the hot-spot view of the assembly window
+	core.enableProfile();
+	ApplicationTUI appTui(&core, &program);
+
+	// The core runs on its own thread; the UI holds it while handling a key or drawing
+	unique_ptr<CM0P_Runner> runner(new CM0P_Runner(core));
+	uint64_t drawnExecuted = 0;
+	// Redraw if the core ran since the last frame; leaves the core held
+	auto drawFrame = [&]() {
+		runner -> hold();
+		if (runner->getExecuted() == drawnExecuted)
+			return;
+		drawnExecuted = runner -> getExecuted();
+		appTui.updateRegisterWin();
+		appTui.updateFlagsWin();
+		appTui.updateASMWin();
+		appTui.updateLabelsWin();
+		appTui.memWinGoto(core.getCoreRegisters()[15]);
+	};
+	auto stepCore = [&]() {
+		runner -> send(CM0P_Runner::STEP);
+		// Let the core take the step before redrawing
+		runner -> release();
+		drawFrame();
+	};
+
+	// Telemetry is sampled at a low rate, or right away when the core stops or starts
+	auto lastStats = chrono::steady_clock::now();
+	CM0P_Runner::State shownState = CM0P_Runner::PAUSED;
+	auto updateStats = [&]() {
+		auto now = chrono::steady_clock::now();
+		if (runner->getState() == shownState and now - lastStats < chrono::milliseconds(STATS_INTERVAL_MS))
+			return;
+		lastStats = now;
+		CM0P_Runner::Stats stats = runner -> sample();
+		if (stats.state == CM0P_Runner::WATCHPOINT and shownState != CM0P_Runner::WATCHPOINT)
+			appTui.showWatchHit();
+		shownState = stats.state;
+		appTui.updateRunStats(stats);
+	};
+
+	// Reassemble and patch the running program whenever a source is saved
+	vector<unique_ptr<FileWatcher>> watchers;
+	if (watch) {
+		for (auto &path: asmPaths) {
+			watchers.emplace_back(new FileWatcher(path));
+		}
+	}
+	auto lastWatchPoll = chrono::steady_clock::now();
+	auto pollWatchers = [&]() {
+		auto now = chrono::steady_clock::now();
+		if (watchers.empty() or now - lastWatchPoll < chrono::milliseconds(WATCH_POLL_MS))
+			return;
+		lastWatchPoll = now;
+		bool changed = false;
+		for (auto &it: watchers) {
+			changed = it->changed() or changed;
+		}
+		// Assembling does not touch the core, so it keeps running meanwhile
+		if (!changed or !assembler->reassemble())
+			return;
+		runner -> hold();
+		program = assembler->getProgram();
+		uint32_t written = core.patchCode(program);
+		appTui.reloadProgram(&program, assembler->getSummary() + "; patched " + to_string(written) + " halfwords");
+	};
+
+	appTui.setIdleHandler([&]() {
+		// Only stop the core for a frame if there is something new to draw
+		if (runner->getExecuted() != drawnExecuted)
+			drawFrame();
+		updateStats();
+		pollWatchers();
+		runner -> release();
+	}, FRAME_INTERVAL_MS);
 
 	ApplicationTUI::winId currWin = appTui.memory;
 	appTui.selectWin(currWin);
 	bool loop = true;
 	bool winLoop = true;
+
+	// Wait for a key with the core released, then hold it while the key is handled
+	auto nextKey = [&]() {
+		while (true) {
+			runner -> release();
+			int key = appTui.getWinCh(currWin);
+			runner -> hold();
+			if (!runner->isRunning())
+				return key;
+			// Any key stops a run and is only used for that
+			runner -> send(CM0P_Runner::PAUSE);
+		}
+	};
 	
 	while(loop) {
 		switch(currWin) {
 			case ApplicationTUI::memory:
 				winLoop = true;
 				while(winLoop) {
-					switch(appTui.getWinCh(currWin)) {
+					switch(nextKey()) {
 						case 'q':
 							if (appTui.confirmExit()) {
 								loop = false;
@@ -106,12 +447,11 @@ int main (int argc, char *argv[]) {
 							winLoop = false;
 							break;
 						case 'n':
-							{
-								core.step_inst();
-								appTui.updateRegisterWin();
-								appTui.updateFlagsWin();
-								appTui.memWinGoto(core.getCoreRegisters()[15]);
-							}
+							stepCore();
+							break;
+						// Run until a key is pressed or the core halts
+						case 'r':
+							runner -> send(CM0P_Runner::RUN);
 							break;
 						case '/':
 							appTui.memWinGoto();
@@ -119,6 +459,18 @@ int main (int argc, char *argv[]) {
 						case '*':
 							appTui.memWinGoto(core.getCoreRegisters()[15]);
 							break;
+						case 's':
+							appTui.memWinSearch();
+							break;
+						case 'w':
+							appTui.memWinToggleWatchpoint();
+							break;
+						case 'f':
+							appTui.memWinSearchNext(false);
+							break;
+						case 'F':
+							appTui.memWinSearchNext(true);
+							break;
 						default:
 							break;
 					}
@@ -127,7 +479,7 @@ int main (int argc, char *argv[]) {
 			case ApplicationTUI::registers:
 				winLoop = true;
 				while (winLoop) {
-					switch(appTui.getWinCh(currWin)) {
+					switch(nextKey()) {
 						case 'q':
 							if (appTui.confirmExit()) {
 								loop = false;
@@ -145,6 +497,12 @@ int main (int argc, char *argv[]) {
 						case 'c':
 							appTui.regWinChangeReg();
 							break;
+						case 'n':
+							stepCore();
+							break;
+						case 'r':
+							runner -> send(CM0P_Runner::RUN);
+							break;
 						case '\t':
 							currWin = ApplicationTUI::assembly;
 							appTui.selectWin(ApplicationTUI::assembly);
@@ -158,12 +516,58 @@ int main (int argc, char *argv[]) {
 			case ApplicationTUI::assembly:
 				winLoop = true;
 				while (winLoop) {
-					switch(appTui.getWinCh(currWin)) {
+					switch(nextKey()) {
 						case '\t':
 							currWin = ApplicationTUI::memory;
 							appTui.selectWin(ApplicationTUI::memory);
 							winLoop = false;
 							break;
+						case KEY_DOWN:
+						case 'j':
+							appTui.scrollASMWin(1);
+							break;
+						case KEY_UP:
+						case 'k':
+							appTui.scrollASMWin(-1);
+							break;
+						case KEY_NPAGE:
+						case 'D':
+							appTui.scrollASMWin(20);
+							break;
+						case KEY_PPAGE:
+						case 'U':
+							appTui.scrollASMWin(-20);
+							break;
+						case 'g':
+							appTui.setPresetASMWin(0);
+							break;
+						case 'G':
+							appTui.setPresetASMWin(1);
+							break;
+						case '*':
+							appTui.setPresetASMWin(2);
+							break;
+						case 'b':
+							appTui.asmWinToggleBreakpoint();
+							break;
+						case 'B':
+							appTui.asmWinToggleLabelBreakpoint();
+							break;
+						case 'c':
+							appTui.asmWinSetProbe(true);
+							break;
+						case 't':
+							appTui.asmWinSetProbe(false);
+							break;
+						case 'T':
+							appTui.writeTrace(TRACE_PATH);
+							break;
+						case 'n':
+							stepCore();
+							break;
+						case 'r':
+							runner -> send(CM0P_Runner::RUN);
+							break;
 					}
 				}
 				break;
@@ -177,5 +581,7 @@ int main (int argc, char *argv[]) {
 	}
 
 	appTui.clean();
+	runner.reset();
+	core.saveTranslationCache(TRANSLATION_CACHE_DIR);
 	return 0;
 }
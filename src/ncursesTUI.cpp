@@ -5,12 +5,9 @@
 
 // void ApplicationTUI::resizeWin(int foo) {}
 
-ApplicationTUI::ApplicationTUI(
-		CM0P_Core* core,
-		unordered_map<string, uint32_t> labels,
-		vector<pair<string, ARMv6_Assembler::OpcodeResult>> asmResults
-	) {
+ApplicationTUI::ApplicationTUI(CM0P_Core* core, const ARMv6_Program* program) {
 	this -> core = core;
+	this -> program = program;
 
 	initscr();
 	cbreak();
@@ -30,11 +27,22 @@ ApplicationTUI::ApplicationTUI(
 
 	memWinWordPerLine = (winWidth/2 - 14) / 11;
 
+	// Hot-spot levels of the assembly window
+	if (has_colors()) {
+		start_color();
+		use_default_colors();
+		short heatColors[HEAT_LEVELS] = {COLOR_CYAN, COLOR_GREEN, COLOR_YELLOW, COLOR_RED};
+		for (int i=0; i<HEAT_LEVELS; i++) {
+			init_pair(i+1, heatColors[i], -1);
+			heatPairs[i] = i+1;
+		}
+	}
+
 	createMemoryWin();
-	createLabelsWin(labels);
+	createLabelsWin();
 	createFlagsWin();
 	createRegisterWin();
-	createASMWin(asmResults);
+	createASMWin();
 
 	selectWin(memory);
 }
@@ -44,17 +52,79 @@ void ApplicationTUI::clean() {
 }
 
 int ApplicationTUI::getWinCh(ApplicationTUI::winId id) {
-	return wgetch(getWin(id));
+	if (!idleHandler)
+		return wgetch(getWin(id));
+
+	WINDOW* win = getWin(id);
+	wtimeout(win, idleInterval);
+	int ch;
+	while ((ch = wgetch(win)) == ERR) {
+		idleHandler();
+	}
+	// Other prompts read from the same windows and expect to block
+	wtimeout(win, -1);
+	return ch;
+}
+
+void ApplicationTUI::setIdleHandler(function<void()> handler, int intervalMs) {
+	idleHandler = handler;
+	idleInterval = intervalMs;
+}
+
+void ApplicationTUI::reloadProgram(const ARMv6_Program* program, string msg) {
+	this -> program = program;
+	delwin(labelsWin);
+	delwin(asmWin);
+	createLabelsWin();
+	createASMWin();
+	// Keep the highlight on the assembly window
+	if (selectedWin == assembly) {
+		wattron(asmWin, A_BOLD);
+		wattron(asmWin, A_STANDOUT);
+		wborder(asmWin, '|', '|', '-', '-', '+', '+', '+', '+');
+		wattroff(asmWin, A_STANDOUT);
+		wattroff(asmWin, A_BOLD);
+		wrefresh(asmWin);
+	}
+
+	updateMemoryWin();
+	drawMemoryWinCursor();
+	updateRegisterWin();
+	updateFlagsWin();
+	createStatusWin(msg);
 }
 
 void ApplicationTUI::updateRegisterWin() {
 	uint32_t* coreRegs = core -> getCoreRegisters();
+	// Only registers that changed now or were highlighted for the last change are printed
+	uint16_t changed = 0;
+	for (int i=0; i<16; i++) {
+		if (regWinDrawn and coreRegs[i] != regWinValues[i])
+			changed |= 1 << i;
+	}
+	uint16_t redraw = regWinDrawn ? changed | regWinChanged : 0xFFFF;
+	regWinChanged = changed;
 	for (int i=0; i<16; i++) {
-		mvwprintw(registerWin, i+1, 17, "0x%08x", coreRegs[i]);
+		regWinValues[i] = coreRegs[i];
+		if (redraw >> i & 1)
+			printRegister(i);
 	}
+	regWinDrawn = true;
 	updateRegisterWinCursorVertical(0);
 }
 
+void ApplicationTUI::printRegister(int i) {
+	bool changed = regWinChanged >> i & 1;
+	bool selected = i == regWinCur-1;
+	if (changed)
+		wattron(registerWin, A_UNDERLINE);
+	if (selected)
+		wattron(registerWin, A_BOLD);
+	mvwprintw(registerWin, i+1, 17, "0x%08x", core->getCoreRegisters()[i]);
+	wattroff(registerWin, A_BOLD);
+	wattroff(registerWin, A_UNDERLINE);
+}
+
 void ApplicationTUI::regWinChangeReg() {
 	string ustr = "0x" + statusWinInputPrompt("New Register Value: 0x", 1);
 	int regVal = (int)strtol(ustr.c_str(), NULL, 0);
@@ -87,6 +157,8 @@ void ApplicationTUI::createStatusWin(string msg) {
 	// msg += separator + "/: goto address";
 	// mvwprintw(statusWin, 0, 0, "q: quit");
 	mvwprintw(statusWin, 0, 0, "%s", msg.c_str());
+	if (!runStats.empty())
+		mvwprintw(statusWin, 0, winWidth - 11 - runStats.size(), "%s", runStats.c_str());
 	wrefresh(statusWin);
 }
 void ApplicationTUI::updateStatusWin() {
@@ -94,6 +166,28 @@ void ApplicationTUI::updateStatusWin() {
 	wrefresh(statusWin);
 }
 
+void ApplicationTUI::updateRunStats(const CM0P_Runner::Stats &stats) {
+	const char* state = "PAUSED";
+	if (stats.state == CM0P_Runner::RUNNING)
+		state = "RUNNING";
+	else if (stats.state == CM0P_Runner::HALTED)
+		state = "HALTED";
+	else if (stats.state == CM0P_Runner::BREAKPOINT)
+		state = "BREAK";
+	else if (stats.state == CM0P_Runner::WATCHPOINT)
+		state = "WATCH";
+	char buf[128];
+	snprintf(buf, sizeof(buf), " %-7s %8.2f MIPS | cpu %3.0f%% | %lu inst | %.6f s ",
+		state, stats.mips, stats.hostLoad * 100, (unsigned long)stats.executed, stats.virtualTime);
+	// Clear what is left of a longer line
+	string line = buf;
+	if (line.size() < runStats.size())
+		line.insert(0, runStats.size() - line.size(), ' ');
+	runStats = buf;
+	mvwprintw(statusWin, 0, winWidth - 11 - line.size(), "%s", line.c_str());
+	wrefresh(statusWin);
+}
+
 void ApplicationTUI::createRegisterWin() {
 	// Create window
 	registerWin = newwin(18, 29, winHeight-19, winWidth/2-1);
@@ -244,6 +338,100 @@ void ApplicationTUI::memWinGoto(uint32_t address) {
 	updateStatusWin();
 }
 
+void ApplicationTUI::memWinSearch() {
+	string in = statusWinInputPrompt("Search b|h|w value [mask] : ", 0);
+	// Cancelled
+	if (in == " ")
+		return;
+	char kind = 0;
+	unsigned int value = 0, mask = 0xFFFFFFFF;
+	int n = sscanf(in.c_str(), " %c %x %x", &kind, &value, &mask);
+	int width = kind == 'b' ? 1 : kind == 'h' ? 2 : kind == 'w' ? 4 : 0;
+	if (n < 2 or width == 0) {
+		createStatusWin("Invalid search! Use b, h or w, a hex value and an optional hex mask, e.g. w deadbeef ffff0000.");
+		wgetch(memoryWin);
+		createStatusWin(getWinStat(selectedWin));
+		return;
+	}
+	memWinSearchSet = true;
+	memWinSearchValue = value;
+	memWinSearchMask = mask;
+	memWinSearchWidth = width;
+	// A new search includes the cursor
+	memWinSearchFrom((memWinPos+memWinCurY-1)*4*memWinWordPerLine + memWinCurX*2, false);
+}
+
+void ApplicationTUI::memWinSearchNext(bool backward) {
+	if (!memWinSearchSet)
+		return;
+	uint32_t cursor = (memWinPos+memWinCurY-1)*4*memWinWordPerLine + memWinCurX*2;
+	// Continue from the last match unless the cursor was moved away from it
+	uint32_t from = (memWinSearchFound & ~1) == cursor ? memWinSearchFound : cursor;
+	if (backward and from == 0) {
+		createStatusWin(" No earlier match");
+		return;
+	}
+	memWinSearchFrom(backward ? from - 1 : from + 1, backward);
+}
+
+void ApplicationTUI::memWinToggleWatchpoint() {
+	uint32_t addr = (memWinPos+memWinCurY-1)*4*memWinWordPerLine + memWinCurX*2;
+	char buf[96];
+	if (core->clearWatchpoint(addr)) {
+		snprintf(buf, sizeof(buf), " Watchpoint at %08x cleared; %lu set", addr, (unsigned long)core->getMemPtr()->getWatchpoints().size());
+	}
+	else {
+		string in = statusWinInputPrompt("Watch r|w|c [length] : ", 0);
+		// Cancelled
+		if (in == " ")
+			return;
+		char kindText[8] = "";
+		unsigned int length = 2;
+		sscanf(in.c_str(), " %7s %u", kindText, &length);
+		uint8_t kinds = CM0P_Memory::parseWatchKinds(kindText);
+		if (kinds == 0 or !core->setWatchpoint(addr, length, kinds)) {
+			createStatusWin("Invalid watchpoint! Use r, w, c or a mix such as rw, and an optional length in bytes.");
+			wgetch(memoryWin);
+			createStatusWin(getWinStat(selectedWin));
+			return;
+		}
+		snprintf(buf, sizeof(buf), " Watching %s%s%s of %08x+%u; %lu set", kinds & CM0P_Memory::WATCH_READ ? "r" : "",
+			kinds & CM0P_Memory::WATCH_WRITE ? "w" : "", kinds & CM0P_Memory::WATCH_CHANGE ? "c" : "", addr, length,
+			(unsigned long)core->getMemPtr()->getWatchpoints().size());
+	}
+	createStatusWin(buf);
+	// Watched words are drawn bold; print every row again
+	memWinDrawnPos = -1;
+	updateMemoryWin();
+	drawMemoryWinCursor();
+}
+
+void ApplicationTUI::showWatchHit() {
+	const CM0P_Memory::WatchHit &hit = core->getMemPtr()->getLastWatchHit();
+	char buf[128];
+	int n = snprintf(buf, sizeof(buf), " Watchpoint %08x: %s of %0*x at %08x", hit.watchAddress,
+		hit.write ? "write" : "read", hit.width * 2, hit.value, hit.address);
+	if (hit.write)
+		n += snprintf(buf + n, sizeof(buf) - n, " (was %0*x)", hit.width * 2, hit.oldValue);
+	snprintf(buf + n, sizeof(buf) - n, " by %08x", core->getWatchPC());
+	createStatusWin(buf);
+}
+
+void ApplicationTUI::memWinSearchFrom(uint32_t start, bool backward) {
+	uint32_t found;
+	if (!core->getMemPtr()->search(start, memWinSearchValue, memWinSearchMask, memWinSearchWidth, backward, found)) {
+		createStatusWin(backward ? " No earlier match" : " No later match");
+		return;
+	}
+	memWinSearchFound = found;
+	memWinGoto(found);
+	char msg[96];
+	snprintf(msg, sizeof(msg), " Found %0*x at %08x | f: next | F: previous", memWinSearchWidth*2,
+		memWinSearchValue & memWinSearchMask, found);
+	createStatusWin(msg);
+	updateStatusWin();
+}
+
 void ApplicationTUI::createMemoryWin() {
 	memoryWin = newwin(winHeight-1, winWidth/2, 0, 0);
 	keypad(memoryWin, TRUE);
@@ -267,50 +455,315 @@ void ApplicationTUI::createFlagsWin() {
 	wborder(flagsWin, '|', '|', '-', '-', '+', '+', '+', '+');
 	wrefresh(flagsWin);
 }
-void ApplicationTUI::createLabelsWin(unordered_map<string, uint32_t> labels) {
+void ApplicationTUI::createLabelsWin() {
 	labelsWin = newwin(winHeight-23, 29, 0, winWidth/2-1);
 	mvwprintw(labelsWin, 1, 2, "-- Labels --");
 	// Sort labels by their memory addresses
-	vector<pair<string, uint32_t>> sortedLabels(labels.begin(), labels.end());
+	const unordered_map<string, uint32_t> &labels = program->getLabels();
+	sortedLabels.clear();
+	sortedLabels.reserve(labels.size());
+	for (auto &it: labels) {
+		sortedLabels.push_back(&it);
+	}
 	sort(sortedLabels.begin(), sortedLabels.end(),
-		[](pair<string, uint32_t>&a,pair<string, uint32_t>&b) {
-			return a.second < b.second;
+		[](const pair<const string, uint32_t>* a, const pair<const string, uint32_t>* b) {
+			return a->second < b->second;
 		}
 	);
-	int i=2;
-	for (auto &it: sortedLabels) {
-		mvwprintw(labelsWin, i, 2, "%08x   %s", it.second, it.first.c_str());
-		i++;
-	}
+	labelsView = ListView();
+	labelsView.win = labelsWin;
+	labelsView.firstRow = 2;
+	labelsView.rows = max(0, winHeight - 26);
+	labelsView.width = 25;
+	labelsView.count = sortedLabels.size();
+	labelsView.line = [this](size_t i) {
+		char buf[16];
+		snprintf(buf, sizeof(buf), "%08x   ", sortedLabels[i]->second);
+		return buf + sortedLabels[i]->first;
+	};
+	updateLabelsWin();
+	drawListView(labelsView);
 	wborder(labelsWin, '|', '|', '-', '-', '+', '+', '+', '+');
 	wrefresh(labelsWin);
 }
 
-void ApplicationTUI::createASMWin(vector<pair<string, ARMv6_Assembler::OpcodeResult>> asmResults) {
-	asmWin = newwin(winHeight-1, winWidth/2-28, 0, winWidth/2+27);
-	int maxLine = winHeight - 0;
-	if (maxLine > asmResults.size())
-		maxLine = asmResults.size();
-	int addr = core->getBaseAddr();
-	for (int i=0; i<maxLine; i++) {
-		ARMv6_Assembler::OpcodeResult ores = asmResults.at(i).second;
-		// mvwprintw(asmWin, i, 2, "%08x %s", addr, asmResults.at(i-1).first.c_str());
-		mvwprintw(asmWin, i+1, 2, "%08x %08x %s", addr, ores.opcode, asmResults.at(i).first.c_str());
-		addr += (ores.i32+1) * 2;
+// Count in at most 6 characters
+static string formatCount(uint64_t count) {
+	char buf[16];
+	const char* units = " kMGTPE";
+	double value = count;
+	int unit = 0;
+	while (value >= 1e6 or (unit > 0 and value >= 1000)) {
+		value /= 1000;
+		unit++;
 	}
+	if (unit == 0)
+		snprintf(buf, sizeof(buf), "%lu", (unsigned long)count);
+	else
+		snprintf(buf, sizeof(buf), value < 100 ? "%.2f%c" : "%.1f%c", value, units[unit]);
+	return buf;
+}
+
+void ApplicationTUI::createASMWin() {
+	asmWin = newwin(winHeight-1, winWidth/2-28, 0, winWidth/2+27);
+	keypad(asmWin, TRUE);
+	asmView = ListView();
+	asmView.win = asmWin;
+	asmView.firstRow = 1;
+	asmView.rows = max(0, winHeight - 3);
+	asmView.width = max(0, winWidth/2 - 32);
+	asmView.count = program->size();
+	asmView.line = [this](size_t i) {
+		ARMv6_Program::Instruction inst = program->at(i);
+		uint64_t count = core->getProfileCount(inst.addr);
+		uint64_t total = core->getProfileTotal();
+		char buf[48];
+		const CM0P_Probe* probe = core->getProbe(inst.addr);
+		snprintf(buf, sizeof(buf), "%c%08x %6s %5.1f%% %08x ", probe ? probe->kind() : ' ', inst.addr, formatCount(count).c_str(), total ? 100.0 * count / total : 0.0, inst.opcode);
+		return buf + string(inst.text);
+	};
+	// Share of all counted instructions: any, 0.1%, 1%, 10%
+	asmView.attr = [this](size_t i) {
+		uint64_t count = core->getProfileCount(program->at(i).addr);
+		uint64_t total = core->getProfileTotal();
+		if (count == 0)
+			return 0;
+		int level = 0;
+		if (count * 1000 >= total)
+			level++;
+		if (count * 100 >= total)
+			level++;
+		if (count * 10 >= total)
+			level++;
+		return (int)COLOR_PAIR(heatPairs[level]);
+	};
+	asmDrawnTotal = core -> getProfileTotal();
+	updateASMWin();
+	asmView.cursor = max<int64_t>(asmView.marked, 0);
+	drawListView(asmView);
 	wborder(asmWin, '|', '|', '-', '-', '+', '+', '+', '+');
 	wrefresh(asmWin);
 }
 
+void ApplicationTUI::updateASMWin() {
+	size_t i;
+	size_t top = asmView.top;
+	if (program->find(core->getCoreRegisters()[15], i))
+		markListItem(asmView, i);
+	else
+		markListItem(asmView, -1);
+	// Counts changed; a scroll has already drawn them
+	if (core->getProfileTotal() != asmDrawnTotal and asmView.top == top)
+		drawListView(asmView);
+	asmDrawnTotal = core -> getProfileTotal();
+	wrefresh(asmWin);
+}
+
+void ApplicationTUI::updateLabelsWin() {
+	// Last label at or before the PC
+	uint32_t pc = core->getCoreRegisters()[15];
+	auto it = upper_bound(sortedLabels.begin(), sortedLabels.end(), pc,
+		[](uint32_t addr, const pair<const string, uint32_t>* label) {
+			return addr < label->second;
+		}
+	);
+	markListItem(labelsView, (int64_t)(it - sortedLabels.begin()) - 1);
+	wrefresh(labelsWin);
+}
+
+void ApplicationTUI::scrollASMWin(int64_t lines) {
+	moveListCursor(asmView, asmView.cursor + lines);
+	wrefresh(asmWin);
+}
+
+void ApplicationTUI::setPresetASMWin(int moveid) {
+	switch (moveid) {
+		// First instruction
+		case 0:
+			moveListCursor(asmView, 0);
+			break;
+		// Last instruction
+		case 1:
+			moveListCursor(asmView, asmView.count);
+			break;
+		// Instruction at the PC
+		case 2:
+			if (asmView.marked >= 0) {
+				scrollListView(asmView, asmView.marked - asmView.rows / 3);
+				moveListCursor(asmView, asmView.marked);
+			}
+			break;
+		default:
+			break;
+	}
+	wrefresh(asmWin);
+}
+
+void ApplicationTUI::asmWinToggleBreakpoint() {
+	if (asmView.cursor < 0 or (size_t)asmView.cursor >= asmView.count)
+		return;
+	uint32_t addr = program->at(asmView.cursor).addr;
+	bool set = core -> toggleBreakpoint(addr);
+	char buf[64];
+	snprintf(buf, sizeof(buf), " Breakpoint %s at %08x; %u set", set ? "set" : "cleared", addr,
+		core->getBreakpointCount());
+	createStatusWin(buf);
+	drawListRow(asmView, asmView.cursor);
+	wrefresh(asmWin);
+}
+
+void ApplicationTUI::asmWinToggleLabelBreakpoint() {
+	string in = statusWinInputPrompt("Breakpoint at label : ", 0);
+	// Cancelled
+	if (in == " ")
+		return;
+	// The prompt ends its input with a null character
+	string name = in.substr(0, in.find('\0'));
+	auto it = program->getLabels().find(name);
+	if (it == program->getLabels().end()) {
+		createStatusWin(" No label " + name);
+		return;
+	}
+	bool set = core -> toggleBreakpoint(it->second);
+	char buf[64];
+	snprintf(buf, sizeof(buf), " at %08x; %u set", it->second, core->getBreakpointCount());
+	createStatusWin(string(set ? " Breakpoint set on " : " Breakpoint cleared on ") + name + buf);
+	size_t i;
+	if (program->find(it->second, i)) {
+		moveListCursor(asmView, i);
+		drawListRow(asmView, i);
+	}
+	wrefresh(asmWin);
+}
+
+void ApplicationTUI::asmWinSetProbe(bool stop) {
+	if (asmView.cursor < 0 or (size_t)asmView.cursor >= asmView.count)
+		return;
+	uint32_t addr = program->at(asmView.cursor).addr;
+	string in = statusWinInputPrompt(stop ? "Break if : " : "Trace value, ... [if condition] : ", 0);
+	// Cancelled
+	if (in == " ")
+		return;
+	in = in.substr(0, in.find('\0'));
+	string error;
+	CM0P_Probe probe;
+	char buf[64];
+	if (in.find_first_not_of(' ') == string::npos) {
+		core -> clearProbe(addr);
+		snprintf(buf, sizeof(buf), " Cleared %08x; %u set", addr, core->getBreakpointCount());
+		createStatusWin(buf);
+	}
+	else if (!probe.parse(stop ? "if " + in : in, stop, error)) {
+		createStatusWin(" " + error);
+	}
+	else {
+		core -> setProbe(addr, probe);
+		snprintf(buf, sizeof(buf), " at %08x; %u set", addr, core->getBreakpointCount());
+		createStatusWin(string(stop ? " Conditional breakpoint" : " Tracepoint") + buf);
+	}
+	drawListRow(asmView, asmView.cursor);
+	wrefresh(asmWin);
+}
+
+void ApplicationTUI::writeTrace(string path) {
+	CM0P_TraceBuffer &trace = core -> getTrace();
+	char buf[128];
+	if (core->writeTrace(path))
+		snprintf(buf, sizeof(buf), " %lu tracepoint hits, last %u written to %s", (unsigned long)trace.getWritten(), trace.size(), path.c_str());
+	else
+		snprintf(buf, sizeof(buf), " Unable to write %s", path.c_str());
+	createStatusWin(buf);
+}
+
+void ApplicationTUI::drawListView(ListView &view) {
+	for (int row=0; row<view.rows; row++) {
+		drawListRow(view, view.top + row);
+	}
+}
+
+void ApplicationTUI::drawListRow(ListView &view, size_t item) {
+	if (item < view.top or item >= view.top + view.rows)
+		return;
+	string text;
+	if (item < view.count)
+		text = view.line(item);
+	// Pad to clear what was shown before
+	text.resize(view.width, ' ');
+	int attr = item < view.count and view.attr ? view.attr(item) : 0;
+	if ((int64_t)item == view.marked)
+		attr |= A_REVERSE;
+	if ((int64_t)item == view.cursor)
+		attr |= A_BOLD;
+	wattron(view.win, attr);
+	mvwprintw(view.win, view.firstRow + (item - view.top), 2, "%s", text.c_str());
+	wattroff(view.win, attr);
+}
+
+void ApplicationTUI::scrollListView(ListView &view, int64_t top) {
+	// Last page ends with the last item
+	int64_t maxTop = (int64_t)view.count - view.rows;
+	if (top > maxTop)
+		top = maxTop;
+	if (top < 0)
+		top = 0;
+	if ((size_t)top == view.top)
+		return;
+	view.top = top;
+	drawListView(view);
+}
+
+void ApplicationTUI::markListItem(ListView &view, int64_t item) {
+	if (item == view.marked)
+		return;
+	int64_t prev = view.marked;
+	view.marked = item;
+	// Keep the marked item in the upper part of the view
+	if (item >= 0 and (item < (int64_t)view.top or item >= (int64_t)view.top + view.rows)) {
+		size_t top = view.top;
+		scrollListView(view, item - view.rows / 3);
+		if (top != view.top)
+			return;
+	}
+	if (prev >= 0)
+		drawListRow(view, prev);
+	if (item >= 0)
+		drawListRow(view, item);
+}
+
+void ApplicationTUI::moveListCursor(ListView &view, int64_t item) {
+	if (item >= (int64_t)view.count)
+		item = (int64_t)view.count - 1;
+	if (item < 0)
+		item = 0;
+	int64_t prev = view.cursor;
+	view.cursor = item;
+	size_t top = view.top;
+	if (item < (int64_t)view.top)
+		scrollListView(view, item);
+	else if (item >= (int64_t)view.top + view.rows)
+		scrollListView(view, item - view.rows + 1);
+	if (top != view.top)
+		return;
+	if (prev >= 0)
+		drawListRow(view, prev);
+	drawListRow(view, item);
+}
+
 void ApplicationTUI::removeMemoryWinCursor() {
-	HALFWORD hword = core->getMemPtr() -> read_halfword((memWinPos+memWinCurY-1)*4*memWinWordPerLine + memWinCurX*2);
+	uint32_t addr = (memWinPos+memWinCurY-1)*4*memWinWordPerLine + memWinCurX*2;
+	HALFWORD hword = core->getMemPtr() -> peek_halfword(addr);
+	int attr = memHeatAttr(memHeatLevel(addr));
+	if (core->getMemPtr()->isWatched(addr, 2))
+		attr |= A_BOLD;
+	wattron(memoryWin, attr);
 	mvwprintw(memoryWin, memWinCurY, memWinCurX*5 + 14 + memWinCurX/2, "%04x", hword);
+	wattroff(memoryWin, attr);
 	wrefresh(memoryWin);
 }
 void ApplicationTUI::drawMemoryWinCursor() {
 	wattron(memoryWin, A_BOLD);
 	wattron(memoryWin, A_STANDOUT);
-	HALFWORD hword = core->getMemPtr() -> read_halfword((memWinPos+memWinCurY-1)*4*memWinWordPerLine + memWinCurX*2);
+	HALFWORD hword = core->getMemPtr() -> peek_halfword((memWinPos+memWinCurY-1)*4*memWinWordPerLine + memWinCurX*2);
 	mvwprintw(memoryWin, memWinCurY, memWinCurX*5 + 14 + memWinCurX/2, "%04x", hword);
 	wattroff(memoryWin, A_STANDOUT);
 	wattroff(memoryWin, A_BOLD);
@@ -385,17 +838,92 @@ void ApplicationTUI::updateMemoryWinCursorHorizontal(int cols) {
 	updateStatusWin();
 }
 
+int ApplicationTUI::memHeatLevel(uint32_t addr) {
+	if (!CM0P_Memory::HEATMAP)
+		return -1;
+	CM0P_Memory* mem = core -> getMemPtr();
+	uint64_t accesses = mem->getReadCount(addr) + mem->getWriteCount(addr);
+	if (accesses == 0)
+		return -1;
+	// Any, a thousand, 100 thousand and 10 million accesses
+	int level = 0;
+	for (uint64_t step=1000; level < HEAT_LEVELS-1 and accesses >= step; step*=100) {
+		level++;
+	}
+	return level;
+}
+
+int ApplicationTUI::memHeatAttr(int level) {
+	return level >= 0 ? (int)COLOR_PAIR(heatPairs[level]) : 0;
+}
+
 void ApplicationTUI::updateMemoryWin() {
-	// Highlight selected
-	for (int i=0; i<winHeight-3; i++) {
-		// Address of line
-		mvwprintw(memoryWin, i+1, 2, "%08x", (memWinPos+i)*4*memWinWordPerLine);
-		// Value in each memory space
+	CM0P_Memory* mem = core -> getMemPtr();
+	int rows = winHeight - 3;
+	uint32_t rowBytes = 4*memWinWordPerLine;
+	uint64_t generation = mem -> getGeneration();
+	if (memWinRows.size() != (size_t)rows)
+		memWinRows.assign(rows, MemWinRow());
+
+	// Keep rows still in view after scrolling so they are not formatted again
+	bool scrolled = memWinPos != memWinDrawnPos;
+	int shift = memWinPos - memWinDrawnPos;
+	if (memWinDrawnPos >= 0 and shift > 0 and shift < rows)
+		rotate(memWinRows.begin(), memWinRows.begin() + shift, memWinRows.end());
+	else if (memWinDrawnPos >= 0 and shift < 0 and -shift < rows)
+		rotate(memWinRows.begin(), memWinRows.end() + shift, memWinRows.end());
+
+	for (int i=0; i<rows; i++) {
+		MemWinRow &row = memWinRows[i];
+		uint32_t addr = (memWinPos+i)*rowBytes;
+		bool cached = row.addr == addr;
+		// Unchanged rows are only printed again when they moved
+		bool dirty = !cached or row.highlighted or mem->changedSince(addr, rowBytes, memWinGeneration);
+		bool printed = dirty or scrolled;
+
+		// Words written since the last draw are highlighted until the next one
+		vector<bool> changed(memWinWordPerLine);
+		if (dirty) {
+			row.words.resize(memWinWordPerLine);
+			row.highlighted = false;
+			char buf[16];
+			snprintf(buf, sizeof(buf), "%08x    ", addr);
+			row.text = buf;
+			for (int j=0; j<memWinWordPerLine; j++) {
+				WORD word = mem->peek_word(addr + j*4);
+				changed[j] = cached and word != row.words[j];
+				row.highlighted = row.highlighted or changed[j];
+				row.words[j] = word;
+				snprintf(buf, sizeof(buf), "%04x %04x  ", word>>16, word&0xFFFF);
+				row.text += buf;
+			}
+			row.text.resize(row.text.size() - 2);
+			row.addr = addr;
+		}
+		if (printed)
+			mvwprintw(memoryWin, i+1, 2, "%s", row.text.c_str());
+		if (!printed and !CM0P_Memory::HEATMAP)
+			continue;
+
+		// Words printed plain so far, or shaded differently from their access counts
+		row.heat.resize(memWinWordPerLine, -1);
 		for (int j=0; j<memWinWordPerLine; j++) {
-			WORD word = core->getMemPtr()->read_word((memWinPos+i)*4*memWinWordPerLine + j*4);
-			mvwprintw(memoryWin, i+1, j*11 + 14, "%04x %04x", word>>16, word&0xFFFF);
+			int level = memHeatLevel(addr + j*4);
+			if (!printed and level == row.heat[j])
+				continue;
+			row.heat[j] = level;
+			int attr = (changed[j] ? A_UNDERLINE : 0) | memHeatAttr(level);
+			if (mem->isWatched(addr + j*4, 4))
+				attr |= A_BOLD;
+			if (printed and attr == 0)
+				continue;
+			wattron(memoryWin, attr);
+			mvwprintw(memoryWin, i+1, j*11 + 14, "%.9s", row.text.c_str() + 12 + j*11);
+			wattroff(memoryWin, attr);
 		}
 	}
+	memWinDrawnPos = memWinPos;
+	memWinGeneration = generation;
 }
 
 void ApplicationTUI::setPresetMemWinCur(int moveid) {
@@ -453,15 +981,16 @@ WINDOW* ApplicationTUI::getWin(ApplicationTUI::winId id) {
 string ApplicationTUI::getWinStat(winId id) {
 	switch(id) {
 		case memory:
-			return " q: quit | n: next instruction | h,j,k,l/arrow keys: navigate | H: View top | L: View bottom | /: goto address | *: goto PC";
+			return " q: quit | n: step | r: run | hjkl: move | H/L: top/bottom | /: goto | *: PC | s/f/F: search | w: watch";
 		case registers:
-			return " q: quit | j:down | k:up | c: change register value";
+			return " q: quit | j:down | k:up | c: change register value | n: step | r: run, any key pauses";
+		case assembly:
+			return " j,k,D,U,g,G,*: move | b/B: break here/label | c: break if | t: trace | T: save trace";
 		case help:
 		case opcode:
 		case status:
 		case flags:
 		case labels:
-		case assembly:
 		default:
 			return "";
 	}
@@ -505,7 +1034,7 @@ void ApplicationTUI::updateFlagsWin() {
 }
 
 void ApplicationTUI::updateRegisterWinCursorVertical(int lines) {
-	mvwprintw(registerWin, regWinCur, 17, "0x%08x", core->getCoreRegisters()[regWinCur-1]);
+	int prevCur = regWinCur;
 
 	if (lines != 0) {
 		if (lines > 0) {
@@ -526,9 +1055,8 @@ void ApplicationTUI::updateRegisterWinCursorVertical(int lines) {
 		}
 	}
 
-	wattron(registerWin, A_BOLD);
-	mvwprintw(registerWin, regWinCur, 17, "0x%08x", core->getCoreRegisters()[regWinCur-1]);
-	wattroff(registerWin, A_BOLD);
+	printRegister(prevCur-1);
+	printRegister(regWinCur-1);
 	wrefresh(registerWin);
 }
 
@@ -4,7 +4,10 @@
 #include "cortex-m0p_memory.h"
 #include "ncurses.h"
 #include "cortex-m0p_core.h"
+#include "cortex-m0p_runner.h"
+#include <functional>
 #include <string>
+#include <vector>
 // #include "form.h"
 using namespace std;
 
@@ -29,6 +32,8 @@ class ApplicationTUI {
 		int memWinWordPerLine;
 
 		CM0P_Core* core;
+		// Program shown in the labels and assembly windows; owned by the caller
+		const ARMv6_Program* program;
 
 		// Avaliable max size of the application
 		int winWidth, winHeight;
@@ -38,30 +43,95 @@ class ApplicationTUI {
 		int memWinCurX = 0, memWinCurY = 1;
 		int regWinCur = 16;
 
-		WINDOW *helpWin;		// Help menu
-		WINDOW *memoryWin;
-		WINDOW *opcodeWin;
-		WINDOW *statusWin;		// Keybinds / current window
-		WINDOW *registerWin;	// Register values
-		WINDOW *flagsWin;
-		WINDOW *labelsWin;
-		WINDOW *asmWin;
+		// Last pattern searched for in memory
+		bool memWinSearchSet = false;
+		uint32_t memWinSearchValue = 0, memWinSearchMask = 0;
+		int memWinSearchWidth = 0;
+		uint32_t memWinSearchFound = 0;
+
+		// Rows of the memory window as last drawn; only rows whose pages were written
+		// since memWinGeneration are read and formatted again
+		struct MemWinRow {
+			int64_t addr = -1;		// -1 until drawn
+			vector<WORD> words;
+			string text;			// Address and words as printed
+			bool highlighted = false;
+			vector<int8_t> heat;	// Access level each word is shaded with
+		};
+		vector<MemWinRow> memWinRows;
+		int memWinDrawnPos = -1;
+		uint64_t memWinGeneration = 0;
+
+		// Registers as last drawn and those that changed then
+		uint32_t regWinValues[16] = {};
+		uint16_t regWinChanged = 0;
+		bool regWinDrawn = false;
+
+		// Help and opcode windows are never created
+		WINDOW *helpWin = nullptr;		// Help menu
+		WINDOW *memoryWin = nullptr;
+		WINDOW *opcodeWin = nullptr;
+		WINDOW *statusWin = nullptr;	// Keybinds / current window
+		WINDOW *registerWin = nullptr;	// Register values
+		WINDOW *flagsWin = nullptr;
+		WINDOW *labelsWin = nullptr;
+		WINDOW *asmWin = nullptr;
 
 		// Array of text in each left and right window
 		string *leftWinTxt, *rightWinText;
 
 		vector<string> asmSrc;
 
+		// Window listing one item per line; only the visible slice is printed, so the
+		// cost of a redraw does not depend on the number of items
+		struct ListView {
+			WINDOW* win = nullptr;
+			int firstRow = 0;		// Window line of the first visible item
+			int rows = 0;			// Visible items
+			int width = 0;			// Characters per line
+			size_t count = 0;		// Items in the list
+			size_t top = 0;			// First visible item
+			int64_t marked = -1;	// Item shown highlighted, -1 for none
+			int64_t cursor = -1;	// Item shown bold, -1 for none
+			function<string(size_t)> line;	// Text of an item
+			function<int(size_t)> attr;		// Attributes of an item; optional
+		};
+		ListView asmView, labelsView;
+		// Profile total when the assembly window was last drawn
+		uint64_t asmDrawnTotal = 0;
+		// Color pairs of the hot-spot levels, coolest first; 0 without colors
+		const static int HEAT_LEVELS = 4;
+		int heatPairs[HEAT_LEVELS] = {};
+		// Labels of the program ordered by address
+		vector<const pair<const string, uint32_t>*> sortedLabels;
+
+		void drawListView(ListView &view);
+		void drawListRow(ListView &view, size_t item);
+		// Show items from top on, kept within the list
+		void scrollListView(ListView &view, int64_t top);
+		// Highlight an item and scroll to it if it is out of view
+		void markListItem(ListView &view, int64_t item);
+		// Move the cursor to an item, kept within the list and in view
+		void moveListCursor(ListView &view, int64_t item);
+
+		// Telemetry of the running core shown at the right of the status bar
+		string runStats;
+
+		// Called while waiting for keys; see setIdleHandler()
+		function<void()> idleHandler;
+		int idleInterval = 0;
+
 		void resizeWin(int foo);
 		void createStatusWin(string msg);
 		void createRegisterWin();
 		void createMemoryWin();
 		void createFlagsWin();
-		void createLabelsWin(unordered_map<string, uint32_t> labels);
-		void createASMWin(vector<pair<string, ARMv6_Assembler::OpcodeResult>> asmResults);
+		void createLabelsWin();
+		void createASMWin();
 		void updateStatusWin();
 
-		winId selectedWin;
+		// Nothing is selected until the constructor selects the memory window
+		winId selectedWin = help;
 		WINDOW* getWin(winId id);
 		// Get status bar message for given window
 		string getWinStat(winId id);
@@ -69,16 +139,44 @@ class ApplicationTUI {
 		// Input type: 0 for all, 1 for hex only, 2 for num only
 		string statusWinInputPrompt(string prompt, int inType);
 
+		// Shade of the access count of a memory line, -1 if never accessed or not counted
+		int memHeatLevel(uint32_t addr);
+		int memHeatAttr(int level);
+
+		// Search from an address and go to the match
+		void memWinSearchFrom(uint32_t start, bool backward);
+
 		void removeMemoryWinCursor();
 		void drawMemoryWinCursor();
+		// Print register i, underlined if it changed and bold under the cursor
+		void printRegister(int i);
 
 	public:
 		// Constructor
-		ApplicationTUI(CM0P_Core* core, unordered_map<string, uint32_t> labels, vector<pair<string, ARMv6_Assembler::OpcodeResult>> asmResults);
+		ApplicationTUI(CM0P_Core* core, const ARMv6_Program* program);
 
 		void updateRegisterWin();
 		void updateMemoryWin();
 		void updateFlagsWin();
+		// Highlight the instruction and label at the PC, scrolling them into view; the
+		// execution counts of the visible instructions are refreshed as well
+		void updateASMWin();
+		void updateLabelsWin();
+		// Move the cursor of the assembly window by lines, or to the first or last
+		// instruction or the PC
+		void scrollASMWin(int64_t lines);
+		void setPresetASMWin(int moveid);
+		// Set or clear a breakpoint on the instruction under the cursor, or at a label
+		// from prompt
+		void asmWinToggleBreakpoint();
+		void asmWinToggleLabelBreakpoint();
+		// Set a conditional breakpoint or a tracepoint on the instruction under the cursor
+		// from prompt; an empty prompt clears it
+		void asmWinSetProbe(bool stop);
+		// Write the values recorded by tracepoints to path
+		void writeTrace(string path);
+		// Show the latest telemetry of the core in the status bar
+		void updateRunStats(const CM0P_Runner::Stats &stats);
 
 		// Update cursor of memory window
 		void updateMemoryWinCursorVertical(int lines);
@@ -88,12 +186,25 @@ class ApplicationTUI {
 		// Set cursor to address or from prompt
 		void memWinGoto();
 		void memWinGoto(uint32_t address);
+		// Search memory for a pattern from prompt, starting at the cursor
+		void memWinSearch();
+		// Go to the next or previous match of the last search
+		void memWinSearchNext(bool backward);
+		// Watch the halfword under the cursor, or more, with kinds from prompt; clears the
+		// watchpoint there if there is one
+		void memWinToggleWatchpoint();
+		// Show the access that stopped the core in the status bar
+		void showWatchHit();
 
 		// Update cursor of register window
 		void updateRegisterWinCursorVertical(int lines);
 
 		// Get key press given window
 		int getWinCh(winId id);
+		// Call handler about every intervalMs while waiting for a key
+		void setIdleHandler(function<void()> handler, int intervalMs);
+		// Redraw labels, assembly and memory after the program was reassembled
+		void reloadProgram(const ARMv6_Program* program, string msg);
 		// Update selected window and highlight
 		void selectWin(winId id);
 		// Change PC with user input